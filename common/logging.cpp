@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "logging.h"
+
+#include <cstdlib> // getenv()
+#include <sstream>
+
+namespace Logging
+{
+
+static uint32_t parseCategories (const std::string& categories)
+{
+    static const struct
+    {
+        const char* name;
+        Category category;
+    } names[] =
+    {
+        {"general", Category::GENERAL},
+        {"dbus", Category::DBUS},
+        {"items", Category::ITEMS},
+        {"http", Category::HTTP},
+    };
+
+    uint32_t mask = 0;
+    std::istringstream stream(categories);
+    std::string name;
+
+    while (std::getline(stream, name, ','))
+    {
+        if (name == "all")
+        {
+            mask = ~0u;
+            continue;
+        }
+
+        for (const auto& entry : names)
+        {
+            if (name == entry.name)
+            {
+                mask |= 1u << static_cast<uint32_t>(entry.category);
+            }
+        }
+    }
+
+    return mask;
+}
+
+static uint32_t initialCategories ()
+{
+    auto env = getenv("PAY_LOG_CATEGORIES");
+    return env == nullptr ? 0 : parseCategories(env);
+}
+
+std::atomic<uint32_t> enabledCategories{initialCategories()};
+
+void enable (const std::string& categories)
+{
+    enabledCategories.store(parseCategories(categories), std::memory_order_relaxed);
+}
+
+} // ns Logging
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAY_LOGGING_H
+#define PAY_LOGGING_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <glib.h>
+
+/* Levels, anything below PAY_LOG_MIN_LEVEL is compiled out entirely */
+#define PAY_LOG_LEVEL_DEBUG   0
+#define PAY_LOG_LEVEL_INFO    1
+#define PAY_LOG_LEVEL_WARNING 2
+
+#ifndef PAY_LOG_MIN_LEVEL
+#define PAY_LOG_MIN_LEVEL PAY_LOG_LEVEL_DEBUG
+#endif
+
+#define PAY_LOG_GLIB_DEBUG   G_LOG_LEVEL_DEBUG
+#define PAY_LOG_GLIB_INFO    G_LOG_LEVEL_INFO
+#define PAY_LOG_GLIB_WARNING G_LOG_LEVEL_WARNING
+
+namespace Logging
+{
+
+/* Debug and info messages are off unless their category is turned
+   on, warnings always go out */
+enum class Category : uint32_t
+{
+    GENERAL,
+    DBUS,
+    ITEMS,
+    HTTP
+};
+
+/* One bit per category, initialized from the comma separated list of
+   category names (or "all") in PAY_LOG_CATEGORIES */
+extern std::atomic<uint32_t> enabledCategories;
+
+inline bool enabled (Category category)
+{
+    return (enabledCategories.load(std::memory_order_relaxed) & (1u << static_cast<uint32_t>(category))) != 0;
+}
+
+/* Changes the enabled categories at runtime, takes the same
+   list as the environment variable */
+void enable (const std::string& categories);
+
+} // ns Logging
+
+/* Whether a message would go out, for guarding anything that's
+   expensive to build beyond its arguments */
+#define pay_log_enabled(level, category) \
+    (PAY_LOG_LEVEL_##level >= PAY_LOG_MIN_LEVEL && \
+     (PAY_LOG_LEVEL_##level >= PAY_LOG_LEVEL_WARNING || Logging::enabled(Logging::Category::category)))
+
+/* The arguments are only evaluated when the message goes out */
+#define pay_log(level, category, ...) \
+    do { \
+        if (pay_log_enabled(level, category)) \
+        { \
+            g_log(G_LOG_DOMAIN, PAY_LOG_GLIB_##level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define pay_debug(category, ...)   pay_log(DEBUG, category, __VA_ARGS__)
+#define pay_info(category, ...)    pay_log(INFO, category, __VA_ARGS__)
+#define pay_warning(category, ...) pay_log(WARNING, category, __VA_ARGS__)
+
+#endif // PAY_LOGGING_H
@@ -0,0 +1,215 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+namespace Stats
+{
+
+constexpr size_t Histogram::buckets;
+
+namespace
+{
+
+constexpr size_t maxSlots{1024};
+
+/* One thread's values. Only the owning thread writes, the atomics are
+   there so that readers never see a torn value. */
+struct Shard
+{
+    std::array<std::atomic<uint64_t>, maxSlots> slots;
+
+    Shard ()
+    {
+        for (auto& slot : slots)
+        {
+            slot.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    size_t nextSlot = 0;
+    std::vector<std::pair<std::string, size_t>> counters;
+    std::vector<std::pair<std::string, size_t>> histograms;
+    std::set<Shard*> live;
+    /* What the threads that have exited left behind */
+    std::array<uint64_t, maxSlots> retired{};
+
+    size_t allocate (size_t count)
+    {
+        if (nextSlot + count > maxSlots)
+        {
+            throw std::length_error("Out of stats slots");
+        }
+        auto slot = nextSlot;
+        nextSlot += count;
+        return slot;
+    }
+
+    uint64_t sum (size_t slot)
+    {
+        uint64_t total = retired[slot];
+        for (auto shard : live)
+        {
+            total += shard->slots[slot].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+/* Never destroyed, threads can still be exiting while the statics
+   are torn down */
+Registry& registry ()
+{
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+class ShardHolder
+{
+public:
+    ShardHolder () :
+        shard(new Shard())
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.live.insert(shard);
+    }
+
+    ~ShardHolder ()
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (size_t i = 0; i < maxSlots; i++)
+        {
+            reg.retired[i] += shard->slots[i].load(std::memory_order_relaxed);
+        }
+        reg.live.erase(shard);
+        delete shard;
+    }
+
+    Shard* const shard;
+};
+
+inline void bump (size_t slot, uint64_t value)
+{
+    thread_local ShardHolder holder;
+    auto& cell = holder.shard->slots[slot];
+    /* We're the only writer, no need for a locked add */
+    cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // anonymous namespace
+
+/*********************
+ * Counter
+ *********************/
+
+Counter::Counter (const std::string& name)
+{
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    slot = reg.allocate(1);
+    reg.counters.emplace_back(name, slot);
+}
+
+void
+Counter::add (uint64_t value)
+{
+    bump(slot, value);
+}
+
+/*********************
+ * Histogram
+ *********************/
+
+Histogram::Histogram (const std::string& name)
+{
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    first = reg.allocate(buckets + 1);
+    reg.histograms.emplace_back(name, first);
+}
+
+void
+Histogram::record (const std::chrono::microseconds& value)
+{
+    uint64_t usec = value.count() > 0 ? value.count() : 0;
+
+    size_t bucket = 0;
+    for (auto rest = usec; rest != 0 && bucket < buckets - 1; rest >>= 1)
+    {
+        bucket++;
+    }
+
+    bump(first + bucket, 1);
+    bump(first + buckets, usec);
+}
+
+/*********************
+ * Reading
+ *********************/
+
+std::map<std::string, uint64_t>
+counters ()
+{
+    std::map<std::string, uint64_t> retval;
+
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& counter : reg.counters)
+    {
+        retval[counter.first] = reg.sum(counter.second);
+    }
+
+    return retval;
+}
+
+std::map<std::string, HistogramValue>
+histograms ()
+{
+    std::map<std::string, HistogramValue> retval;
+
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& histogram : reg.histograms)
+    {
+        HistogramValue value{0, 0, {}};
+        for (size_t i = 0; i < Histogram::buckets; i++)
+        {
+            auto count = reg.sum(histogram.second + i);
+            value.buckets.push_back(count);
+            value.count += count;
+        }
+        value.sum = reg.sum(histogram.second + Histogram::buckets);
+
+        retval[histogram.first] = value;
+    }
+
+    return retval;
+}
+
+} // ns Stats
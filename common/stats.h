@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAY_STATS_H
+#define PAY_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Process wide counters and latency histograms. Every thread adds into
+   its own copy of the values, which only it writes to, so updating them
+   never takes a lock or shares a cache line. Reading sums the copies of
+   all the threads, including the ones that have already exited. */
+namespace Stats
+{
+
+/* Meant to be file level statics, names should be unique */
+class Counter
+{
+public:
+    explicit Counter (const std::string& name);
+
+    void add (uint64_t value = 1);
+
+private:
+    size_t slot;
+};
+
+class Histogram
+{
+public:
+    /* Bucket 0 counts zero, bucket i the values in [2^(i-1), 2^i)
+       microseconds, and the last one everything above */
+    static constexpr size_t buckets{24};
+
+    explicit Histogram (const std::string& name);
+
+    void record (const std::chrono::microseconds& value);
+
+private:
+    /* The buckets followed by the sum */
+    size_t first;
+};
+
+struct HistogramValue
+{
+    uint64_t count;
+    uint64_t sum; /* microseconds */
+    std::vector<uint64_t> buckets;
+};
+
+std::map<std::string, uint64_t> counters ();
+std::map<std::string, HistogramValue> histograms ();
+
+} // ns Stats
+
+#endif // PAY_STATS_H
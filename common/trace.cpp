@@ -0,0 +1,211 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <cstdlib> // getenv()
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace Trace
+{
+
+namespace
+{
+
+/* Events go into one file per process as JSON lines, which lets us
+   append as we go and not care how the process ends. Every line is
+   complete, so the files can be combined with any JSON tool. */
+class Writer
+{
+public:
+    Writer ()
+    {
+        auto dir = getenv("PAY_TRACE_DIR");
+        if (dir == nullptr || dir[0] == '\0')
+        {
+            return;
+        }
+
+        pid = getpid();
+        auto path = std::string(dir) + "/pay-trace-" + std::to_string(pid) + ".jsonl";
+        file = fopen(path.c_str(), "w");
+    }
+
+    ~Writer ()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+        }
+    }
+
+    bool enabled ()
+    {
+        return file != nullptr;
+    }
+
+    void write (const std::string& trace_id, const std::string& name, uint64_t start, uint64_t end)
+    {
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        auto tid = std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        fprintf(file,
+                "{\"name\":\"%s\",\"cat\":\"pay\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+                "\"pid\":%d,\"tid\":%zu,\"args\":{\"%s\":\"%s\"}}\n",
+                escape(name).c_str(),
+                static_cast<unsigned long long>(start),
+                static_cast<unsigned long long>(end > start ? end - start : 0),
+                static_cast<int>(pid),
+                tid,
+                idKey,
+                escape(trace_id).c_str());
+        fflush(file);
+    }
+
+private:
+    static std::string escape (const std::string& in)
+    {
+        std::string out;
+        for (auto c : in)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    std::mutex mutex;
+    FILE* file = nullptr;
+    pid_t pid = 0;
+};
+
+Writer& writer ()
+{
+    static Writer instance;
+    return instance;
+}
+
+std::string randomHex (size_t bytes)
+{
+    static std::mutex mutex;
+    static std::mt19937_64 rng(std::random_device{}());
+    static const char digits[] = "0123456789abcdef";
+
+    std::string out;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < bytes; i++)
+    {
+        auto byte = rng() & 0xff;
+        out += digits[byte >> 4];
+        out += digits[byte & 0xf];
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+std::string newId ()
+{
+    return randomHex(16);
+}
+
+bool validId (const std::string& trace_id)
+{
+    if (trace_id.size() != 32)
+    {
+        return false;
+    }
+
+    for (auto c : trace_id)
+    {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string traceparent (const std::string& trace_id)
+{
+    return "00-" + trace_id + "-" + randomHex(8) + "-01";
+}
+
+uint64_t now ()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool enabled ()
+{
+    return writer().enabled();
+}
+
+void record (const std::string& trace_id,
+             const std::string& name,
+             uint64_t start,
+             uint64_t end)
+{
+    writer().write(trace_id, name, start, end);
+}
+
+Span::Span (const std::string& trace_id, const std::string& name) :
+    _trace_id(trace_id),
+    _name(name),
+    _start(now()),
+    _ended(false)
+{
+}
+
+Span::~Span ()
+{
+    end();
+}
+
+void
+Span::end ()
+{
+    if (_ended)
+    {
+        return;
+    }
+    _ended = true;
+
+    record(_trace_id, _name, _start, now());
+}
+
+} // ns Trace
@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAY_TRACE_H
+#define PAY_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+/* Follows a single purchase across libpay, the services and the Pay UI.
+   The trace ID is handed from one hop to the next, and each one writes
+   spans for its part as Chrome trace events into PAY_TRACE_DIR, one
+   JSON object per line in pay-trace-<pid>.jsonl. Slurping the files of
+   every process into one array gives the whole picture in
+   chrome://tracing:
+
+     jq -s . $PAY_TRACE_DIR/pay-trace-*.jsonl > purchase-trace.json
+
+   Nothing is written when PAY_TRACE_DIR isn't set. */
+namespace Trace
+{
+
+/* Name of the trace ID in D-Bus metadata and URL queries */
+constexpr const char* idKey = "trace_id";
+
+/* 32 hex characters, the same as a W3C trace-id so it can go straight
+   into a traceparent header */
+std::string newId ();
+
+/* Whether an ID we were handed looks like one of ours, anything else
+   isn't safe to pass on in URLs and headers */
+bool validId (const std::string& trace_id);
+
+/* A traceparent header value for a request made as part of the trace */
+std::string traceparent (const std::string& trace_id);
+
+/* Wall clock microseconds, so spans from different processes line up */
+uint64_t now ();
+
+bool enabled ();
+
+/* Writes a finished span */
+void record (const std::string& trace_id,
+             const std::string& name,
+             uint64_t start,
+             uint64_t end);
+
+/* A span from construction until end() or destruction, whichever is first */
+class Span
+{
+public:
+    Span (const std::string& trace_id, const std::string& name);
+    ~Span ();
+
+    Span (const Span&) = delete;
+    Span& operator= (const Span&) = delete;
+
+    void end ();
+
+    const std::string& traceId ()
+    {
+        return _trace_id;
+    }
+
+private:
+    std::string _trace_id;
+    std::string _name;
+    uint64_t _start;
+    bool _ended;
+};
+
+} // ns Trace
+
+#endif // PAY_TRACE_H
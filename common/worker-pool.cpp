@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "worker-pool.h"
+
+#include <algorithm>
+
+#include <glib.h>
+
+WorkerPool::WorkerPool (unsigned int count) :
+    stopping(false)
+{
+    for (unsigned int i = 0; i < std::max(count, 1u); i++)
+    {
+        threads.emplace_back([this]()
+        {
+            worker();
+        });
+    }
+}
+
+WorkerPool::~WorkerPool ()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+    lock.unlock();
+
+    wake.notify_all();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void
+WorkerPool::submit (const std::string& key, std::function<void()> work)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto& strand = strands[key];
+    strand.push_back(work);
+
+    /* Otherwise whoever is running the key picks it up when done */
+    if (strand.size() == 1)
+    {
+        ready.push_back(key);
+        lock.unlock();
+        wake.notify_one();
+    }
+}
+
+void
+WorkerPool::worker ()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        wake.wait(lock, [this]()
+        {
+            return stopping || !ready.empty();
+        });
+
+        if (ready.empty())
+        {
+            /* Stopping and nothing left */
+            return;
+        }
+
+        auto key = ready.front();
+        ready.pop_front();
+        /* Stays at the front, empty, so the key isn't made ready again */
+        auto work = std::move(strands[key].front());
+        lock.unlock();
+
+        try
+        {
+            work();
+        }
+        catch (std::exception& e)
+        {
+            g_warning("Worker for '%s' failed: %s", key.c_str(), e.what());
+        }
+        catch (...)
+        {
+            g_warning("Worker for '%s' failed", key.c_str());
+        }
+
+        /* Whatever it holds on to can take locks of its own as it goes */
+        work = nullptr;
+
+        lock.lock();
+        auto& strand = strands[key];
+        strand.pop_front();
+        if (strand.empty())
+        {
+            strands.erase(key);
+        }
+        else
+        {
+            ready.push_back(key);
+            wake.notify_one();
+        }
+    }
+}
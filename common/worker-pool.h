@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAY_WORKER_POOL_H
+#define PAY_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A fixed set of threads to push slow work onto. Work submitted with
+   the same key runs one at a time in the order it came in, work with
+   different keys runs in parallel. */
+class WorkerPool
+{
+public:
+    explicit WorkerPool (unsigned int threads);
+    /* Finishes the work that's already been submitted */
+    ~WorkerPool ();
+
+    void submit (const std::string& key, std::function<void()> work);
+
+private:
+    void worker ();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    /* Work for each key that has any, the front of each is either
+       running or next in line */
+    std::map<std::string, std::deque<std::function<void()>>> strands;
+    /* Keys with work waiting and nothing running */
+    std::deque<std::string> ready;
+    std::vector<std::thread> threads;
+};
+
+#endif // PAY_WORKER_POOL_H
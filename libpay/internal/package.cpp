@@ -21,8 +21,10 @@
 #include <libpay/internal/package.h>
 
 #include <common/bus-utils.h>
+#include <common/logging.h>
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 namespace Pay
 {
@@ -58,6 +60,10 @@ Package::Package (const std::string& packageid)
             return tmp;
         }
 
+        /* A new service means a new board */
+        g_signal_connect(storeProxy.get(), "notify::g-name-owner", G_CALLBACK(onNameOwnerChanged), this);
+        requestStatusBoard();
+
         return std::string(); // no error
     });
 
@@ -77,9 +83,118 @@ Package::~Package ()
     thread.quit();
 }
 
+/***
+****  Status board
+***/
+
+/* Called on the thread */
+void
+Package::requestStatusBoard ()
+{
+    auto owner = g_dbus_proxy_get_name_owner(G_DBUS_PROXY(storeProxy.get()));
+    if (owner == nullptr)
+    {
+        /* Not running, and we're not going to start it just for this.
+           We'll hear about it when someone else does. */
+        return;
+    }
+    g_free(owner);
+
+    auto on_async_ready = [](GObject* o, GAsyncResult* res, gpointer gself)
+    {
+        GUnixFDList* fds {};
+        GError* error {};
+        auto v = g_dbus_proxy_call_with_unix_fd_list_finish(G_DBUS_PROXY(o), &fds, res, &error);
+        if (error != nullptr)
+        {
+            /* An older service won't have one, and that's fine */
+            if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+                pay_debug(ITEMS, "No status board: %s", error->message);
+            }
+            g_clear_error(&error);
+            return;
+        }
+
+        gint32 handle {-1};
+        g_variant_get(v, "(h)", &handle);
+        g_variant_unref(v);
+        if (fds == nullptr)
+        {
+            pay_warning(ITEMS, "Status board came without a descriptor");
+            return;
+        }
+
+        auto fd = g_unix_fd_list_get(fds, handle, &error);
+        g_clear_object(&fds);
+        if (fd < 0)
+        {
+            pay_warning(ITEMS, "Unable to get status board: %s", error->message);
+            g_clear_error(&error);
+            return;
+        }
+
+        auto self = static_cast<Package*>(gself);
+        try
+        {
+            self->installStatusBoard(std::unique_ptr<StatusBoard>(new StatusBoard(fd)));
+        }
+        catch (const std::exception& e)
+        {
+            pay_warning(ITEMS, "Unable to use status board: %s", e.what());
+        }
+    };
+
+    g_dbus_proxy_call_with_unix_fd_list(G_DBUS_PROXY(storeProxy.get()),
+                                        "GetStatusBoard",
+                                        nullptr,
+                                        G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                        -1,
+                                        nullptr,
+                                        thread.getCancellable().get(),
+                                        on_async_ready,
+                                        this);
+}
+
+void
+Package::onNameOwnerChanged (GObject* /*proxy*/, GParamSpec* /*pspec*/, gpointer gself)
+{
+    auto self = static_cast<Package*>(gself);
+
+    /* Whatever was on the old board, the new service didn't write it */
+    self->installStatusBoard(nullptr);
+    self->requestStatusBoard();
+}
+
+/* Called on the thread */
+void
+Package::installStatusBoard (std::unique_ptr<StatusBoard> board)
+{
+    std::atomic_store(&statusBoard, std::shared_ptr<StatusBoard>(std::move(board)));
+}
+
+bool
+Package::boardStatus (const std::string& sku,
+                      PayPackageItemStatus& status,
+                      uint64_t& refundable_until) noexcept
+{
+    auto board = std::atomic_load(&statusBoard);
+
+    return board != nullptr
+        && !board->closed()
+        && board->lookup(sku, status, refundable_until);
+}
+
 PayPackageItemStatus
 Package::itemStatus (const std::string& sku) noexcept
 {
+    PayPackageItemStatus status;
+    uint64_t refundable_until;
+    if (boardStatus(sku, status, refundable_until))
+    {
+        return status;
+    }
+
     const auto item = getItem(sku);
 
     return item
@@ -90,6 +205,13 @@ Package::itemStatus (const std::string& sku) noexcept
 PayPackageRefundStatus
 Package::refundStatus (const std::string& sku) noexcept
 {
+    PayPackageItemStatus status;
+    uint64_t refundable_until;
+    if (boardStatus(sku, status, refundable_until))
+    {
+        return calcRefundStatus(status, refundable_until);
+    }
+
     const auto item = getItem(sku);
 
     return item
@@ -101,7 +223,7 @@ PayPackageRefundStatus
 Package::calcRefundStatus (PayPackageItemStatus item,
                            uint64_t refundtime)
 {
-    g_debug("Checking refund status with timeout: %lld", refundtime);
+    pay_debug(ITEMS, "Checking refund status with timeout: %lld", refundtime);
 
     if (item != PAY_PACKAGE_ITEM_STATUS_PURCHASED)
     {
@@ -284,10 +406,10 @@ std::shared_ptr<PayItem> create_pay_item_from_variant(GVariant* item_properties)
                 {
                     item->set_title(g_variant_get_string(value, nullptr));
                 }
-                else
+                else if (pay_log_enabled(DEBUG, ITEMS))
                 {
                     auto valstr = g_variant_print(value, true);
-                    g_warning("Unhandled item property '%s': '%s'", key, valstr);
+                    pay_debug(ITEMS, "Unhandled item property '%s': '%s'", key, valstr);
                     g_free(valstr);
                 }
             }
@@ -423,12 +545,15 @@ template<typename BusProxy,
 bool Package::startStoreAction(const std::shared_ptr<BusProxy>& bus_proxy,
                                const gchar* function_name,
                                GVariant* params,
-                               gint timeout_msec) noexcept
+                               gint timeout_msec,
+                               std::shared_ptr<Trace::Span> span) noexcept
 {
     struct CallbackData
     {
         GVariant* v {};
         Package* pkg;
+        /* Ends when the call completes */
+        std::shared_ptr<Trace::Span> span;
 
         ~CallbackData()
         {
@@ -478,6 +603,7 @@ bool Package::startStoreAction(const std::shared_ptr<BusProxy>& bus_proxy,
 
     data->v = g_variant_ref(params);
     data->pkg = this;
+    data->span = span;
 
     thread.executeOnThread([this, bus_proxy, function_name, params, data,
                             timeout_msec, &on_async_ready]()
@@ -502,7 +628,7 @@ bool Package::startStoreAction(const std::shared_ptr<BusProxy>& bus_proxy,
 bool
 Package::startVerification (const std::string& sku) noexcept
 {
-    g_debug("%s %s", G_STRFUNC, sku.c_str());
+    pay_debug(ITEMS, "%s %s", G_STRFUNC, sku.c_str());
 
     auto ok = startStoreAction<proxyPayStore,
                                &proxy_pay_store_call_get_item_finish> (
@@ -511,32 +637,42 @@ Package::startVerification (const std::string& sku) noexcept
         g_variant_new("(s)", sku.c_str()),
         -1);
 
-    g_debug("%s returning %d", G_STRFUNC, int(ok));
+    pay_debug(ITEMS, "%s returning %d", G_STRFUNC, int(ok));
     return ok;
 }
 
 bool
 Package::startPurchase (const std::string& sku) noexcept
 {
-    g_debug("%s %s", G_STRFUNC, sku.c_str());
+    pay_debug(ITEMS, "%s %s", G_STRFUNC, sku.c_str());
 
     statusChanged(sku, PAY_PACKAGE_ITEM_STATUS_PURCHASING, 0);
 
+    /* The purchase trace starts here and the ID goes along with
+       the call for the service to carry on with */
+    auto trace_id = Trace::newId();
+    auto span = std::make_shared<Trace::Span>(trace_id, "libpay.purchase");
+
+    GVariantBuilder metadata;
+    g_variant_builder_init(&metadata, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&metadata, "{sv}", Trace::idKey, g_variant_new_string(trace_id.c_str()));
+
     auto ok = startStoreAction<proxyPayStore,
-                               &proxy_pay_store_call_purchase_item_finish> (
+                               &proxy_pay_store_call_purchase_item_with_metadata_finish> (
         storeProxy,
-        "PurchaseItem",
-        g_variant_new("(s)", sku.c_str()),
-        300 * G_USEC_PER_SEC);
+        "PurchaseItemWithMetadata",
+        g_variant_new("(sa{sv})", sku.c_str(), &metadata),
+        300 * G_USEC_PER_SEC,
+        span);
 
-    g_debug("%s returning %d", G_STRFUNC, int(ok));
+    pay_debug(ITEMS, "%s returning %d", G_STRFUNC, int(ok));
     return ok;
 }
 
 bool
 Package::startRefund (const std::string& sku) noexcept
 {
-    g_debug("%s %s", G_STRFUNC, sku.c_str());
+    pay_debug(ITEMS, "%s %s", G_STRFUNC, sku.c_str());
 
     auto ok = startStoreAction<proxyPayStore,
                                &proxy_pay_store_call_refund_item_finish> (
@@ -545,14 +681,14 @@ Package::startRefund (const std::string& sku) noexcept
         g_variant_new("(s)", sku.c_str()),
         -1);
 
-    g_debug("%s returning %d", G_STRFUNC, int(ok));
+    pay_debug(ITEMS, "%s returning %d", G_STRFUNC, int(ok));
     return ok;
 }
 
 bool
 Package::startAcknowledge (const std::string& sku) noexcept
 {
-    g_debug("%s %s", G_STRFUNC, sku.c_str());
+    pay_debug(ITEMS, "%s %s", G_STRFUNC, sku.c_str());
 
     auto ok = startStoreAction<proxyPayStore,
                                &proxy_pay_store_call_acknowledge_item_finish> (
@@ -561,7 +697,7 @@ Package::startAcknowledge (const std::string& sku) noexcept
         g_variant_new("(s)", sku.c_str()),
         -1);
 
-    g_debug("%s returning %d", G_STRFUNC, int(ok));
+    pay_debug(ITEMS, "%s returning %d", G_STRFUNC, int(ok));
     return ok;
 }
 
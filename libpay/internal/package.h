@@ -25,12 +25,15 @@
 #include <libpay/proxy-store.h>
 
 #include <libpay/internal/item.h>
+#include <libpay/internal/status-board.h>
 
 #include <common/glib-thread.h>
+#include <common/trace.h>
 
 #include <core/signal.h>
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <thread>
@@ -55,6 +58,16 @@ class Package
     GLib::ContextThread thread;
     std::shared_ptr<proxyPayStore> storeProxy;
 
+    /* The service's status board, if it's given us one. Only ever
+       touched through std::atomic_load() and std::atomic_store(), each
+       lookup holds its own reference so a replaced board is unmapped
+       once the last reader is done with it. */
+    std::shared_ptr<StatusBoard> statusBoard;
+    void installStatusBoard(std::unique_ptr<StatusBoard> board);
+    void requestStatusBoard();
+    static void onNameOwnerChanged(GObject* proxy, GParamSpec* pspec, gpointer gself);
+    bool boardStatus(const std::string& sku, PayPackageItemStatus& status, uint64_t& refundable_until) noexcept;
+
     constexpr static uint64_t expiretime{60}; // 60 seconds prior status is "expiring"
 
     template<typename Collection>
@@ -65,7 +78,8 @@ class Package
     bool startStoreAction(const std::shared_ptr<BusProxy>& bus_proxy,
                           const gchar* function_name,
                           GVariant* params,
-                          gint timeout_msec) noexcept;
+                          gint timeout_msec,
+                          std::shared_ptr<Trace::Span> span = nullptr) noexcept;
 
 
 public:
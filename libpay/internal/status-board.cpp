@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libpay/internal/status-board.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Pay
+{
+
+namespace Internal
+{
+
+namespace
+{
+
+constexpr uint32_t boardMagic{0x50415942};
+constexpr uint32_t boardVersion{1};
+
+constexpr size_t headerSize{64};
+constexpr size_t headerMagic{0};
+constexpr size_t headerVersion{4};
+constexpr size_t headerSlots{8};
+constexpr size_t headerSlotSize{12};
+constexpr size_t headerClosed{16};
+
+constexpr size_t slotSeq{0};
+constexpr size_t slotState{4};
+constexpr size_t slotRefundable{8};
+constexpr size_t slotHash{16};
+constexpr size_t slotSkuLen{24};
+constexpr size_t slotSku{32};
+
+/* Reads of a slot the service is busy with before we give up on it */
+constexpr int maxRetries{16};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+              sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "The board is read through atomics laid over it");
+
+template<typename T>
+const std::atomic<T>& field (const uint8_t* base, size_t offset)
+{
+    return *reinterpret_cast<const std::atomic<T>*>(base + offset);
+}
+
+/* FNV-1a, the same as the service's hash/fnv */
+uint64_t skuHash (const std::string& sku)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto c : sku)
+    {
+        hash ^= uint8_t(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+} // anonymous namespace
+
+StatusBoard::StatusBoard (int fd)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < headerSize)
+    {
+        close(fd);
+        throw std::runtime_error("Status board is too small");
+    }
+
+    auto map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    const auto mapError = errno;
+    /* The mapping keeps it open */
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        throw std::runtime_error(std::string("Unable to map status board: ") + strerror(mapError));
+    }
+
+    data = static_cast<const uint8_t*>(map);
+    size = info.st_size;
+    slots = field<uint32_t>(data, headerSlots).load(std::memory_order_acquire);
+    slotSize = field<uint32_t>(data, headerSlotSize).load(std::memory_order_acquire);
+
+    if (field<uint32_t>(data, headerMagic).load(std::memory_order_acquire) != boardMagic ||
+        field<uint32_t>(data, headerVersion).load(std::memory_order_acquire) != boardVersion ||
+        slots == 0 || (slots & (slots - 1)) != 0 ||
+        slotSize <= slotSku || slotSize % 8 != 0 ||
+        headerSize + uint64_t(slots) * slotSize > size)
+    {
+        munmap(const_cast<uint8_t*>(data), size);
+        throw std::runtime_error("Not a status board we can read");
+    }
+}
+
+StatusBoard::~StatusBoard ()
+{
+    munmap(const_cast<uint8_t*>(data), size);
+}
+
+bool
+StatusBoard::closed () const noexcept
+{
+    return field<uint32_t>(data, headerClosed).load(std::memory_order_acquire) != 0;
+}
+
+bool
+StatusBoard::lookup (const std::string& sku,
+                     PayPackageItemStatus& status,
+                     uint64_t& refundable_until) const noexcept
+{
+    if (sku.empty() || sku.size() > slotSize - slotSku)
+    {
+        return false;
+    }
+
+    const auto hash = skuHash(sku);
+    auto index = uint32_t(hash) & (slots - 1);
+
+    for (uint32_t probe = 0; probe < slots; probe++, index = (index + 1) & (slots - 1))
+    {
+        const auto slot = data + headerSize + size_t(index) * slotSize;
+        const auto& seq = field<uint32_t>(slot, slotSeq);
+
+        for (int attempt = 0;; attempt++)
+        {
+            if (attempt == maxRetries)
+            {
+                return false;
+            }
+
+            const auto before = seq.load(std::memory_order_acquire);
+            if ((before & 1) != 0)
+            {
+                continue;
+            }
+
+            const auto stored = field<uint64_t>(slot, slotHash).load(std::memory_order_relaxed);
+            const auto state = field<uint32_t>(slot, slotState).load(std::memory_order_relaxed);
+            const auto until = field<uint64_t>(slot, slotRefundable).load(std::memory_order_relaxed);
+            const auto length = field<uint32_t>(slot, slotSkuLen).load(std::memory_order_relaxed);
+            /* The sku can be changing under us too, but whatever we
+               made of it only counts if the sequence held still */
+            const bool match = stored == hash &&
+                               length == sku.size() &&
+                               memcmp(slot + slotSku, sku.data(), sku.size()) == 0;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) != before)
+            {
+                continue;
+            }
+
+            if (stored == 0)
+            {
+                /* The end of the probe, it isn't here */
+                return false;
+            }
+            if (!match)
+            {
+                break;
+            }
+
+            switch (state)
+            {
+            case 1:
+                status = PAY_PACKAGE_ITEM_STATUS_PURCHASED;
+                break;
+            case 2:
+                status = PAY_PACKAGE_ITEM_STATUS_APPROVED;
+                break;
+            case 3:
+                status = PAY_PACKAGE_ITEM_STATUS_NOT_PURCHASED;
+                break;
+            default:
+                return false;
+            }
+            refundable_until = until;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace Internal
+
+} // namespace Pay
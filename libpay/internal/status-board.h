@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <libpay/pay-package.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Pay
+{
+
+namespace Internal
+{
+
+/* The states of a package's items that the pay service has seen, which
+   it keeps in shared memory for us to map read only. Its side is
+   status_board.go in the service, the layout is:
+
+   Header, 64 bytes: magic, version, slot count (a power of two), slot
+   size and a closed flag, all uint32.
+
+   Slots, linear probing on the FNV-1a hash of the sku:
+     0  uint32 sequence, odd while the service is writing the slot
+     4  uint32 state, 1 purchased, 2 approved, 3 not purchased
+     8  uint64 refundable_until
+    16  uint64 hash of the sku, zero for an empty slot
+    24  uint32 length of the sku
+    32  the sku
+
+   Lookups don't block or take a lock, a reader that keeps running into
+   the service writing the slot gives up and the caller asks over the
+   bus instead. */
+class StatusBoard
+{
+public:
+    /* Takes the descriptor, throws when it isn't a board we can read */
+    explicit StatusBoard (int fd);
+    ~StatusBoard ();
+
+    StatusBoard (const StatusBoard&) = delete;
+    StatusBoard& operator= (const StatusBoard&) = delete;
+
+    /* Once the service lets go of the board it stops keeping it up
+       to date */
+    bool closed () const noexcept;
+
+    /* False when the item isn't on the board */
+    bool lookup (const std::string& sku,
+                 PayPackageItemStatus& status,
+                 uint64_t& refundable_until) const noexcept;
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint32_t slots = 0;
+    uint32_t slotSize = 0;
+};
+
+} // namespace Internal
+
+} // namespace Pay
@@ -94,19 +94,8 @@ MainView {
             mainView.recentLogin = mainView.recentCredentials();
             checkout.beforeTimeout = mainView.recentLogin;
 
-            // Check for selected payment, and keep it selected if so.
-            if (checkout.hasSelectedPayment) {
-                for (var i=0; i < payments.length; i++) {
-                    if (payments[i].paymentId == checkout.paymentId &&
-                        payments[i].backendId == checkout.backendId) {
-                            payments[i].preferred = true;
-                    } else {
-                        payments[i].preferred = false;
-                    }
-                }
-            }
-            checkout.model = payments;
-            checkout.hasPayments = payments.length != 0;
+            checkout.model = purchase.paymentMethods;
+            checkout.hasPayments = purchase.paymentMethods.count != 0;
             checkout.setSelectedItem();
 
             mainView.state = "checkout";
@@ -115,6 +104,21 @@ MainView {
             hideLoading();
         }
 
+        // Newer than the cached details we showed, the page stays where it is
+        onItemDetailsUpdated: {
+            checkout.itemIcon = icon;
+            checkout.itemTitle = title;
+            checkout.itemSubtitle = publisher;
+            if (currency == suggestedCurrency) {
+                checkout.price = formatted_price;
+            }
+        }
+
+        onPaymentTypesUpdated: {
+            checkout.hasPayments = purchase.paymentMethods.count != 0;
+            checkout.setSelectedItem();
+        }
+
         onNoPreferredPaymentMethod: {
             checkout.hasPreferredPayment = false;
             var values = mainView.getLastPayment();
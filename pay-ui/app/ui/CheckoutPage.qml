@@ -66,7 +66,7 @@ Page {
     signal addCreditCard
 
     function launchPurchase() {
-        var pay = paymentTypes.model[pageCheckout.selectedItem];
+        var pay = paymentTypes.model.get(pageCheckout.selectedItem);
         var email = accountView.currentItem.email;
         pageCheckout.buy(email, password, otp, pay.paymentId, pay.backendId);
     }
@@ -82,10 +82,16 @@ Page {
     }
 
     function setSelectedItem() {
-        for (var i=0; i < pageCheckout.model.length; i++) {
-            if (pageCheckout.model[i].preferred) {
-                selectedItem = i;
-            }
+        // Keep the payment that was picked selected, if it's still there
+        var index = -1;
+        if (hasSelectedPayment) {
+            index = pageCheckout.model.indexOf(paymentId, backendId);
+        }
+        if (index < 0) {
+            index = pageCheckout.model.preferredIndex();
+        }
+        if (index >= 0) {
+            selectedItem = index;
         }
     }
 
@@ -328,7 +334,7 @@ Page {
                         spacing: units.gu(0.25)
 
                         Label {
-                            text: modelData.name
+                            text: model.name
                             elide: Text.ElideLeft
                             anchors {
                                 left: parent.left
@@ -337,7 +343,7 @@ Page {
                             fontSize: "small"
                         }
                         Label {
-                            text: modelData.description
+                            text: model.description
                             elide: Text.ElideLeft
                             anchors {
                                 left: parent.left
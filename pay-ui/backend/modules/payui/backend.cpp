@@ -4,14 +4,15 @@
 #include "purchase.h"
 #include "certificateadapter.h"
 #include "oxideconstants.h"
-#include "pay_info.h"
+#include "payment_methods_model.h"
 
 void BackendPlugin::registerTypes(const char *uri)
 {
     Q_ASSERT(uri == QLatin1String("payui"));
 
     qmlRegisterType<UbuntuPurchase::Purchase>(uri, 0, 1, "Purchase");
-    qmlRegisterType<UbuntuPurchase::PayInfo>(uri, 0, 1, "PayInfo");
+    qmlRegisterUncreatableType<UbuntuPurchase::PaymentMethodsModel>(uri, 0, 1, "PaymentMethodsModel",
+                                                                   "Get it from Purchase.paymentMethods");
     qmlRegisterType<CertificateAdapter>(uri, 0, 1, "CertificateAdapter");
     qmlRegisterType<SecurityStatus>(uri, 0, 1, "SecurityStatus");
     qmlRegisterType<SslCertificate>(uri, 0, 1, "SslCertificate");
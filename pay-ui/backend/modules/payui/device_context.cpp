@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "device_context.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDebug>
+#include <QFile>
+
+#define PARTNER_ID_FILE "/custom/partner-id"
+
+namespace UbuntuPurchase {
+
+DeviceContext* DeviceContext::instance()
+{
+    // Parented to the application so it goes away with it
+    static DeviceContext* context = new DeviceContext(QCoreApplication::instance());
+    return context;
+}
+
+DeviceContext::DeviceContext(QObject *parent) :
+    QObject(parent)
+{
+    if (QFile::exists(PARTNER_ID_FILE)) {
+        QFile pid_file(PARTNER_ID_FILE);
+        if (pid_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            // Always use lowercase, and trim whitespace.
+            m_partnerId = pid_file.readLine().toLower().trimmed();
+            qDebug() << "Found partner ID:" << m_partnerId;
+        } else {
+            qWarning() << "Failed to open partner ID file.";
+        }
+    } else {
+        qDebug() << "No partner ID file found.";
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall("com.ubuntu.WhoopsiePreferences",
+                                                      "/com/ubuntu/WhoopsiePreferences",
+                                                      "com.ubuntu.WhoopsiePreferences",
+                                                      "GetIdentifier");
+    QDBusPendingCall call = QDBusConnection::systemBus().asyncCall(msg);
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, &DeviceContext::handleDeviceId);
+}
+
+void DeviceContext::handleDeviceId(QDBusPendingCallWatcher* call)
+{
+    QDBusPendingReply<QString> reply = *call;
+    if (reply.isError()) {
+        // Purchases still work without it, so don't hold them up
+        qWarning() << "Failed to get device ID:" << reply.error().message();
+    } else {
+        m_deviceId = reply.value();
+    }
+    call->deleteLater();
+
+    m_ready = true;
+    Q_EMIT ready();
+}
+
+bool DeviceContext::isReady() const
+{
+    return m_ready;
+}
+
+QString DeviceContext::deviceId() const
+{
+    return m_deviceId;
+}
+
+QByteArray DeviceContext::partnerId() const
+{
+    return m_partnerId;
+}
+
+}
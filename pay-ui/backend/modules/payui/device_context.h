@@ -0,0 +1,59 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DEVICE_CONTEXT_H
+#define DEVICE_CONTEXT_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+class QDBusPendingCallWatcher;
+
+namespace UbuntuPurchase {
+
+// What the store is told about the device: the whoopsie identifier and
+// the partner ID. Neither changes while we run, so they're looked up once,
+// without blocking, when the context is first used.
+class DeviceContext : public QObject
+{
+    Q_OBJECT
+public:
+    static DeviceContext* instance();
+
+    bool isReady() const;
+    QString deviceId() const;
+    QByteArray partnerId() const;
+
+Q_SIGNALS:
+    void ready();
+
+private Q_SLOTS:
+    void handleDeviceId(QDBusPendingCallWatcher* call);
+
+private:
+    explicit DeviceContext(QObject *parent = 0);
+
+    bool m_ready = false;
+    QString m_deviceId;
+    QByteArray m_partnerId;
+};
+
+}
+
+#endif // DEVICE_CONTEXT_H
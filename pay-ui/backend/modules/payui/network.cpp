@@ -25,15 +25,18 @@
 #include <QUrl>
 #include <QUrlQuery>
 #include <QDebug>
-#include <QFile>
+#include <QLoggingCategory>
+#include <QNetworkDiskCache>
 #include <QProcessEnvironment>
-#include <QDBusInterface>
-#include <QDBusReply>
-#include <QDBusConnection>
+#include <QSettings>
+#include <QStandardPaths>
 
 #include <ubuntu-app-launch/registry.h>
 
 #include "certificateadapter.h"
+#include "device_context.h"
+
+#include <common/trace.h>
 
 #define PAY_PURCHASES_PATH "/purchases"
 #define PAY_PAYMENTMETHODS_PATH "/paymentmethods"
@@ -43,19 +46,23 @@
 #define DEVICE_ID_HEADER "X-Device-Id"
 
 #define PARTNER_ID_HEADER "X-Partner-ID"
-#define PARTNER_ID_FILE "/custom/partner-id"
 
-#define PREFERED_PAYMENT_TYPE "0"
-#define PAYMENT_TYPES "1"
-#define BUY_ITEM "2"
-#define ITEM_INFO "3"
-#define UPDATE_CREDENTIALS "4"
-#define CHECK_PASSWORD "5"
-#define CHECK_PURCHASED "6"
+// Item info and payment methods are shown from here straight away
+#define CACHE_DIR "/http"
+#define CACHE_MAX_SIZE (5 * 1024 * 1024)
+#define TLS_SESSIONS_FILE "/tls-sessions"
 
 #define BUY_COMPLETE "Complete"
 #define BUY_IN_PROGRESS "InProgress"
 
+/* What we tell the service in com.canonical.pay.payui.PurchaseResult */
+#define PURCHASE_RESULT_PURCHASED "purchased"
+#define PURCHASE_RESULT_NOT_PURCHASED "not purchased"
+
+/* Replies are logged in full, so they stay quiet unless asked for with
+   QT_LOGGING_RULES="pay.network.debug=true" */
+Q_LOGGING_CATEGORY(payNetwork, "pay.network", QtWarningMsg)
+
 using namespace ubuntu::app_launch;
 
 namespace UbuntuPurchase {
@@ -64,15 +71,25 @@ Network::Network(QObject *parent) :
     QObject(parent),
     m_nam(this),
     m_service(this),
-    m_preferred(nullptr)
+    m_paymentMethods(this)
 {
-    connect(&m_nam, SIGNAL(finished(QNetworkReply*)),
-                     this, SLOT(onReply(QNetworkReply*)));
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QNetworkDiskCache* cache = new QNetworkDiskCache(this);
+    cache->setCacheDirectory(cacheDir + CACHE_DIR);
+    cache->setMaximumCacheSize(CACHE_MAX_SIZE);
+    m_nam.setCache(cache);
+    // Get DNS, TCP and TLS out of the way while the UI loads
+    m_sessionsFile = cacheDir + TLS_SESSIONS_FILE;
+    loadSessionTickets();
+    warmUp(getEnvironmentValue(PAY_BASE_URL_ENVVAR, PAY_BASE_URL));
+    warmUp(getEnvironmentValue(SEARCH_BASE_URL_ENVVAR, SEARCH_BASE_URL));
+    // Look up the device identity now, so it's there when we buy
+    DeviceContext::instance();
     // SSO SERVICE
     connect(&m_service, &CredentialsService::credentialsFound,
                      this, &Network::handleCredentialsFound);
     connect(&m_service, &CredentialsService::credentialsNotFound,
-                     this, &Network::credentialsNotFound);
+                     this, &Network::handleCredentialsNotFound);
     connect(&m_service, &SSOService::credentialsStored,
                      this, &Network::handleCredentialsStored);
     connect(&m_service, &CredentialsService::loginError,
@@ -83,6 +100,22 @@ Network::Network(QObject *parent) :
 
 void Network::getCredentials()
 {
+    switch (m_credentialsPrefetch) {
+    case Prefetch::PENDING:
+        m_credentialsWanted = true;
+        return;
+    case Prefetch::FOUND:
+        m_credentialsPrefetch = Prefetch::NONE;
+        Q_EMIT credentialsFound();
+        return;
+    case Prefetch::NOT_FOUND:
+        m_credentialsPrefetch = Prefetch::NONE;
+        Q_EMIT credentialsNotFound();
+        return;
+    case Prefetch::NONE:
+        break;
+    }
+
     qDebug() << "getting credentials";
     m_service.getCredentials();
 }
@@ -128,6 +161,209 @@ bool Network::isSupportedCurrency(const QString& currency_code)
     return currency_map.contains(currency_code);
 }
 
+void Network::prefetch(const QString& appid, const QString& itemid)
+{
+    // Everything the checkout page needs is signed, so it all has
+    // to wait for the credentials
+    qDebug() << "Prefetching checkout for" << itemid << "by app" << appid;
+    m_prefetchAppId = appid;
+    m_prefetchItemId = itemid;
+    m_credentialsPrefetch = Prefetch::PENDING;
+    m_credentialsWanted = false;
+    m_service.getCredentials();
+}
+
+void Network::prefetchRequests()
+{
+    // The payment types depend on the currency the item info suggests,
+    // guess at it the same way that does without the server's hint
+    QString currency = DEFAULT_CURRENCY;
+    const char* env_value = std::getenv(CURRENCY_ENVVAR);
+    if (env_value != NULL && isSupportedCurrency(env_value)) {
+        currency = env_value;
+    }
+
+    m_prefetching = true;
+    getItemInfo(m_prefetchAppId, m_prefetchItemId);
+    requestPaymentTypes(currency);
+    m_prefetching = false;
+}
+
+void Network::warmUp(const QString& baseUrl)
+{
+    QUrl url(baseUrl);
+    if (url.scheme() != "https") {
+        return;
+    }
+
+    qDebug() << "Connecting ahead to" << url.host();
+    m_nam.connectToHostEncrypted(url.host(), url.port(443), sslConfiguration(url.host()));
+}
+
+void Network::loadSessionTickets()
+{
+    QSettings sessions(m_sessionsFile, QSettings::IniFormat);
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for (const QString& host : sessions.childGroups()) {
+        sessions.beginGroup(host);
+        if (sessions.value("expires").toDateTime() > now) {
+            m_sessionTickets[host] = sessions.value("ticket").toByteArray();
+        }
+        sessions.endGroup();
+    }
+}
+
+void Network::storeSessionTicket(QNetworkReply* reply)
+{
+    QString host = reply->url().host();
+    QSslConfiguration config = reply->sslConfiguration();
+    QByteArray ticket = config.sessionTicket();
+    if (ticket.isEmpty() || m_sessionTickets.value(host) == ticket) {
+        return;
+    }
+
+    m_sessionTickets[host] = ticket;
+
+    QSettings sessions(m_sessionsFile, QSettings::IniFormat);
+    sessions.beginGroup(host);
+    sessions.setValue("ticket", ticket);
+    sessions.setValue("expires", QDateTime::currentDateTimeUtc().addSecs(config.sessionTicketLifeTimeHint()));
+    sessions.endGroup();
+}
+
+QSslConfiguration Network::sslConfiguration(const QString& host)
+{
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    // Needed for Qt to hand us the session ticket at all
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    auto ticket = m_sessionTickets.constFind(host);
+    if (ticket != m_sessionTickets.constEnd()) {
+        config.setSessionTicket(ticket.value());
+    }
+    return config;
+}
+
+RequestObject* Network::track(QNetworkReply* reply, RequestObject::Handler handler)
+{
+    RequestObject* request = new RequestObject(reply, handler);
+    connect(reply, &QNetworkReply::finished, this, [this, request]() {
+        storeSessionTicket(request->reply);
+        request->certificate = request->reply->sslConfiguration().peerCertificate();
+        if (request->answer && !request->certificate.isNull()) {
+            request->answer->certificate = request->certificate;
+        }
+        onReply(request);
+    });
+    return request;
+}
+
+void Network::sendGet(const QNetworkRequest& request, RequestObject::Handler handler)
+{
+    QString key = request.url().toString();
+
+    if (m_prefetching) {
+        Prefetched prefetched;
+        prefetched.replies = fetch(request, handler);
+        m_prefetched.insert(key, prefetched);
+        return;
+    }
+
+    auto held = m_prefetched.find(key);
+    if (held == m_prefetched.end()) {
+        fetch(request, handler);
+        return;
+    }
+
+    // Already on its way, or already here
+    RequestObject* prefetched = held->request;
+    if (prefetched == nullptr) {
+        held->wanted = true;
+    } else {
+        m_prefetched.erase(held);
+        onReply(prefetched);
+    }
+}
+
+QList<QPointer<QNetworkReply>> Network::fetch(const QNetworkRequest& original, RequestObject::Handler handler)
+{
+    QNetworkRequest request(original);
+    request.setSslConfiguration(sslConfiguration(request.url().host()));
+
+    if (m_nam.cache()->metaData(request.url()).isValid()) {
+        // Show what we had last time, and ask the server whether that's
+        // still right. The cache adds the conditional headers.
+        QSharedPointer<RequestObject::Answer> answer(new RequestObject::Answer());
+
+        QNetworkRequest cached(request);
+        cached.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysCache);
+        RequestObject* fromCache = track(m_nam.get(cached), handler);
+        fromCache->answer = answer;
+
+        QNetworkRequest revalidate(request);
+        revalidate.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferNetwork);
+        RequestObject* revalidation = track(m_nam.get(revalidate), handler);
+        revalidation->revalidation = true;
+        revalidation->answer = answer;
+        return { fromCache->reply, revalidation->reply };
+    }
+
+    return { track(m_nam.get(request), handler)->reply };
+}
+
+bool Network::holdPrefetched(RequestObject* request)
+{
+    QNetworkReply* reply = request->reply;
+    auto held = m_prefetched.find(reply->request().url().toString());
+    if (held == m_prefetched.end()) {
+        return false;
+    }
+
+    if (held->request != nullptr) {
+        if (request->revalidation && reply->error() == QNetworkReply::NoError &&
+            !reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool()) {
+            // Newer than what we're holding, give them this instead
+            held->request->reply->deleteLater();
+            held->request = request;
+        } else {
+            reply->deleteLater();
+        }
+        return true;
+    }
+
+    if (held->wanted) {
+        m_prefetched.erase(held);
+        return false;
+    }
+
+    held->request = request;
+    return true;
+}
+
+void Network::dropPrefetched()
+{
+    // The item info's handler asks for whatever the checkout page needs
+    // with it, so anything prefetched that's still unclaimed was a wrong
+    // guess, e.g. payment types in another currency than the suggested one
+    for (auto held = m_prefetched.begin(); held != m_prefetched.end();) {
+        if (held->wanted) {
+            ++held;
+            continue;
+        }
+
+        qCDebug(payNetwork) << "Dropping unclaimed prefetch:" << held.key();
+        for (const QPointer<QNetworkReply>& reply : held->replies) {
+            if (reply.isNull()) {
+                continue;
+            }
+            // Aborting finishes the reply, which nobody is waiting on
+            QObject::disconnect(reply.data(), nullptr, this, nullptr);
+            reply->abort();
+            reply->deleteLater();
+        }
+        held = m_prefetched.erase(held);
+    }
+}
+
 QString Network::sanitizeUrl(const QUrl& url)
 {
     static QRegExp regexp("\\b\\/\\/+");
@@ -141,156 +377,75 @@ QString Network::encodeQuerySlashes(const QString& query)
     return temp.replace(regexp, "%2F");
 }
 
-void Network::onReply(QNetworkReply *reply)
+void Network::onReply(RequestObject* request)
 {
+    if (holdPrefetched(request)) {
+        return;
+    }
+
+    QNetworkReply* reply = request->reply;
+    // Only the payment types show who we're talking to
+    bool wantsCertificate = (request->handler == &Network::handlePaymentTypes);
+    QSslCertificate certificate = request->answer ? request->answer->certificate : request->certificate;
+
+    // A revalidation only matters if the server had something new, but
+    // it's what tells us the certificate behind the cached reply
+    if (request->revalidation &&
+        (reply->error() != QNetworkReply::NoError ||
+         reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool())) {
+        qCDebug(payNetwork) << "Cached reply still current:" << reply->request().url();
+        if (wantsCertificate && request->answer->delivered) {
+            emitCertificate(certificate);
+        }
+        reply->deleteLater();
+        return;
+    }
+
+    // Whichever of the cached reply and the revalidation comes second
+    // only refreshes what the first one showed, or goes away if it has
+    // nothing newer
+    bool updating = false;
+    if (request->answer) {
+        if (request->answer->delivered && !request->revalidation) {
+            reply->deleteLater();
+            return;
+        }
+        updating = request->answer->delivered;
+        request->answer->delivered = true;
+    }
+    // Once the item info is handled, what it asked for has been claimed
+    bool dropUnclaimed = (request->handler == &Network::handleItemInfo && !updating);
+
     QVariant statusAttr = reply->attribute(
                             QNetworkRequest::HttpStatusCodeAttribute);
     if (!statusAttr.isValid()) {
         QString message("Invalid reply status");
         qWarning() << message;
         Q_EMIT error(message);
-        return;
-    }
-
-    RequestObject* state = qobject_cast<RequestObject*>(reply->request().originatingObject());
-    if (state->operation.isEmpty()) {
-        QString message("Reply received for non valid state.");
-        qWarning() << message;
-        Q_EMIT error(message);
+        if (dropUnclaimed) {
+            dropPrefetched();
+        }
+        reply->deleteLater();
         return;
     }
 
     int httpStatus = statusAttr.toInt();
-    qDebug() << "Reply status:" << httpStatus;
+    qCDebug(payNetwork) << "Reply status:" << httpStatus;
     if (httpStatus == 200 || httpStatus == 201) {
         QByteArray payload = reply->readAll();
-        qDebug() << payload;
-        QJsonDocument document = QJsonDocument::fromJson(payload);
-
-        if (state->operation.contains(PAYMENT_TYPES) && document.isArray()) {
-            qDebug() << "Reply state: PAYMENT_TYPES";
-            QVariantList listPays;
-            QJsonArray array = document.array();
-            for (int i = 0; i < array.size(); i++) {
-                QJsonObject object = array.at(i).toObject();
-                QString description = object.value("description").toString();
-                QString backend = object.value("id").toString();
-                bool preferredBackend = object.value("preferred").toBool();
-                QJsonArray choices = object.value("choices").toArray();
-                for (int j = 0; j < choices.size(); j++) {
-                    QJsonObject choice = choices.at(j).toObject();
-                    QString name = choice.value("description").toString();
-                    QString paymentId = QString::number(choice.value("id").toInt());
-                    bool requiresInteracion = choice.value("requires_interaction").toBool();
-                    bool preferred = choice.value("preferred").toBool() && preferredBackend;
-                    PayInfo* pay = new PayInfo();
-                    pay->setPayData(name, description, paymentId, backend, requiresInteracion, preferred);
-                    listPays.append(qVariantFromValue((QObject*)pay));
-                    if (preferred) {
-                        m_preferred = pay;
-                    }
-                }
-            }
-            qDebug() << "Emit signal paymentTypesObtained";
-            Q_EMIT paymentTypesObtained(listPays);
-            if (m_preferred == nullptr) {
-                Q_EMIT noPreferredPaymentMethod();
-            }
-            qDebug() << "Emit signal certificateFound";
-            CertificateAdapter* cert = new CertificateAdapter(reply->sslConfiguration().peerCertificate());
-            Q_EMIT certificateFound(cert);
-        } else if (state->operation.contains(BUY_ITEM) && document.isObject()) {
-            qDebug() << "Reply state: BUY_ITEM";
-            QJsonObject object = document.object();
-            QString state = object.value("state").toString();
-
-            if (state == BUY_COMPLETE) {
-                qDebug() << "BUY STATE: complete";
-                Q_EMIT buyItemSucceeded();
-            } else if (state == BUY_IN_PROGRESS) {
-                QUrl url(getPayApiUrl(object.value("redirect_to").toString()));
-                qDebug() << "BUY STATE: in progress";
-                qDebug() << "BUY Redirect URL:" << url.toString();
-                QString sign = m_token.signUrl(url.toString(), "GET", true);
-                url.setQuery(encodeQuerySlashes(sign));
-                Q_EMIT buyInteractionRequired(url.toString());
-            } else {
-                qDebug() << "BUY STATE: failed";
-                Q_EMIT buyItemFailed();
-            }
-        } else if (state->operation.contains(ITEM_INFO) && document.isObject()) {
-            qDebug() << "Reply state: ITEM_INFO";
-            QJsonObject object = document.object();
-            QString icon;
-            QString publisher;
-            if (object.contains("publisher")) {
-                publisher = object.value("publisher").toString();
-            }
-            if (object.contains("icon_url")) {
-                icon = object.value("icon_url").toString();
-            } else if (object.contains("icon")) {
-                icon = object.value("icon").toString();
-            } else {
-                if (m_selectedAppId != "click-scope") {
-                    try {
-                        auto u_appid = AppID::discover(m_selectedAppId.toStdString());
-                        auto u_app = Application::create(u_appid, Registry::getDefault());
-                        if (u_app) {
-                            icon = QString::fromStdString(u_app->info()->iconPath());
-                        }
-                    } catch (std::runtime_error) {
-                        // Just avoid crashing to fall back to the theme icon
-                    }
-                }
-            }
-
-            QString title = object.value("title").toString();
-
-            QJsonObject prices = object.value("prices").toObject();
-            QString suggested_currency = DEFAULT_CURRENCY;
-            QString currency = DEFAULT_CURRENCY;
-            if (reply->hasRawHeader(SUGGESTED_CURRENCY_HEADER_NAME)) {
-                suggested_currency = reply->rawHeader(SUGGESTED_CURRENCY_HEADER_NAME);
-            }
-            const char* env_value = std::getenv(CURRENCY_ENVVAR);
-            if (env_value != NULL) {
-                suggested_currency = env_value;
-            }
-
-            if (isSupportedCurrency(suggested_currency) && prices.contains(suggested_currency)) {
-                currency = suggested_currency;
-            }
-            double price = 0.00;
-            if (prices[currency].isDouble()) {
-                    price = prices[currency].toDouble();
-            } else if (prices[currency].isString()) {
-                price = prices[currency].toString().toDouble();
-            }
-            QLocale locale;
-            QString formatted_price = locale.toCurrencyString(price, getSymbolForCurrency(currency));
-            qDebug() << "Sending signal: itemDetailsObtained: " << title << " " << formatted_price;
-            Q_EMIT itemDetailsObtained(title, publisher, currency, formatted_price, icon.isEmpty() ? FALLBACK_ICON_URL : icon);
-        } else if (state->operation.contains(CHECK_PURCHASED)) {
-            QJsonObject object = document.object();
-            auto state = object.value("state").toString();
-            if (state == "Complete" || state == "purchased "||
-                state == "approved") {
-                Q_EMIT buyItemSucceeded();
-            } else {
-                Q_EMIT itemNotPurchased();
-            }
-        } else {
-            QString message("Reply received for non valid state.");
-            qWarning() << message;
-            Q_EMIT error(message);
+        qCDebug(payNetwork) << payload;
+        m_updating = updating;
+        (this->*request->handler)(reply, payload);
+        m_updating = false;
+        if (wantsCertificate) {
+            emitCertificate(certificate);
         }
-
     } else if (httpStatus == 401 || httpStatus == 403) {
         qWarning() << "Credentials no longer valid. Invalidating.";
         m_service.invalidateCredentials();
         Q_EMIT authenticationError();
-    } else if (httpStatus == 404 && state->operation.contains(CHECK_PURCHASED)) {
-        Q_EMIT itemNotPurchased();
+    } else if (httpStatus == 404 && request->notFound != nullptr) {
+        (this->*request->notFound)();
     } else {
         QString message(QString::number(httpStatus));
         message += ": ";
@@ -298,9 +453,190 @@ void Network::onReply(QNetworkReply *reply)
         qWarning() << message;
         Q_EMIT error(message);
     }
+    if (dropUnclaimed) {
+        dropPrefetched();
+    }
     reply->deleteLater();
 }
 
+void Network::emitCertificate(const QSslCertificate& certificate)
+{
+    // Nothing to show for a reply that never went to the server, QML
+    // takes any certificate as a secure connection
+    if (certificate.isNull()) {
+        return;
+    }
+
+    qCDebug(payNetwork) << "Emit signal certificateFound";
+    CertificateAdapter* cert = new CertificateAdapter(certificate);
+    Q_EMIT certificateFound(cert);
+}
+
+void Network::invalidReply()
+{
+    QString message("Reply received for non valid state.");
+    qWarning() << message;
+    Q_EMIT error(message);
+}
+
+void Network::handlePaymentTypes(QNetworkReply*, const QByteArray& payload)
+{
+    QJsonDocument document = QJsonDocument::fromJson(payload);
+    if (!document.isArray()) {
+        invalidReply();
+        return;
+    }
+
+    qCDebug(payNetwork) << "Reply state: PAYMENT_TYPES";
+    QList<PaymentMethod> methods;
+    QJsonArray array = document.array();
+    for (int i = 0; i < array.size(); i++) {
+        QJsonObject object = array.at(i).toObject();
+        QString description = object.value("description").toString();
+        QString backend = object.value("id").toString();
+        bool preferredBackend = object.value("preferred").toBool();
+        QJsonArray choices = object.value("choices").toArray();
+        for (int j = 0; j < choices.size(); j++) {
+            QJsonObject choice = choices.at(j).toObject();
+            PaymentMethod method;
+            method.name = choice.value("description").toString();
+            method.description = description;
+            method.paymentId = QString::number(choice.value("id").toInt());
+            method.backendId = backend;
+            method.requiresInteraction = choice.value("requires_interaction").toBool();
+            method.preferred = choice.value("preferred").toBool() && preferredBackend;
+            methods.append(method);
+        }
+    }
+    m_paymentMethods.setMethods(methods);
+    if (m_updating) {
+        qCDebug(payNetwork) << "Emit signal paymentTypesUpdated";
+        Q_EMIT paymentTypesUpdated();
+        return;
+    }
+    qCDebug(payNetwork) << "Emit signal paymentTypesObtained";
+    Q_EMIT paymentTypesObtained();
+    if (m_paymentMethods.preferredIndex() < 0) {
+        Q_EMIT noPreferredPaymentMethod();
+    }
+}
+
+void Network::handlePurchase(QNetworkReply*, const QByteArray& payload)
+{
+    QJsonDocument document = QJsonDocument::fromJson(payload);
+    if (!document.isObject()) {
+        invalidReply();
+        return;
+    }
+
+    qCDebug(payNetwork) << "Reply state: BUY_ITEM";
+    QJsonObject object = document.object();
+    QString state = object.value("state").toString();
+
+    if (state == BUY_COMPLETE) {
+        qCDebug(payNetwork) << "BUY STATE: complete";
+        Q_EMIT purchaseResultObtained(PURCHASE_RESULT_PURCHASED, QString::fromUtf8(payload));
+        Q_EMIT buyItemSucceeded();
+    } else if (state == BUY_IN_PROGRESS) {
+        QUrl url(getPayApiUrl(object.value("redirect_to").toString()));
+        qCDebug(payNetwork) << "BUY STATE: in progress";
+        qCDebug(payNetwork) << "BUY Redirect URL:" << url.toString();
+        QString sign = m_token.signUrl(url.toString(), "GET", true);
+        url.setQuery(encodeQuerySlashes(sign));
+        Q_EMIT buyInteractionRequired(url.toString());
+    } else {
+        qCDebug(payNetwork) << "BUY STATE: failed";
+        Q_EMIT purchaseResultObtained(PURCHASE_RESULT_NOT_PURCHASED, QString::fromUtf8(payload));
+        Q_EMIT buyItemFailed();
+    }
+}
+
+void Network::handleItemInfo(QNetworkReply* reply, const QByteArray& payload)
+{
+    QJsonDocument document = QJsonDocument::fromJson(payload);
+    if (!document.isObject()) {
+        invalidReply();
+        return;
+    }
+
+    qCDebug(payNetwork) << "Reply state: ITEM_INFO";
+    QJsonObject object = document.object();
+    QString icon;
+    QString publisher;
+    if (object.contains("publisher")) {
+        publisher = object.value("publisher").toString();
+    }
+    if (object.contains("icon_url")) {
+        icon = object.value("icon_url").toString();
+    } else if (object.contains("icon")) {
+        icon = object.value("icon").toString();
+    } else {
+        if (m_selectedAppId != "click-scope") {
+            try {
+                auto u_appid = AppID::discover(m_selectedAppId.toStdString());
+                auto u_app = Application::create(u_appid, Registry::getDefault());
+                if (u_app) {
+                    icon = QString::fromStdString(u_app->info()->iconPath());
+                }
+            } catch (std::runtime_error) {
+                // Just avoid crashing to fall back to the theme icon
+            }
+        }
+    }
+
+    QString title = object.value("title").toString();
+
+    QJsonObject prices = object.value("prices").toObject();
+    QString suggested_currency = DEFAULT_CURRENCY;
+    QString currency = DEFAULT_CURRENCY;
+    if (reply->hasRawHeader(SUGGESTED_CURRENCY_HEADER_NAME)) {
+        suggested_currency = reply->rawHeader(SUGGESTED_CURRENCY_HEADER_NAME);
+    }
+    const char* env_value = std::getenv(CURRENCY_ENVVAR);
+    if (env_value != NULL) {
+        suggested_currency = env_value;
+    }
+
+    if (isSupportedCurrency(suggested_currency) && prices.contains(suggested_currency)) {
+        currency = suggested_currency;
+    }
+    double price = 0.00;
+    if (prices[currency].isDouble()) {
+            price = prices[currency].toDouble();
+    } else if (prices[currency].isString()) {
+        price = prices[currency].toString().toDouble();
+    }
+    QLocale locale;
+    QString formatted_price = locale.toCurrencyString(price, getSymbolForCurrency(currency));
+    if (m_updating) {
+        qCDebug(payNetwork) << "Sending signal: itemDetailsUpdated: " << title << " " << formatted_price;
+        Q_EMIT itemDetailsUpdated(title, publisher, currency, formatted_price, icon.isEmpty() ? FALLBACK_ICON_URL : icon);
+        return;
+    }
+    qCDebug(payNetwork) << "Sending signal: itemDetailsObtained: " << title << " " << formatted_price;
+    Q_EMIT itemDetailsObtained(title, publisher, currency, formatted_price, icon.isEmpty() ? FALLBACK_ICON_URL : icon);
+}
+
+void Network::handleItemPurchased(QNetworkReply*, const QByteArray& payload)
+{
+    QJsonObject object = QJsonDocument::fromJson(payload).object();
+    auto state = object.value("state").toString();
+    if (state == "Complete" || state == "purchased" ||
+        state == "approved") {
+        Q_EMIT purchaseResultObtained(PURCHASE_RESULT_PURCHASED, QString::fromUtf8(payload));
+        Q_EMIT buyItemSucceeded();
+    } else {
+        Q_EMIT purchaseResultObtained(PURCHASE_RESULT_NOT_PURCHASED, QString::fromUtf8(payload));
+        Q_EMIT itemNotPurchased();
+    }
+}
+
+void Network::handleItemNotPurchased()
+{
+    Q_EMIT purchaseResultObtained(PURCHASE_RESULT_NOT_PURCHASED, QString());
+    Q_EMIT itemNotPurchased();
+}
+
 void Network::requestPaymentTypes(const QString& currency)
 {
     QNetworkRequest request;
@@ -313,9 +649,7 @@ void Network::requestPaymentTypes(const QString& currency)
     signRequestUrl(request, url.toString());
     request.setRawHeader("Accept", "application/json");
     request.setUrl(url);
-    RequestObject* reqObject = new RequestObject(QString(PAYMENT_TYPES));
-    request.setOriginatingObject(reqObject);
-    m_nam.get(request);
+    sendGet(request, &Network::handlePaymentTypes);
 }
 
 void Network::checkPassword(const QString& email, const QString& password,
@@ -329,8 +663,14 @@ void Network::buyItemWithPreferredPaymentType(const QString& email, const QStrin
                                               const QString& appid, const QString& itemid, const QString& currency,
                                               bool recentLogin)
 {
-    m_selectedPaymentId = m_preferred->paymentId();
-    m_selectedBackendId = m_preferred->backendId();
+    int preferred = m_paymentMethods.preferredIndex();
+    if (preferred < 0) {
+        qWarning() << "No preferred payment method to buy with.";
+        Q_EMIT noPreferredPaymentMethod();
+        return;
+    }
+    m_selectedPaymentId = m_paymentMethods.at(preferred).paymentId;
+    m_selectedBackendId = m_paymentMethods.at(preferred).backendId;
     m_selectedAppId = appid;
     m_selectedItemId = itemid;
     m_currency = currency;
@@ -360,6 +700,16 @@ void Network::buyItem(const QString& email, const QString& password,
 
 void Network::purchaseProcess()
 {
+    DeviceContext* device = DeviceContext::instance();
+    if (!device->isReady()) {
+        qDebug() << "Waiting for the device ID before purchasing";
+        connect(device, &DeviceContext::ready,
+                this, &Network::purchaseProcess, Qt::UniqueConnection);
+        return;
+    }
+    disconnect(device, &DeviceContext::ready,
+               this, &Network::purchaseProcess);
+
     QUrl url(getPayApiUrl(QString(PAY_API_ROOT) + PAY_PURCHASES_PATH + "/"));
     qDebug() << "Request Purchase:" << url;
     qDebug() << "Payment" << m_selectedAppId << m_selectedBackendId << m_selectedPaymentId;
@@ -378,48 +728,30 @@ void Network::purchaseProcess()
 
     QNetworkRequest request;
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    request.setRawHeader(DEVICE_ID_HEADER, getDeviceId().toUtf8().data());
+    request.setRawHeader(DEVICE_ID_HEADER, device->deviceId().toUtf8().data());
 
     // Get the partner ID and add it to the request.
-    QByteArray partner_id = getPartnerId();
+    QByteArray partner_id = device->partnerId();
     if (!partner_id.isEmpty()) {
         request.setRawHeader(PARTNER_ID_HEADER, partner_id);
     }
+    // Let the server join the purchase trace, if there is one
+    if (!m_traceId.isEmpty()) {
+        auto traceId = m_traceId.toStdString();
+        request.setRawHeader("traceparent", QByteArray::fromStdString(Trace::traceparent(traceId)));
+        m_purchaseSpan = std::make_shared<Trace::Span>(traceId, "payui.purchase-request");
+    }
     request.setUrl(url);
+    // Purchases always go to the server, and never come from the cache
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+    request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+    request.setSslConfiguration(sslConfiguration(url.host()));
     signRequestUrl(request, url.toString(), QString("POST"));
-    RequestObject* reqObject = new RequestObject(QString(BUY_ITEM));
-    request.setOriginatingObject(reqObject);
-    m_nam.post(request, content);
-}
-
-QByteArray Network::getPartnerId()
-{
-    QByteArray id;
-
-    if (QFile::exists(PARTNER_ID_FILE)) {
-        QFile pid_file(PARTNER_ID_FILE);
-        if (pid_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            // Always use lowercase, and trim whitespace.
-            id = pid_file.readLine().toLower().trimmed();
-            qDebug() << "Found partner ID:" << id;
-        } else {
-            qWarning() << "Failed to open partner ID file.";
-        }
-    } else {
-        qDebug() << "No partner ID file found.";
-    }
-
-    return id;
-}
-
-QString Network::getDeviceId()
-{
-    QDBusInterface iface("com.ubuntu.WhoopsiePreferences",
-                         "/com/ubuntu/WhoopsiePreferences",
-                         "com.ubuntu.WhoopsiePreferences",
-                         QDBusConnection::systemBus(), 0);
-    QDBusReply<QString> reply = iface.call("GetIdentifier");
-    return reply.value();
+    QNetworkReply* reply = m_nam.post(request, content);
+    connect(reply, &QNetworkReply::finished, this, [this]() {
+        m_purchaseSpan.reset();
+    });
+    track(reply, &Network::handlePurchase);
 }
 
 void Network::getItemInfo(const QString& packagename, const QString& sku)
@@ -444,9 +776,7 @@ void Network::getItemInfo(const QString& packagename, const QString& sku)
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     request.setUrl(url);
     signRequestUrl(request, url.toString(), QStringLiteral("GET"));
-    RequestObject* reqObject = new RequestObject(QString(ITEM_INFO));
-    request.setOriginatingObject(reqObject);
-    m_nam.get(request);
+    sendGet(request, &Network::handleItemInfo);
 }
 
 QString Network::getEnvironmentValue(const QString& key,
@@ -488,6 +818,11 @@ QString Network::getAddPaymentUrl(const QString& currency)
     return payUrl.toString();
 }
 
+PaymentMethodsModel* Network::paymentMethods()
+{
+    return &m_paymentMethods;
+}
+
 QDateTime Network::getTokenUpdated()
 {
     return m_token.updated();
@@ -505,18 +840,48 @@ void Network::checkItemPurchased(const QString& appid, const QString& sku)
     qDebug() << "Checking for previous purchase:" << url;
     QNetworkRequest request;
     request.setUrl(url);
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+    request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+    request.setSslConfiguration(sslConfiguration(url.host()));
     signRequestUrl(request, url.toString(), QStringLiteral("GET"));
-    RequestObject* reqObject = new RequestObject(QString(CHECK_PURCHASED));
-    request.setOriginatingObject(reqObject);
-    m_nam.get(request);
+    RequestObject* pending = track(m_nam.get(request), &Network::handleItemPurchased);
+    pending->notFound = &Network::handleItemNotPurchased;
+}
+
+void Network::setTraceId(const QString& traceId)
+{
+    m_traceId = traceId;
 }
 
 void Network::handleCredentialsFound(Token token)
 {
     m_token = token;
+
+    if (m_credentialsPrefetch == Prefetch::PENDING) {
+        prefetchRequests();
+        if (!m_credentialsWanted) {
+            m_credentialsPrefetch = Prefetch::FOUND;
+            return;
+        }
+        m_credentialsPrefetch = Prefetch::NONE;
+    }
+
     Q_EMIT credentialsFound();
 }
 
+void Network::handleCredentialsNotFound()
+{
+    if (m_credentialsPrefetch == Prefetch::PENDING) {
+        if (!m_credentialsWanted) {
+            m_credentialsPrefetch = Prefetch::NOT_FOUND;
+            return;
+        }
+        m_credentialsPrefetch = Prefetch::NONE;
+    }
+
+    Q_EMIT credentialsNotFound();
+}
+
 void  Network::handleCredentialsStored()
 {
     // Get credentials again to update token object.
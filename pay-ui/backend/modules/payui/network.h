@@ -20,17 +20,29 @@
 #define NETWORK_H
 
 #include <QDateTime>
+#include <QMap>
 #include <QObject>
+#include <QPointer>
 #include <QtNetwork/QNetworkReply>
 #include <QStringList>
 #include <QVariantList>
 #include <QUrl>
+#include <QSharedPointer>
 #include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslConfiguration>
 #include <token.h>
 #include "credentials_service.h"
 
 #include "certificateadapter.h"
-#include "pay_info.h"
+#include "payment_methods_model.h"
+
+#include <memory>
+
+namespace Trace
+{
+class Span;
+}
 
 using namespace UbuntuOne;
 
@@ -47,17 +59,43 @@ constexpr static const char* SEARCH_API_ROOT{"/api/v1"};
 constexpr static const char* FALLBACK_ICON_URL{"image://theme/placeholder-app-icon"};
 
 
+class Network;
+
+// One request to the server and what to do with its reply. It's a child
+// of the reply, so the two go away together.
 class RequestObject : public QObject
 {
     Q_OBJECT
 public:
-    explicit RequestObject(QString oper, QObject *parent = 0) :
-        QObject(parent)
+    typedef void (Network::*Handler)(QNetworkReply* reply, const QByteArray& payload);
+    typedef void (Network::*NotFoundHandler)();
+
+    RequestObject(QNetworkReply* in_reply, Handler in_handler) :
+        QObject(in_reply),
+        reply(in_reply),
+        handler(in_handler)
     {
-        operation = oper;
     }
 
-    QString operation;
+    QNetworkReply* reply;
+    // Gets the payload of a successful reply
+    Handler handler;
+    // A 404 is an answer rather than an error when this is set
+    NotFoundHandler notFound = nullptr;
+    // Checking whether a reply we served from the cache is still current
+    bool revalidation = false;
+    // Who the server said it was, null for a reply from the cache
+    QSslCertificate certificate;
+
+    // What a reply from the cache and its revalidation share, the two
+    // answer the same request and only the first one gets to start
+    // anything off
+    struct Answer {
+        bool delivered = false;
+        // From whichever of the two went to the server
+        QSslCertificate certificate;
+    };
+    QSharedPointer<Answer> answer;
 };
 
 class Network : public QObject
@@ -81,8 +119,11 @@ public:
     void getCredentials();
     void setCredentials(Token token);
     QString getAddPaymentUrl(const QString& currency);
+    PaymentMethodsModel* paymentMethods();
     QDateTime getTokenUpdated();
     void checkItemPurchased(const QString& appid, const QString& sku);
+    void setTraceId(const QString& traceId);
+    void prefetch(const QString& appid, const QString& itemid);
     static QString getSymbolForCurrency(const QString& currency_code);
     static bool isSupportedCurrency(const QString& currency_code);
     static QString sanitizeUrl(const QUrl& url);
@@ -94,7 +135,11 @@ public:
 
 Q_SIGNALS:
     void itemDetailsObtained(QString title, QString publisher, QString currency, QString formatted_price, QString icon);
-    void paymentTypesObtained(QVariantList payments);
+    void paymentTypesObtained();
+    // The server had newer details than the cached ones we already
+    // showed, only what's displayed should change
+    void itemDetailsUpdated(QString title, QString publisher, QString currency, QString formatted_price, QString icon);
+    void paymentTypesUpdated();
     void buyItemSucceeded();
     void buyItemFailed();
     void buyInteractionRequired(QString url);
@@ -108,10 +153,11 @@ Q_SIGNALS:
     void twoFactorAuthRequired();
     void itemNotPurchased();
     void certificateFound(QObject* cert);
+    void purchaseResultObtained(QString status, QString item);
 
 private Q_SLOTS:
-    void onReply(QNetworkReply*);
     void handleCredentialsFound(Token token);
+    void handleCredentialsNotFound();
     void handleCredentialsStored();
     void purchaseProcess();
 
@@ -120,17 +166,59 @@ private:
     QNetworkRequest m_request;
     CredentialsService m_service;
     Token m_token;
-    PayInfo* m_preferred;
+    PaymentMethodsModel m_paymentMethods;
     QString m_selectedPaymentId;
     QString m_selectedBackendId;
     QString m_selectedAppId;
     QString m_selectedItemId;
     QString m_currency;
     bool m_startPurchase = false;
-
+    // Set while a handler gets newer data for something it already handled
+    bool m_updating = false;
+    QString m_traceId;
+    std::shared_ptr<Trace::Span> m_purchaseSpan;
+
+    // Requests started by prefetch() before anyone asked for them, by
+    // URL. Their replies wait here until the same request is made, or
+    // until the item info shows nobody is going to make it.
+    enum class Prefetch { NONE, PENDING, FOUND, NOT_FOUND };
+    struct Prefetched {
+        RequestObject* request = nullptr;
+        bool wanted = false;
+        // Everything fetch() started for it, to stop them if unclaimed
+        QList<QPointer<QNetworkReply>> replies;
+    };
+    Prefetch m_credentialsPrefetch = Prefetch::NONE;
+    bool m_credentialsWanted = false;
+    bool m_prefetching = false;
+    QString m_prefetchAppId;
+    QString m_prefetchItemId;
+    QMap<QString, Prefetched> m_prefetched;
+
+    // TLS session tickets by host, kept between runs so the first
+    // request of a run can resume a session instead of a full handshake
+    QString m_sessionsFile;
+    QMap<QString, QByteArray> m_sessionTickets;
+
+    void prefetchRequests();
+    void warmUp(const QString& baseUrl);
+    void loadSessionTickets();
+    void storeSessionTicket(QNetworkReply* reply);
+    QSslConfiguration sslConfiguration(const QString& host);
+    RequestObject* track(QNetworkReply* reply, RequestObject::Handler handler);
+    void sendGet(const QNetworkRequest& request, RequestObject::Handler handler);
+    QList<QPointer<QNetworkReply>> fetch(const QNetworkRequest& request, RequestObject::Handler handler);
+    bool holdPrefetched(RequestObject* request);
+    void dropPrefetched();
+    void onReply(RequestObject* request);
+    void emitCertificate(const QSslCertificate& certificate);
+    void handlePaymentTypes(QNetworkReply* reply, const QByteArray& payload);
+    void handlePurchase(QNetworkReply* reply, const QByteArray& payload);
+    void handleItemInfo(QNetworkReply* reply, const QByteArray& payload);
+    void handleItemPurchased(QNetworkReply* reply, const QByteArray& payload);
+    void handleItemNotPurchased();
+    void invalidReply();
     void signRequestUrl(QNetworkRequest& request, QString url, QString method="GET");
-    QString getDeviceId();
-    QByteArray getPartnerId();
 };
 
 }
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "payment_methods_model.h"
+
+namespace UbuntuPurchase {
+
+bool PaymentMethod::operator==(const PaymentMethod& other) const
+{
+    return name == other.name &&
+        description == other.description &&
+        paymentId == other.paymentId &&
+        backendId == other.backendId &&
+        requiresInteraction == other.requiresInteraction &&
+        preferred == other.preferred;
+}
+
+PaymentMethodsModel::PaymentMethodsModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+int PaymentMethodsModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_methods.size();
+}
+
+QVariant PaymentMethodsModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_methods.size()) {
+        return QVariant();
+    }
+
+    const PaymentMethod& method = m_methods.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return method.name;
+    case DescriptionRole:
+        return method.description;
+    case PaymentIdRole:
+        return method.paymentId;
+    case BackendIdRole:
+        return method.backendId;
+    case RequiresInteractionRole:
+        return method.requiresInteraction;
+    case PreferredRole:
+        return method.preferred;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> PaymentMethodsModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[NameRole] = "name";
+    roles[DescriptionRole] = "description";
+    roles[PaymentIdRole] = "paymentId";
+    roles[BackendIdRole] = "backendId";
+    roles[RequiresInteractionRole] = "requiresInteraction";
+    roles[PreferredRole] = "preferred";
+    return roles;
+}
+
+void PaymentMethodsModel::setMethods(const QList<PaymentMethod>& methods)
+{
+    int oldCount = m_methods.size();
+
+    // Drop the ones that are gone first, then everything left over is
+    // in the new list somewhere, and just needs moving or updating.
+    for (int row = m_methods.size() - 1; row >= 0; row--) {
+        const PaymentMethod& old = m_methods.at(row);
+        bool found = false;
+        for (const auto& method : methods) {
+            if (method.paymentId == old.paymentId && method.backendId == old.backendId) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            beginRemoveRows(QModelIndex(), row, row);
+            m_methods.removeAt(row);
+            endRemoveRows();
+        }
+    }
+
+    for (int row = 0; row < methods.size(); row++) {
+        const PaymentMethod& method = methods.at(row);
+        int current = -1;
+        for (int i = row; i < m_methods.size(); i++) {
+            if (m_methods.at(i).paymentId == method.paymentId &&
+                m_methods.at(i).backendId == method.backendId) {
+                current = i;
+                break;
+            }
+        }
+
+        if (current < 0) {
+            beginInsertRows(QModelIndex(), row, row);
+            m_methods.insert(row, method);
+            endInsertRows();
+            continue;
+        }
+
+        if (current != row) {
+            beginMoveRows(QModelIndex(), current, current, QModelIndex(), row);
+            m_methods.move(current, row);
+            endMoveRows();
+        }
+
+        if (m_methods.at(row) != method) {
+            m_methods[row] = method;
+            QModelIndex changed = index(row);
+            Q_EMIT dataChanged(changed, changed);
+        }
+    }
+
+    if (m_methods.size() != oldCount) {
+        Q_EMIT countChanged();
+    }
+}
+
+QVariantMap PaymentMethodsModel::get(int row) const
+{
+    QVariantMap map;
+    if (row < 0 || row >= m_methods.size()) {
+        return map;
+    }
+
+    QHash<int, QByteArray> roles = roleNames();
+    for (auto role = roles.constBegin(); role != roles.constEnd(); ++role) {
+        map[QString::fromUtf8(role.value())] = data(index(row), role.key());
+    }
+    return map;
+}
+
+int PaymentMethodsModel::indexOf(const QString& paymentId, const QString& backendId) const
+{
+    for (int row = 0; row < m_methods.size(); row++) {
+        if (m_methods.at(row).paymentId == paymentId &&
+            m_methods.at(row).backendId == backendId) {
+            return row;
+        }
+    }
+    return -1;
+}
+
+int PaymentMethodsModel::preferredIndex() const
+{
+    for (int row = 0; row < m_methods.size(); row++) {
+        if (m_methods.at(row).preferred) {
+            return row;
+        }
+    }
+    return -1;
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of version 3 of the GNU Lesser General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PAYMENT_METHODS_MODEL_H
+#define PAYMENT_METHODS_MODEL_H
+
+#include <QAbstractListModel>
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+
+namespace UbuntuPurchase {
+
+struct PaymentMethod
+{
+    QString name;
+    QString description;
+    QString paymentId;
+    QString backendId;
+    bool requiresInteraction = false;
+    bool preferred = false;
+
+    bool operator==(const PaymentMethod& other) const;
+    bool operator!=(const PaymentMethod& other) const { return !(*this == other); }
+};
+
+// The payment methods the user can choose from. A refresh only touches
+// the rows that changed, so the views keep the delegates they have.
+class PaymentMethodsModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        DescriptionRole,
+        PaymentIdRole,
+        BackendIdRole,
+        RequiresInteractionRole,
+        PreferredRole
+    };
+
+    explicit PaymentMethodsModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int count() const { return m_methods.size(); }
+    const PaymentMethod& at(int row) const { return m_methods.at(row); }
+    void setMethods(const QList<PaymentMethod>& methods);
+
+    Q_INVOKABLE QVariantMap get(int row) const;
+    Q_INVOKABLE int indexOf(const QString& paymentId, const QString& backendId) const;
+    Q_INVOKABLE int preferredIndex() const;
+
+Q_SIGNALS:
+    void countChanged();
+
+private:
+    QList<PaymentMethod> m_methods;
+};
+
+}
+
+#endif // PAYMENT_METHODS_MODEL_H
@@ -21,10 +21,14 @@
 #include <QUrlQuery>
 #include <QCoreApplication>
 #include <QDateTime>
+#include <QDBusConnection>
+#include <QDBusMessage>
 #include <QtDebug>
 
 #include <logging.h>
 
+#include <common/trace.h>
+
 namespace UbuntuPurchase {
 
 Purchase::Purchase(QObject *parent) :
@@ -35,6 +39,10 @@ Purchase::Purchase(QObject *parent) :
                      this, &Purchase::itemDetailsObtained);
     connect(&m_network, &Network::paymentTypesObtained,
                      this, &Purchase::paymentTypesObtained);
+    connect(&m_network, &Network::itemDetailsUpdated,
+                     this, &Purchase::itemDetailsUpdated);
+    connect(&m_network, &Network::paymentTypesUpdated,
+                     this, &Purchase::paymentTypesUpdated);
     connect(&m_network, &Network::buyItemSucceeded,
                      this, &Purchase::buyItemSucceeded);
     connect(&m_network, &Network::buyItemFailed,
@@ -61,6 +69,8 @@ Purchase::Purchase(QObject *parent) :
                      this, &Purchase::itemNotPurchased);
     connect(&m_network, &Network::certificateFound,
                      this, &Purchase::certificateFound);
+    connect(&m_network, &Network::purchaseResultObtained,
+                     this, &Purchase::reportPurchaseResult);
 
     QCoreApplication* instance = QCoreApplication::instance();
 
@@ -79,9 +89,25 @@ Purchase::Purchase(QObject *parent) :
             m_appid = data.host();
             m_itemid = data.fileName();
             qDebug() << "Purchase requested for" << m_itemid << "by app" << m_appid;
+
+            // We're part of a purchase trace that started in the app
+            QString traceId = QUrlQuery(data).queryItemValue(Trace::idKey);
+            if (!traceId.isEmpty()) {
+                m_network.setTraceId(traceId);
+                m_span = std::make_shared<Trace::Span>(traceId.toStdString(), "payui.session");
+            }
+
+            // Where the service wants to hear how the purchase went
+            m_resultPath = QUrlQuery(data).queryItemValue("result");
             break;
         }
     }
+
+    // Everything the checkout page starts with is known now, get it
+    // going while QML is still loading
+    if (!m_appid.isEmpty() || !m_itemid.isEmpty()) {
+        m_network.prefetch(m_appid, m_itemid);
+    }
 }
 
 Purchase::~Purchase()
@@ -92,15 +118,34 @@ Purchase::~Purchase()
 void Purchase::quitCancel()
 {
     qDebug() << "Purchase Canceled: exit code 1";
+    m_span.reset();
     QCoreApplication::exit(1);
 }
 
 void Purchase::quitSuccess()
 {
     qDebug() << "Purchase Succeeded: exit code 0";
+    m_span.reset();
     QCoreApplication::exit(0);
 }
 
+void Purchase::reportPurchaseResult(QString status, QString item)
+{
+    if (m_resultPath.isEmpty()) {
+        return;
+    }
+
+    // Saves the service asking the store again once we exit, it
+    // only double checks in the background
+    qDebug() << "Reporting purchase result:" << status;
+    QDBusMessage message = QDBusMessage::createMethodCall("com.canonical.pay",
+                                                          m_resultPath,
+                                                          "com.canonical.pay.payui",
+                                                          "PurchaseResult");
+    message << status << item;
+    QDBusConnection::sessionBus().asyncCall(message);
+}
+
 void Purchase::checkCredentials()
 {
     m_network.getCredentials();
@@ -141,6 +186,11 @@ void Purchase::buyItem(QString email, QString password, QString otp, QString cur
     m_network.buyItem(email, password, otp, m_appid, m_itemid, currency, paymentId, backendId, recentLogin);
 }
 
+PaymentMethodsModel* Purchase::paymentMethods()
+{
+    return m_network.paymentMethods();
+}
+
 QDateTime Purchase::getTokenUpdated()
 {
     return m_network.getTokenUpdated();
@@ -13,6 +13,7 @@ namespace UbuntuPurchase {
 class Purchase : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY(UbuntuPurchase::PaymentMethodsModel* paymentMethods READ paymentMethods CONSTANT)
 
 public:
     explicit Purchase(QObject *parent = 0);
@@ -31,9 +32,13 @@ public:
     Q_INVOKABLE QDateTime getTokenUpdated();
     Q_INVOKABLE void checkItemPurchased();
 
+    PaymentMethodsModel* paymentMethods();
+
 Q_SIGNALS:
     void itemDetailsObtained(QString title, QString publisher, QString currency, QString formatted_price, QString icon);
-    void paymentTypesObtained(QVariantList payments);
+    void paymentTypesObtained();
+    void itemDetailsUpdated(QString title, QString publisher, QString currency, QString formatted_price, QString icon);
+    void paymentTypesUpdated();
     void buyItemSucceeded();
     void buyItemFailed();
     void buyInterationRequired(QString url);
@@ -48,10 +53,15 @@ Q_SIGNALS:
     void itemNotPurchased();
     void certificateFound(QObject* cert);
 
+private Q_SLOTS:
+    void reportPurchaseResult(QString status, QString item);
+
 private:
     Network m_network;
     QString m_appid;
     QString m_itemid;
+    QString m_resultPath;
+    std::shared_ptr<Trace::Span> m_span;
 };
 
 }
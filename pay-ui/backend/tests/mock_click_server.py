@@ -1,9 +1,14 @@
 import json
 import threading
+import time
 from http.server import BaseHTTPRequestHandler, HTTPServer
+from socketserver import ThreadingMixIn
 
 
 KEEP_ALIVE = True
+# Bumped on every reply under /changing/, so a revalidation always
+# finds something new
+REVISION = 0
 
 
 class MyHandler(BaseHTTPRequestHandler):
@@ -57,16 +62,30 @@ class MyHandler(BaseHTTPRequestHandler):
                 ]
             }
         ]
+        if self.path.find("/changing/") != -1 and \
+                self.headers.get("If-None-Match") is not None:
+            # Lets the client show what it had cached before this
+            time.sleep(0.2)
+        if self.path.find("/slowpayments/") != -1:
+            time.sleep(0.5)
         if fail:
             self.send_response(404)
         else:
             self.send_response(200)
         self.send_header("Content-type", "application/json")
+        if self.path.find("/changing/") != -1:
+            global REVISION
+            REVISION += 1
+            self.send_header("ETag", '"%d"' % REVISION)
+            self.send_header("Cache-Control", "no-cache")
         self.end_headers()
         self.wfile.write(bytes(json.dumps(types), 'UTF-8'))
 
     def response_buy_item(self, fail=False, interaction=False):
         state = "Complete" if not interaction else "InProgress"
+        # The store's own name for the state of an item already bought
+        if self.path.find("/storepurchased/") != -1:
+            state = "purchased"
         response = {
             "state": state,
         }
@@ -86,6 +105,8 @@ class MyHandler(BaseHTTPRequestHandler):
         self.wfile.write(bytes(json.dumps(response), 'UTF-8'))
 
     def response_item_info(self, fail, eurozone, dotar):
+        if self.path.find("/slowiteminfo/") != -1:
+            time.sleep(0.5)
         if self.path.find("/items/by-sku/") != -1:
             response = {
                 "id": 1,
@@ -159,9 +180,14 @@ class MyHandler(BaseHTTPRequestHandler):
             self.response_item_info(fail, eurozone, dotar)
 
 
+class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
+    # A slow reply mustn't hold back the others
+    daemon_threads = True
+
+
 def run_click_server():
     server_address = ('', 8000)
-    httpd = HTTPServer(server_address, MyHandler)
+    httpd = ThreadedHTTPServer(server_address, MyHandler)
     global KEEP_ALIVE
     print('start')
     while KEEP_ALIVE:
@@ -26,14 +26,15 @@
 #include <QUrlQuery>
 #include <QString>
 #include <QDir>
+#include <QStandardPaths>
 #include <QTest>
 #include <QTimer>
 #include <QSignalSpy>
 #include <QVariant>
 #include <QVariantList>
 
-#include <modules/payui/network.h>
-#include <modules/payui/pay_info.h>
+#include <modules/payui/network->h>
+#include <modules/payui/payment_methods_model.h>
 
 using namespace UbuntuPurchase;
 
@@ -45,8 +46,11 @@ private slots:
     void initTestCase();
     void testNetworkAuthenticationError();
     void testNetworkGetPaymentTypes();
+    void testNetworkGetPaymentTypesRefresh();
+    void testNetworkGetPaymentTypesUpdated();
     void testNetworkGetPaymentTypesFail();
     void testNetworkBuyItem();
+    void testNetworkBuyItemResult();
     void testNetworkBuyItemInProgress();
     void testNetworkBuyItemFail();
     void testNetworkButItemWithPaymentType();
@@ -59,15 +63,23 @@ private slots:
     void testNetworkGetItemInfoOverrideOther();
     void testNetworkGetItemInfoIAPAppIconFallback();
     void testNetworkGetItemInfoFail();
+    void testNetworkPrefetchReplyFirst();
+    void testNetworkPrefetchReplyFirstCached();
+    void testNetworkPrefetchRequestFirst();
+    void testNetworkPrefetchRequestFirstCached();
     void testUseExistingCredentials();
     void testCheckAlreadyPurchased();
     void testCheckAlreadyPurchasedFail();
+    void testCheckAlreadyPurchasedFailResult();
+    void testCheckAlreadyPurchasedStoreState();
     void testSanitizeUrl();
     void testEncodeQuerySlashes();
     void cleanupTestCase();
 
 private:
-    UbuntuPurchase::Network network;
+    void prefetchOtherCurrency(const QString& baseUrl, bool cached, bool guessStored);
+
+    UbuntuPurchase::Network* network;
     QProcess* process;
 };
 
@@ -75,7 +87,12 @@ void TestNetwork::initTestCase()
 {
     setenv("SSO_AUTH_BASE_URL", "http://localhost:8000/", 1);
     qDebug() << "Starting Server";
-    network.setCredentials(Token("token_key", "token_secret", "consumer_key", "consumer_secret"));
+    // Keep the reply cache away from the user's, and start it empty so
+    // nothing from an earlier run gets revalidated
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).removeRecursively();
+    network = new UbuntuPurchase::Network(this);
+    network->setCredentials(Token("token_key", "token_secret", "consumer_key", "consumer_secret"));
     process = new QProcess(this);
     QSignalSpy spy(process, SIGNAL(started()));
     process->setWorkingDirectory(QDir::currentPath() + "/backend/tests/");
@@ -96,36 +113,68 @@ void TestNetwork::initTestCase()
 void TestNetwork::testNetworkAuthenticationError()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/authError/", 1);
-    QSignalSpy spy(&network, SIGNAL(authenticationError()));
-    network.buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
+    QSignalSpy spy(network, SIGNAL(authenticationError()));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
     QTRY_COMPARE(spy.count(), 1);
 }
 
 void TestNetwork::testNetworkGetPaymentTypes()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);    
-    QSignalSpy spy(&network, SIGNAL(paymentTypesObtained(QVariantList)));
-    network.requestPaymentTypes("USD");
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    network->requestPaymentTypes("USD");
     QTRY_COMPARE(spy.count(), 1);
-    QList<QVariant> arguments = spy.takeFirst();
-    QVERIFY(arguments.at(0).toList().count() == 3);
-    QVariantList listPays = arguments.at(0).toList();
-    for (int i = 0; i < listPays.count(); i++) {
-        QVariant var = listPays.at(i);
-        PayInfo* info = var.value<PayInfo*>();
+    PaymentMethodsModel* methods = network->paymentMethods();
+    QCOMPARE(methods->count(), 3);
+    for (int i = 0; i < methods->count(); i++) {
         if (i == 2) {
-            QVERIFY(info->preferred() == true);
+            QVERIFY(methods->at(i).preferred == true);
         } else {
-            QVERIFY(info->preferred() == false);
+            QVERIFY(methods->at(i).preferred == false);
         }
     }
 }
 
+void TestNetwork::testNetworkGetPaymentTypesRefresh()
+{
+    setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    network->requestPaymentTypes("USD");
+    QTRY_COMPARE(spy.count(), 1);
+    PaymentMethodsModel* methods = network->paymentMethods();
+    QSignalSpy inserted(methods, SIGNAL(rowsInserted(QModelIndex, int, int)));
+    QSignalSpy removed(methods, SIGNAL(rowsRemoved(QModelIndex, int, int)));
+    QSignalSpy changed(methods, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    network->requestPaymentTypes("USD");
+    QTRY_COMPARE(spy.count(), 2);
+    QCOMPARE(methods->count(), 3);
+    QCOMPARE(inserted.count(), 0);
+    QCOMPARE(removed.count(), 0);
+    QCOMPARE(changed.count(), 0);
+}
+
+void TestNetwork::testNetworkGetPaymentTypesUpdated()
+{
+    setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/changing/", 1);
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    QSignalSpy updated(network, SIGNAL(paymentTypesUpdated()));
+    network->requestPaymentTypes("USD");
+    QTRY_COMPARE(spy.count(), 1);
+    // Nothing was cached, so there's nothing to update
+    QCOMPARE(updated.count(), 0);
+    // The server holds back revalidations, so the cached reply is
+    // always shown first and the server's newer one updates it
+    network->requestPaymentTypes("USD");
+    QTRY_COMPARE(updated.count(), 1);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(network->paymentMethods()->count(), 3);
+}
+
 void TestNetwork::testNetworkGetPaymentTypesFail()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/fail/", 1);
-    QSignalSpy spy(&network, SIGNAL(error(QString)));
-    network.requestPaymentTypes("USD");
+    QSignalSpy spy(network, SIGNAL(error(QString)));
+    network->requestPaymentTypes("USD");
     QTRY_COMPARE(spy.count(), 1);
     QList<QVariant> arguments = spy.takeFirst();
     QVERIFY(arguments.at(0).toString().startsWith("404:"));
@@ -134,16 +183,27 @@ void TestNetwork::testNetworkGetPaymentTypesFail()
 void TestNetwork::testNetworkBuyItem()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(buyItemSucceeded()));
-    network.buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
+    QSignalSpy spy(network, SIGNAL(buyItemSucceeded()));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
     QTRY_COMPARE(spy.count(), 1);
 }
 
+void TestNetwork::testNetworkBuyItemResult()
+{
+    setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
+    QSignalSpy spy(network, SIGNAL(purchaseResultObtained(QString, QString)));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
+    QTRY_COMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), QString("purchased"));
+    QVERIFY(arguments.at(1).toString().contains("Complete"));
+}
+
 void TestNetwork::testNetworkBuyItemInProgress()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/interaction/", 1);
-    QSignalSpy spy(&network, SIGNAL(buyInteractionRequired(QString)));
-    network.buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
+    QSignalSpy spy(network, SIGNAL(buyInteractionRequired(QString)));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
     QTRY_COMPARE(spy.count(), 1);
     QList<QVariant> arguments = spy.takeFirst();
     QString url(arguments.at(0).toString());
@@ -154,43 +214,43 @@ void TestNetwork::testNetworkBuyItemInProgress()
 void TestNetwork::testNetworkBuyItemFail()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/fail/", 1);
-    QSignalSpy spy(&network, SIGNAL(buyItemFailed()));
-    network.buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
+    QSignalSpy spy(network, SIGNAL(buyItemFailed()));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", false);
     QTRY_COMPARE(spy.count(), 1);
 }
 
 void TestNetwork::testNetworkButItemWithPaymentType()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(paymentTypesObtained(QVariantList)));
-    network.requestPaymentTypes("USD");
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    network->requestPaymentTypes("USD");
     QTRY_COMPARE(spy.count(), 1);
-    QSignalSpy spy2(&network, SIGNAL(buyItemSucceeded()));
-    network.buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
+    QSignalSpy spy2(network, SIGNAL(buyItemSucceeded()));
+    network->buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
     QTRY_COMPARE(spy2.count(), 1);
 }
 
 void TestNetwork::testNetworkButItemWithPaymentTypeFail()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(paymentTypesObtained(QVariantList)));
-    network.requestPaymentTypes("USD");
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    network->requestPaymentTypes("USD");
     QTRY_COMPARE(spy.count(), 1);
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/fail/", 1);
-    QSignalSpy spy2(&network, SIGNAL(buyItemFailed()));
-    network.buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
+    QSignalSpy spy2(network, SIGNAL(buyItemFailed()));
+    network->buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
     QTRY_COMPARE(spy2.count(), 1);
 }
 
 void TestNetwork::testNetworkButItemWithPaymentTypeInProgress()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(paymentTypesObtained(QVariantList)));
-    network.requestPaymentTypes("USD""USD");
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    network->requestPaymentTypes("USD""USD");
     QTRY_COMPARE(spy.count(), 1);
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/interaction/", 1);
-    QSignalSpy spy2(&network, SIGNAL(buyInteractionRequired(QString)));
-    network.buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
+    QSignalSpy spy2(network, SIGNAL(buyInteractionRequired(QString)));
+    network->buyItemWithPreferredPaymentType("email", "password", "otp", "USD", "appid", "itemid", false);
     QTRY_COMPARE(spy2.count(), 1);
 }
 
@@ -198,8 +258,8 @@ void TestNetwork::testNetworkGetItemInfo()
 {
      setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/", 1);
      unsetenv(CURRENCY_ENVVAR);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("packagename", "");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("packagename", "");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(2).toString(), QStringLiteral("USD"));
@@ -210,8 +270,8 @@ void TestNetwork::testNetworkGetItemInfoEurozone()
 {
      setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/eurozone/", 1);
      unsetenv(CURRENCY_ENVVAR);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("packagename", "");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("packagename", "");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(2).toString(), QStringLiteral("EUR"));
@@ -222,8 +282,8 @@ void TestNetwork::testNetworkGetItemInfoOtherCoins()
 {
      setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/dotar/", 1);
      unsetenv(CURRENCY_ENVVAR);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("packagename", "");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("packagename", "");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(2).toString(), QStringLiteral("USD"));
@@ -234,8 +294,8 @@ void TestNetwork::testNetworkGetItemInfoOverride()
 {
      setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/", 1);
      setenv(CURRENCY_ENVVAR, "EUR", true);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("packagename", "");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("packagename", "");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(2).toString(), QStringLiteral("EUR"));
@@ -247,8 +307,8 @@ void TestNetwork::testNetworkGetItemInfoOverrideOther()
 {
      setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/dotar/", 1);
      setenv(CURRENCY_ENVVAR, "EUR", true);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("packagename", "");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("packagename", "");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(2).toString(), QStringLiteral("EUR"));
@@ -259,8 +319,8 @@ void TestNetwork::testNetworkGetItemInfoOverrideOther()
 void TestNetwork::testNetworkGetItemInfoIAPAppIconFallback()
 {
      setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/iteminfo/", 1);
-     QSignalSpy spy(&network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
-     network.getItemInfo("donations-ubuntu.canonical", "donate5");
+     QSignalSpy spy(network, SIGNAL(itemDetailsObtained(QString,QString,QString,QString,QString)));
+     network->getItemInfo("donations-ubuntu.canonical", "donate5");
      QTRY_COMPARE(spy.count(), 1);
      QList<QVariant> arguments = spy.takeFirst();
      QCOMPARE(arguments.at(4).toString(), QString(FALLBACK_ICON_URL));
@@ -271,47 +331,136 @@ void TestNetwork::testNetworkGetItemInfoFail()
 {
     setenv(SEARCH_BASE_URL_ENVVAR, "http://localhost:8000/fail/iteminfo/", 1);
     unsetenv(CURRENCY_ENVVAR);
-    QSignalSpy spy(&network, SIGNAL(error(QString)));
-    network.getItemInfo("packagename", "");
+    QSignalSpy spy(network, SIGNAL(error(QString)));
+    network->getItemInfo("packagename", "");
     QTRY_COMPARE(spy.count(), 1);
 }
 
+// Prefetches for an item the server suggests euros for, so the payment
+// types guessed in dollars are never asked for. They go away once the
+// item info is handled, so asking for them later goes to the server and
+// revalidates whatever the guess left in the cache.
+void TestNetwork::prefetchOtherCurrency(const QString& baseUrl, bool cached, bool guessStored)
+{
+    setenv(PAY_BASE_URL_ENVVAR, baseUrl.toUtf8().constData(), 1);
+    unsetenv(CURRENCY_ENVVAR);
+    QSignalSpy spy(network, SIGNAL(paymentTypesObtained()));
+    QSignalSpy updated(network, SIGNAL(paymentTypesUpdated()));
+    if (cached) {
+        network->requestPaymentTypes("USD");
+        QTRY_COMPARE(spy.count(), 1);
+        spy.clear();
+    }
+
+    // What payui.qml does with the item details
+    QString currency;
+    auto connection = connect(network, &Network::itemDetailsObtained,
+                              [this, &currency](QString, QString, QString suggested, QString, QString) {
+        currency = suggested;
+        network->requestPaymentTypes(suggested);
+    });
+    network->prefetch("donations-ubuntu.canonical", "donate5");
+    network->getItemInfo("donations-ubuntu.canonical", "donate5");
+    QTRY_COMPARE(spy.count(), 1);
+    disconnect(connection);
+    QCOMPARE(currency, QStringLiteral("EUR"));
+    QCOMPARE(updated.count(), 0);
+
+    spy.clear();
+    network->requestPaymentTypes("USD");
+    if (guessStored) {
+        QTRY_COMPARE(updated.count(), 1);
+        QCOMPARE(spy.count(), 1);
+    } else {
+        QTRY_COMPARE(spy.count(), 1);
+        QCOMPARE(updated.count(), 0);
+    }
+}
+
+void TestNetwork::testNetworkPrefetchReplyFirst()
+{
+    prefetchOtherCurrency("http://localhost:8000/changing/slowiteminfo/first/iteminfo/eurozone/",
+                          false, true);
+}
+
+void TestNetwork::testNetworkPrefetchReplyFirstCached()
+{
+    prefetchOtherCurrency("http://localhost:8000/changing/slowiteminfo/cached/iteminfo/eurozone/",
+                          true, true);
+}
+
+void TestNetwork::testNetworkPrefetchRequestFirst()
+{
+    // The guess is stopped before the server answers, nothing's cached
+    prefetchOtherCurrency("http://localhost:8000/changing/slowpayments/first/iteminfo/eurozone/",
+                          false, false);
+}
+
+void TestNetwork::testNetworkPrefetchRequestFirstCached()
+{
+    prefetchOtherCurrency("http://localhost:8000/changing/slowpayments/cached/iteminfo/eurozone/",
+                          true, true);
+}
+
 void TestNetwork::testUseExistingCredentials()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(buyItemSucceeded()));
-    network.buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", true);
+    QSignalSpy spy(network, SIGNAL(buyItemSucceeded()));
+    network->buyItem("email", "password", "otp", "USD", "appid", "itemid", "paymentid", "backendid", true);
     QTRY_COMPARE(spy.count(), 1);
 }
 
 void TestNetwork::testCheckAlreadyPurchased()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/", 1);
-    QSignalSpy spy(&network, SIGNAL(buyItemSucceeded()));
-    network.checkItemPurchased("com.example.fakeapp", "");
+    QSignalSpy spy(network, SIGNAL(buyItemSucceeded()));
+    network->checkItemPurchased("com.example.fakeapp", "");
     QTRY_COMPARE(spy.count(), 1);
 }
 
 void TestNetwork::testCheckAlreadyPurchasedFail()
 {
     setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/notpurchased/", 1);
-    QSignalSpy spy(&network, SIGNAL(itemNotPurchased()));
-    network.checkItemPurchased("com.example.fakeapp", "");
+    QSignalSpy spy(network, SIGNAL(itemNotPurchased()));
+    network->checkItemPurchased("com.example.fakeapp", "");
+    QTRY_COMPARE(spy.count(), 1);
+}
+
+void TestNetwork::testCheckAlreadyPurchasedFailResult()
+{
+    setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/notpurchased/", 1);
+    QSignalSpy spy(network, SIGNAL(purchaseResultObtained(QString, QString)));
+    network->checkItemPurchased("com.example.fakeapp", "");
     QTRY_COMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), QString("not purchased"));
+}
+
+void TestNetwork::testCheckAlreadyPurchasedStoreState()
+{
+    setenv(PAY_BASE_URL_ENVVAR, "http://localhost:8000/storepurchased/", 1);
+    QSignalSpy spy(network, SIGNAL(purchaseResultObtained(QString, QString)));
+    QSignalSpy spy2(network, SIGNAL(buyItemSucceeded()));
+    network->checkItemPurchased("com.example.fakeapp", "");
+    QTRY_COMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), QString("purchased"));
+    QVERIFY(arguments.at(1).toString().contains("\"purchased\""));
+    QCOMPARE(spy2.count(), 1);
 }
 
 void TestNetwork::testSanitizeUrl()
 {
     QUrl url("https://example.com//test/this/heavily///really%2f/");
     QUrl expected("https://example.com/test/this/heavily/really%2f/");
-    QString result = network.sanitizeUrl(url);
+    QString result = network->sanitizeUrl(url);
     QTRY_COMPARE(result, expected.toString());
 }
 
 void TestNetwork::testEncodeQuerySlashes()
 {
     QString query("abcdef/01235%3D");
-    QTRY_COMPARE(network.encodeQuerySlashes(query),
+    QTRY_COMPARE(network->encodeQuerySlashes(query),
                  QStringLiteral("abcdef%2F01235%3D"));
 }
 
@@ -319,6 +468,7 @@ void TestNetwork::cleanupTestCase()
 {
     process->close();
     process->deleteLater();
+    delete network;
 }
 
 QTEST_MAIN(TestNetwork)
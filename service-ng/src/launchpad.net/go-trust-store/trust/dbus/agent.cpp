@@ -22,28 +22,197 @@
 
 #include "agent.h"
 
-Agent::Agent(const std::shared_ptr<core::dbus::Bus> &bus,
-             const std::shared_ptr<core::trust::Agent> &agent) :
-	m_bus(bus),
-	m_agent(agent)
+namespace
+{
+	std::mutex sharedBusesMutex;
+	std::map<core::dbus::WellKnownBus, std::weak_ptr<SharedBus>> sharedBuses;
+}
+
+std::shared_ptr<SharedBus> SharedBus::forBus(core::dbus::WellKnownBus bus)
+{
+	std::lock_guard<std::mutex> lock(sharedBusesMutex);
+
+	auto shared = sharedBuses[bus].lock();
+	if (!shared)
+	{
+		shared = std::shared_ptr<SharedBus>(new SharedBus(bus));
+		sharedBuses[bus] = shared;
+	}
+
+	return shared;
+}
+
+SharedBus::SharedBus(core::dbus::WellKnownBus bus) :
+	m_bus(std::make_shared<core::dbus::Bus>(bus)),
+	m_stopping(false)
 {
 	m_bus->install_executor(core::dbus::asio::make_executor(m_bus));
 	m_dbusThread = std::thread(std::bind(&core::dbus::Bus::run, m_bus));
+	m_workerThread = std::thread(std::bind(&SharedBus::work, this));
+}
+
+SharedBus::~SharedBus()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_tasksMutex);
+		m_stopping = true;
+	}
+	m_tasksChanged.notify_all();
+	if (m_workerThread.joinable())
+	{
+		m_workerThread.join();
+	}
+
+	m_bus->stop();
+	if (m_dbusThread.joinable())
+	{
+		m_dbusThread.join();
+	}
+}
+
+std::shared_ptr<core::dbus::Bus> SharedBus::bus() const
+{
+	return m_bus;
+}
+
+void SharedBus::post(const std::function<void()> &task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_tasksMutex);
+		m_tasks.push_back(task);
+	}
+	m_tasksChanged.notify_one();
 }
 
-Agent::~Agent()
+void SharedBus::work()
 {
-	if (m_bus)
+	std::unique_lock<std::mutex> lock(m_tasksMutex);
+	while (true)
 	{
-		m_bus->stop();
-		if (m_dbusThread.joinable())
+		m_tasksChanged.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+
+		// Finish what was asked for before stopping, so every callback gets
+		// its answer
+		if (m_tasks.empty())
 		{
-			m_dbusThread.join();
+			return;
 		}
+
+		auto task = m_tasks.front();
+		m_tasks.pop_front();
+
+		lock.unlock();
+		task();
+		lock.lock();
 	}
 }
 
+const std::chrono::steady_clock::duration Agent::defaultGrantedLifetime =
+	std::chrono::minutes(5);
+
+Agent::Agent(const std::shared_ptr<SharedBus> &bus,
+             const std::shared_ptr<core::trust::Agent> &agent,
+             std::chrono::steady_clock::duration grantedLifetime) :
+	m_bus(bus),
+	m_agent(agent),
+	m_granted(std::make_shared<Granted>(grantedLifetime))
+{
+}
+
 std::shared_ptr<core::trust::Agent> Agent::agent() const
 {
 	return m_agent;
 }
+
+core::trust::Request::Answer Agent::authenticate(
+	const core::trust::Agent::RequestParameters &parameters)
+{
+	auto key = keyFor(parameters);
+	if (m_granted->contains(key))
+	{
+		return core::trust::Request::Answer::granted;
+	}
+
+	auto answer = m_agent->authenticate_request_with_parameters(parameters);
+	m_granted->remember(key, answer);
+	return answer;
+}
+
+void Agent::authenticateAsync(
+	const core::trust::Agent::RequestParameters &parameters,
+	const Callback &callback)
+{
+	auto key = keyFor(parameters);
+	if (m_granted->contains(key))
+	{
+		callback(core::trust::Request::Answer::granted);
+		return;
+	}
+
+	// The shim agent can go away with the Go one before the answer comes
+	// back, so hold on to what we need from it.
+	auto agent = m_agent;
+	auto granted = m_granted;
+	m_bus->post([agent, granted, parameters, key, callback]()
+	{
+		auto answer = agent->authenticate_request_with_parameters(parameters);
+		granted->remember(key, answer);
+		callback(answer);
+	});
+}
+
+void Agent::invalidate()
+{
+	m_granted->clear();
+}
+
+Agent::Key Agent::keyFor(const core::trust::Agent::RequestParameters &parameters)
+{
+	return Key(parameters.application.uid.value(),
+	           parameters.application.id,
+	           parameters.feature.value());
+}
+
+Agent::Granted::Granted(std::chrono::steady_clock::duration lifetime) :
+	m_lifetime(lifetime)
+{
+}
+
+bool Agent::Granted::contains(const Key &key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto granted = m_expiries.find(key);
+	if (granted == m_expiries.end())
+	{
+		return false;
+	}
+
+	if (granted->second < std::chrono::steady_clock::now())
+	{
+		m_expiries.erase(granted);
+		return false;
+	}
+
+	return true;
+}
+
+void Agent::Granted::remember(const Key &key, core::trust::Request::Answer answer)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (answer == core::trust::Request::Answer::granted)
+	{
+		m_expiries[key] = std::chrono::steady_clock::now() + m_lifetime;
+	}
+	else
+	{
+		m_expiries.erase(key);
+	}
+}
+
+void Agent::Granted::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_expiries.clear();
+}
@@ -23,11 +23,14 @@ package dbus
 // #cgo CXXFLAGS: -std=c++11 -Wall
 // #include <stdlib.h>
 // #include "agent_shim.h"
+//
+// extern void goAuthenticateCallback(Answer answer, uintptr_t context);
 import "C"
 
 import (
 	"errors"
 	"runtime"
+	"sync"
 	"unsafe"
 
 	"launchpad.net/go-trust-store/trust"
@@ -110,6 +113,46 @@ func (agent *Agent) AuthenticateRequestWithParameters(parameters *trust.RequestP
 		agent.agent, (*C.RequestParameters)(parameters.ToShim()))))
 }
 
+// AuthenticateRequestWithParametersAsync authenticates the given request
+// without waiting for the user's answer, which is passed to the callback. The
+// callback may be called from another goroutine, or before this returns.
+func (agent *Agent) AuthenticateRequestWithParametersAsync(parameters *trust.RequestParameters, callback func(trust.Answer)) {
+	callbacksMutex.Lock()
+	nextCallback++
+	context := nextCallback
+	callbacks[context] = callback
+	callbacksMutex.Unlock()
+
+	C.authenticateRequestWithParametersAsync(agent.agent,
+		(*C.RequestParameters)(parameters.ToShim()),
+		(C.AuthenticateCallback)(unsafe.Pointer(C.goAuthenticateCallback)),
+		C.uintptr_t(context))
+}
+
+// InvalidateCache forgets the requests that were granted, so the trust store
+// is asked about them again.
+func (agent *Agent) InvalidateCache() {
+	C.invalidateAgentCache(agent.agent)
+}
+
+// The callbacks of the authentications that haven't been answered yet. C only
+// gets the key, as it can't hold on to Go pointers.
+var (
+	callbacksMutex sync.Mutex
+	callbacks      = make(map[uintptr]func(trust.Answer))
+	nextCallback   uintptr
+)
+
+//export goAuthenticateCallback
+func goAuthenticateCallback(answer C.Answer, context C.uintptr_t) {
+	callbacksMutex.Lock()
+	callback := callbacks[uintptr(context)]
+	delete(callbacks, uintptr(context))
+	callbacksMutex.Unlock()
+
+	callback(trust.AnswerFromShim(int(answer)))
+}
+
 // Destroy destroys the agent. This function isn't necessary to manually call,
 // but is idempotent.
 func (agent *Agent) Destroy() {
@@ -20,41 +20,121 @@
 #ifndef GO_TRUST_STORE_DBUS_AGENT_H
 #define GO_TRUST_STORE_DBUS_AGENT_H
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include <core/trust/agent.h>
 
 namespace core
 {
-	namespace trust
-	{
-		class Agent;
-	}
-
 	namespace dbus
 	{
 		class Bus;
+		enum class WellKnownBus;
 	}
 }
 
+// One connection to a well known bus, with the thread running it, shared by
+// all the agents on that bus. It also has the thread the non-blocking
+// authentications wait on, as they can't wait on the bus' own thread.
+class SharedBus
+{
+	public:
+		// The connection to the given bus, creating it if no agent is using
+		// one already.
+		static std::shared_ptr<SharedBus> forBus(core::dbus::WellKnownBus bus);
+
+		// Stop the DBus bus and the worker.
+		~SharedBus();
+
+		std::shared_ptr<core::dbus::Bus> bus() const;
+
+		// Run the task on the worker thread.
+		void post(const std::function<void()> &task);
+
+	private:
+		explicit SharedBus(core::dbus::WellKnownBus bus);
+
+		void work();
+
+		std::shared_ptr<core::dbus::Bus> m_bus;
+		std::thread m_dbusThread;
+
+		std::mutex m_tasksMutex;
+		std::condition_variable m_tasksChanged;
+		std::deque<std::function<void()>> m_tasks;
+		bool m_stopping;
+		std::thread m_workerThread;
+};
+
 // A shim DBus Agent. It exists simply to keep the shared_ptr of the bus and
-// agent alive and control them from C (thus Go). It also takes care of running
-// and stopping the DBus bus so we don't require dbus-cpp bindings.
+// agent alive and control them from C (thus Go). It also remembers the
+// requests that were granted, so asking again doesn't go over the bus.
 class Agent
 {
 	public:
-		// Run the DBus bus.
-		Agent(const std::shared_ptr<core::dbus::Bus> &bus,
-		      const std::shared_ptr<core::trust::Agent> &agent);
+		typedef std::function<void(core::trust::Request::Answer)> Callback;
+
+		// How long a granted request is taken as still granted. The trust
+		// store doesn't tell us when the user changes their mind, so don't
+		// trust it for long.
+		static const std::chrono::steady_clock::duration defaultGrantedLifetime;
 
-		// Stop the DBus bus.
-		~Agent();
+		Agent(const std::shared_ptr<SharedBus> &bus,
+		      const std::shared_ptr<core::trust::Agent> &agent,
+		      std::chrono::steady_clock::duration grantedLifetime = defaultGrantedLifetime);
 
 		std::shared_ptr<core::trust::Agent> agent() const;
 
+		// Authenticate the request, answering from the cache if we can.
+		core::trust::Request::Answer authenticate(
+			const core::trust::Agent::RequestParameters &parameters);
+
+		// Like authenticate(), but doesn't wait for the answer. The callback
+		// is called with it, straight away if it was cached and from the
+		// worker thread otherwise.
+		void authenticateAsync(
+			const core::trust::Agent::RequestParameters &parameters,
+			const Callback &callback);
+
+		// Forget all the granted requests.
+		void invalidate();
+
 	private:
-		std::shared_ptr<core::dbus::Bus> m_bus;
-		std::shared_ptr<core::trust::Agent> m_agent;
+		// uid, application ID and feature
+		typedef std::tuple<std::uint32_t, std::string, std::uint64_t> Key;
 
-		std::thread m_dbusThread;
+		// The requests that were granted, and until when we take them as
+		// still granted.
+		class Granted
+		{
+			public:
+				explicit Granted(std::chrono::steady_clock::duration lifetime);
+
+				bool contains(const Key &key);
+				void remember(const Key &key, core::trust::Request::Answer answer);
+				void clear();
+
+			private:
+				const std::chrono::steady_clock::duration m_lifetime;
+				std::mutex m_mutex;
+				std::map<Key, std::chrono::steady_clock::time_point> m_expiries;
+		};
+
+		static Key keyFor(const core::trust::Agent::RequestParameters &parameters);
+
+		std::shared_ptr<SharedBus> m_bus;
+		std::shared_ptr<core::trust::Agent> m_agent;
+		std::shared_ptr<Granted> m_granted;
 };
 
- #endif // GO_TRUST_STORE_DBUS_AGENT_H
+#endif // GO_TRUST_STORE_DBUS_AGENT_H
@@ -27,14 +27,14 @@
 
 namespace
 {
-	core::dbus::Bus::Ptr createDbusConnection(WellKnownBus bus)
+	core::dbus::WellKnownBus fromShimWellKnownBus(WellKnownBus bus)
 	{
 		switch(bus)
 		{
 			case SYSTEM:
-				return core::dbus::Bus::Ptr(new core::dbus::Bus(core::dbus::WellKnownBus::system));
+				return core::dbus::WellKnownBus::system;
 			default:
-				return core::dbus::Bus::Ptr(new core::dbus::Bus(core::dbus::WellKnownBus::session));
+				return core::dbus::WellKnownBus::session;
 		}
 	}
 
@@ -48,6 +48,17 @@ namespace
 		to.feature = core::trust::Feature(from.feature);
 		to.description = std::string(from.description);
 	}
+
+	Answer toShimAnswer(core::trust::Request::Answer answer)
+	{
+		switch (answer)
+		{
+			case core::trust::Request::Answer::granted:
+				return GRANTED;
+			default:
+				return DENIED;
+		}
+	}
 }
 
 Agent *createPerUserAgentForBusConnection(WellKnownBus bus,
@@ -56,12 +67,12 @@ Agent *createPerUserAgentForBusConnection(WellKnownBus bus,
 {
 	try
 	{
-		auto busConnection = createDbusConnection(bus);
+		auto sharedBus = SharedBus::forBus(fromShimWellKnownBus(bus));
 
 		return new Agent(
-			busConnection,
+			sharedBus,
 			core::trust::dbus::create_per_user_agent_for_bus_connection(
-				busConnection, std::string(serviceName)));
+				sharedBus->bus(), std::string(serviceName)));
 	}
 	catch(const std::exception &exception)
 	{
@@ -78,12 +89,12 @@ Agent *createMultiUserAgentForBusConnection(WellKnownBus bus,
 {
 	try
 	{
-		auto busConnection = createDbusConnection(bus);
+		auto sharedBus = SharedBus::forBus(fromShimWellKnownBus(bus));
 
 		return new Agent(
-			busConnection,
+			sharedBus,
 			core::trust::dbus::create_multi_user_agent_for_bus_connection(
-				busConnection, std::string(serviceName)));
+				sharedBus->bus(), std::string(serviceName)));
 	}
 	catch(const std::exception &exception)
 	{
@@ -105,11 +116,26 @@ Answer authenticateRequestWithParameters(Agent *agent, const RequestParameters *
 
 	fromShimRequestParameters(*parameters, agentParameters);
 
-	switch (agent->agent()->authenticate_request_with_parameters(agentParameters))
-	{
-		case core::trust::Request::Answer::granted:
-			return GRANTED;
-		default:
-			return DENIED;
-	}
+	return toShimAnswer(agent->authenticate(agentParameters));
+}
+
+void authenticateRequestWithParametersAsync(Agent *agent,
+                                            const RequestParameters * const parameters,
+                                            AuthenticateCallback callback,
+                                            uintptr_t context)
+{
+	core::trust::Agent::RequestParameters agentParameters;
+
+	fromShimRequestParameters(*parameters, agentParameters);
+
+	agent->authenticateAsync(agentParameters,
+		[callback, context](core::trust::Request::Answer answer)
+		{
+			callback(toShimAnswer(answer), context);
+		});
+}
+
+void invalidateAgentCache(Agent *agent)
+{
+	agent->invalidate();
 }
@@ -20,6 +20,8 @@
 #ifndef GO_TRUST_STORE_DBUS_AGENT_SHIM_H
 #define GO_TRUST_STORE_DBUS_AGENT_SHIM_H
 
+#include <stdint.h>
+
 #include "../request_shim.h"
 #include "../request_parameters_shim.h"
 
@@ -36,6 +38,10 @@ typedef enum
 	SYSTEM
 } WellKnownBus;
 
+// Called with the answer to a non-blocking authentication, and the context it
+// was started with.
+typedef void (*AuthenticateCallback)(Answer answer, uintptr_t context);
+
 // Create an Agent implementation that communicates with a remote agent living
 // in the same user session. This makes use of forward declaration to mask the
 // fact that the Agent is actually a C++ class.
@@ -53,10 +59,22 @@ Agent *createMultiUserAgentForBusConnection(WellKnownBus bus,
 // Destroy the agent and free all resources.
 void destroyAgent(Agent *agent);
 
-// Authenticate the given request and return the user's answer.
+// Authenticate the given request and return the user's answer. Requests that
+// were granted recently are answered without asking the trust store again.
 Answer authenticateRequestWithParameters(
 	Agent *agent, const RequestParameters *const parameters);
 
+// Authenticate the given request without waiting for the answer, which is
+// passed to the callback along with the context. The callback may run on
+// another thread, or before this returns if the answer was cached. The
+// parameters can be freed as soon as this returns.
+void authenticateRequestWithParametersAsync(
+	Agent *agent, const RequestParameters *const parameters,
+	AuthenticateCallback callback, uintptr_t context);
+
+// Forget the requests that were granted, so they're asked about again.
+void invalidateAgentCache(Agent *agent);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -33,6 +33,8 @@ func TestCreatePerUserAgentForBusConnection(t *testing.T) {
 	if agent == nil {
 		t.Fatal("Agent was unexpectedly nil")
 	}
+
+	agent.Destroy()
 }
 
 // Test typical CreateMultiUserAgentForBusConnection usage.
@@ -46,4 +48,42 @@ func TestCreateMultiUserAgentForBusConnection(t *testing.T) {
 	if agent == nil {
 		t.Fatal("Agent was unexpectedly nil")
 	}
+
+	agent.Destroy()
+}
+
+// Test that invalidating the cache of a new agent is fine.
+func TestInvalidateCache(t *testing.T) {
+	agent, err := CreatePerUserAgentForBusConnection(WellKnownBusSession, "foo")
+	if err != nil {
+		t.Fatalf("Unexpected error while creating per-user agent: %s", err)
+	}
+
+	agent.(*Agent).InvalidateCache()
+	agent.Destroy()
+}
+
+// Test that a granted request is answered without asking the trust store.
+func TestGrantedFromCache(t *testing.T) {
+	testAgent_GrantedFromCache(t)
+}
+
+// Test that a denial forgets the request being granted.
+func TestDenialEvicts(t *testing.T) {
+	testAgent_DenialEvicts(t)
+}
+
+// Test that a granted request is asked about again once it expires.
+func TestGrantExpires(t *testing.T) {
+	testAgent_GrantExpires(t)
+}
+
+// Test that the callback of a non-blocking authentication gets the answer.
+func TestAuthenticateAsyncCallback(t *testing.T) {
+	testAgent_AsyncCallback(t)
+}
+
+// Test that agents share their bus, which goes away with the last of them.
+func TestSharedBusRefcounting(t *testing.T) {
+	testAgent_SharedBusRefcounting(t)
 }
@@ -0,0 +1,209 @@
+/* Copyright (C) 2015 Canonical Ltd.
+ *
+ * This file is part of go-trust-store.
+ *
+ * go-trust-store is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * go-trust-store is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with go-trust-store. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+package dbus
+
+// Since cgo cannot be used within Go test files, this file holds the actual
+// tests and the corresponding test file calls them (i.e. the tests contained
+// within this file are not run directly, but are called from other tests).
+
+// #include "test_agent_shim.h"
+import "C"
+
+import (
+	"testing"
+	"time"
+
+	"launchpad.net/go-trust-store/trust"
+)
+
+// How long the tests wait for an answer that should come back on its own.
+const answerTimeout = 5 * time.Second
+
+// createAgentWithFake creates an agent that asks a fake instead of the trust
+// store, answering with the given answer until told otherwise.
+func createAgentWithFake(answer trust.Answer, grantedLifetime time.Duration) (*Agent, *C.FakeAgent) {
+	shimAnswer := C.Answer(C.DENIED)
+	if answer == trust.AnswerGranted {
+		shimAnswer = C.GRANTED
+	}
+
+	var fake *C.FakeAgent
+	cAgent := C.createAgentWithFake(C.SESSION, shimAnswer,
+		C.int64_t(grantedLifetime/time.Millisecond), &fake)
+
+	return &Agent{agent: cAgent}, fake
+}
+
+func testParameters(feature trust.Feature) *trust.RequestParameters {
+	return &trust.RequestParameters{
+		Application: trust.Application{
+			Uid: 1000,
+			Pid: 42,
+			Id:  "foo.bar_baz_1.0",
+		},
+		Feature:     feature,
+		Description: "foo",
+	}
+}
+
+func expectAnswer(t *testing.T, agent *Agent, feature trust.Feature, expected trust.Answer) {
+	answer := agent.AuthenticateRequestWithParameters(testParameters(feature))
+	if answer != expected {
+		t.Errorf("Answer was %s, expected %s", answer, expected)
+	}
+}
+
+func expectRequests(t *testing.T, fake *C.FakeAgent, expected int) {
+	requests := int(C.fakeRequestCount(fake))
+	if requests != expected {
+		t.Errorf("The trust store was asked %d times, expected %d", requests,
+			expected)
+	}
+}
+
+// Test that a granted request is answered from the cache.
+func testAgent_GrantedFromCache(t *testing.T) {
+	agent, fake := createAgentWithFake(trust.AnswerGranted, time.Minute)
+	defer agent.Destroy()
+
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectRequests(t, fake, 1)
+
+	// The trust store would say no now, but it isn't asked
+	C.setFakeAnswer(fake, C.DENIED)
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectRequests(t, fake, 1)
+
+	// Only the same request is cached
+	expectAnswer(t, agent, 2, trust.AnswerDenied)
+	expectRequests(t, fake, 2)
+
+	// Until the cache is invalidated
+	agent.InvalidateCache()
+	expectAnswer(t, agent, 1, trust.AnswerDenied)
+	expectRequests(t, fake, 3)
+}
+
+// Test that denied requests aren't cached, and that a denial forgets the
+// request being granted.
+func testAgent_DenialEvicts(t *testing.T) {
+	agent, fake := createAgentWithFake(trust.AnswerDenied, time.Minute)
+	defer agent.Destroy()
+
+	expectAnswer(t, agent, 1, trust.AnswerDenied)
+	expectAnswer(t, agent, 1, trust.AnswerDenied)
+	expectRequests(t, fake, 2)
+
+	// Get a denial going that comes back after the request was granted
+	C.holdNextFakeRequest(fake)
+	answers := make(chan trust.Answer, 1)
+	agent.AuthenticateRequestWithParametersAsync(testParameters(1),
+		func(answer trust.Answer) {
+			answers <- answer
+		})
+	C.waitForHeldFakeRequest(fake)
+
+	C.setFakeAnswer(fake, C.GRANTED)
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectRequests(t, fake, 4)
+
+	C.releaseFake(fake)
+	select {
+	case answer := <-answers:
+		if answer != trust.AnswerDenied {
+			t.Errorf("Answer was %s, expected %s", answer, trust.AnswerDenied)
+		}
+	case <-time.After(answerTimeout):
+		t.Fatal("Timed out waiting for the answer")
+	}
+
+	// The grant was forgotten, so the trust store is asked again
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectRequests(t, fake, 5)
+}
+
+// Test that a granted request is asked about again once it expires.
+func testAgent_GrantExpires(t *testing.T) {
+	agent, fake := createAgentWithFake(trust.AnswerGranted,
+		50*time.Millisecond)
+	defer agent.Destroy()
+
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectAnswer(t, agent, 1, trust.AnswerGranted)
+	expectRequests(t, fake, 1)
+
+	time.Sleep(100 * time.Millisecond)
+
+	C.setFakeAnswer(fake, C.DENIED)
+	expectAnswer(t, agent, 1, trust.AnswerDenied)
+	expectRequests(t, fake, 2)
+}
+
+// Test that the callback of a non-blocking authentication gets the answer,
+// from the worker if the trust store is asked and straight away if not.
+func testAgent_AsyncCallback(t *testing.T) {
+	agent, fake := createAgentWithFake(trust.AnswerGranted, time.Minute)
+	defer agent.Destroy()
+
+	answers := make(chan trust.Answer, 1)
+	callback := func(answer trust.Answer) {
+		answers <- answer
+	}
+
+	agent.AuthenticateRequestWithParametersAsync(testParameters(1), callback)
+	select {
+	case answer := <-answers:
+		if answer != trust.AnswerGranted {
+			t.Errorf("Answer was %s, expected %s", answer, trust.AnswerGranted)
+		}
+	case <-time.After(answerTimeout):
+		t.Fatal("Timed out waiting for the answer")
+	}
+	expectRequests(t, fake, 1)
+
+	agent.AuthenticateRequestWithParametersAsync(testParameters(1), callback)
+	select {
+	case answer := <-answers:
+		if answer != trust.AnswerGranted {
+			t.Errorf("Answer was %s, expected %s", answer, trust.AnswerGranted)
+		}
+	default:
+		t.Error("Cached answer wasn't given before returning")
+	}
+	expectRequests(t, fake, 1)
+
+	C.setFakeAnswer(fake, C.DENIED)
+	agent.AuthenticateRequestWithParametersAsync(testParameters(2), callback)
+	select {
+	case answer := <-answers:
+		if answer != trust.AnswerDenied {
+			t.Errorf("Answer was %s, expected %s", answer, trust.AnswerDenied)
+		}
+	case <-time.After(answerTimeout):
+		t.Fatal("Timed out waiting for the answer")
+	}
+	expectRequests(t, fake, 2)
+}
+
+// Test that agents share their bus, which goes away with the last of them.
+func testAgent_SharedBusRefcounting(t *testing.T) {
+	failure := C.checkSharedBusRefcounting(C.SESSION)
+	if failure != nil {
+		t.Error(C.GoString(failure))
+	}
+}
@@ -0,0 +1,167 @@
+/* Copyright (C) 2015 Canonical Ltd.
+ *
+ * This file is part of go-trust-store.
+ *
+ * go-trust-store is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * go-trust-store is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with go-trust-store. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <core/trust/agent.h>
+#include <core/dbus/dbus.h>
+
+#include "test_agent_shim.h"
+#include "agent.h"
+
+struct FakeAgent : public core::trust::Agent
+{
+	explicit FakeAgent(core::trust::Request::Answer answer) :
+		answer(answer)
+	{
+	}
+
+	core::trust::Request::Answer authenticate_request_with_parameters(
+		const RequestParameters &) override
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		auto given = answer;
+		requests++;
+
+		if (holdNext)
+		{
+			holdNext = false;
+			held = true;
+			changed.notify_all();
+			changed.wait(lock, [this] { return !held; });
+		}
+
+		return given;
+	}
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	core::trust::Request::Answer answer;
+	unsigned int requests = 0;
+	bool holdNext = false;
+	bool held = false;
+};
+
+namespace
+{
+	core::dbus::WellKnownBus fromShimWellKnownBus(WellKnownBus bus)
+	{
+		switch(bus)
+		{
+			case SYSTEM:
+				return core::dbus::WellKnownBus::system;
+			default:
+				return core::dbus::WellKnownBus::session;
+		}
+	}
+
+	core::trust::Request::Answer fromShimAnswer(Answer answer)
+	{
+		switch (answer)
+		{
+			case GRANTED:
+				return core::trust::Request::Answer::granted;
+			default:
+				return core::trust::Request::Answer::denied;
+		}
+	}
+}
+
+Agent *createAgentWithFake(WellKnownBus bus, Answer answer,
+                           int64_t grantedLifetimeMilliseconds,
+                           FakeAgent **fake)
+{
+	auto agent = std::make_shared<FakeAgent>(fromShimAnswer(answer));
+	*fake = agent.get();
+
+	return new Agent(SharedBus::forBus(fromShimWellKnownBus(bus)), agent,
+	                 std::chrono::milliseconds(grantedLifetimeMilliseconds));
+}
+
+void setFakeAnswer(FakeAgent *fake, Answer answer)
+{
+	std::lock_guard<std::mutex> lock(fake->mutex);
+	fake->answer = fromShimAnswer(answer);
+}
+
+unsigned int fakeRequestCount(FakeAgent *fake)
+{
+	std::lock_guard<std::mutex> lock(fake->mutex);
+	return fake->requests;
+}
+
+void holdNextFakeRequest(FakeAgent *fake)
+{
+	std::lock_guard<std::mutex> lock(fake->mutex);
+	fake->holdNext = true;
+}
+
+void waitForHeldFakeRequest(FakeAgent *fake)
+{
+	std::unique_lock<std::mutex> lock(fake->mutex);
+	fake->changed.wait(lock, [fake] { return fake->held; });
+}
+
+void releaseFake(FakeAgent *fake)
+{
+	{
+		std::lock_guard<std::mutex> lock(fake->mutex);
+		fake->held = false;
+	}
+	fake->changed.notify_all();
+}
+
+const char *checkSharedBusRefcounting(WellKnownBus bus)
+{
+	auto fake = std::make_shared<FakeAgent>(core::trust::Request::Answer::denied);
+	std::weak_ptr<SharedBus> shared;
+
+	{
+		auto first = new Agent(SharedBus::forBus(fromShimWellKnownBus(bus)), fake);
+		auto sharedBus = SharedBus::forBus(fromShimWellKnownBus(bus));
+		shared = sharedBus;
+		auto second = new Agent(sharedBus, fake);
+		sharedBus.reset();
+
+		if (SharedBus::forBus(fromShimWellKnownBus(bus)) != shared.lock())
+		{
+			delete first;
+			delete second;
+			return "Agents on the same bus didn't share its connection";
+		}
+
+		delete first;
+		if (shared.expired())
+		{
+			delete second;
+			return "The bus went away while an agent was still using it";
+		}
+
+		delete second;
+	}
+
+	if (!shared.expired())
+	{
+		return "The bus was still there after the last agent went away";
+	}
+
+	return NULL;
+}
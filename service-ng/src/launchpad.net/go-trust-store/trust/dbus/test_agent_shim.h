@@ -0,0 +1,64 @@
+/* Copyright (C) 2015 Canonical Ltd.
+ *
+ * This file is part of go-trust-store.
+ *
+ * go-trust-store is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * go-trust-store is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with go-trust-store. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GO_TRUST_STORE_DBUS_TEST_AGENT_SHIM_H
+#define GO_TRUST_STORE_DBUS_TEST_AGENT_SHIM_H
+
+#include <stdint.h>
+
+#include "agent_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A core::trust::Agent that answers every request with the same answer
+// instead of asking the trust store, for the tests.
+typedef struct FakeAgent FakeAgent;
+
+// Create an agent on the given bus that asks the fake instead of a remote
+// agent, and takes granted requests as still granted for the given number of
+// milliseconds. The fake lives as long as the agent.
+Agent *createAgentWithFake(WellKnownBus bus, Answer answer,
+                           int64_t grantedLifetimeMilliseconds,
+                           FakeAgent **fake);
+
+// Change what the fake answers from now on.
+void setFakeAnswer(FakeAgent *fake, Answer answer);
+
+// How many requests the fake was asked about.
+unsigned int fakeRequestCount(FakeAgent *fake);
+
+// Make the next request wait for releaseFake() before it's answered, with
+// the answer the fake had when it was asked.
+void holdNextFakeRequest(FakeAgent *fake);
+
+// Wait until a request is being held.
+void waitForHeldFakeRequest(FakeAgent *fake);
+
+// Answer the request being held.
+void releaseFake(FakeAgent *fake);
+
+// Check that agents on the same bus share its connection, and that it goes
+// away with the last of them. Returns what went wrong, or NULL.
+const char *checkSharedBusRefcounting(WellKnownBus bus);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // GO_TRUST_STORE_DBUS_TEST_AGENT_SHIM_H
@@ -17,10 +17,114 @@
 
 #include "currency.h"
 
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <QByteArray>
 #include <QLocale>
+#include <QString>
+
+namespace {
+
+/* How the locale lays out an amount in one currency, with the amount
+   left as %1 */
+struct Pattern {
+    QString positive;
+    QString negative;
+    int digits;
+    /* False if the symbol got in the way of finding the amount */
+    bool valid;
+};
+
+class Formatter {
+public:
+    QByteArray format(double price, const QByteArray& symbol) {
+        const Pattern& pattern = patternFor(symbol);
+        if (!pattern.valid) {
+            return locale.toCurrencyString(price, QString::fromUtf8(symbol)).toUtf8();
+        }
+
+        const QString& layout = price < 0 ? pattern.negative : pattern.positive;
+        return layout.arg(locale.toString(std::fabs(price), 'f', pattern.digits)).toUtf8();
+    }
+
+private:
+    /* The system locale doesn't change under us, look it up once */
+    const QLocale locale;
+    std::mutex mutex;
+    std::map<QByteArray, Pattern> patterns;
+
+    const Pattern& patternFor(const QByteArray& symbol) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = patterns.find(symbol);
+        if (found != patterns.end()) {
+            return found->second;
+        }
+
+        /* The key must not point into the caller's buffer */
+        QByteArray key(symbol.constData(), symbol.size());
+        return patterns.emplace(key, makePattern(QString::fromUtf8(symbol))).first->second;
+    }
+
+    /* QLocale lays out "1" with the currency's digits, then puts that and
+       the symbol into the currency format, so we can find our way back to
+       the format by looking for the number */
+    Pattern makePattern(const QString& symbol) {
+        Pattern pattern{QString(), QString(), 0, false};
+
+        QString positive = locale.toCurrencyString(1.0, symbol);
+        QString negative = locale.toCurrencyString(-1.0, symbol);
+
+        for (int digits = 3; digits >= 0; digits--) {
+            QString one = locale.toString(1.0, 'f', digits);
+            if (positive.count(one) == 1 && negative.count(one) == 1) {
+                if (symbol.contains(one) || symbol.contains('%')) {
+                    return pattern;
+                }
+
+                pattern.positive = positive.replace(one, QStringLiteral("%1"));
+                pattern.negative = negative.replace(one, QStringLiteral("%1"));
+                pattern.digits = digits;
+                pattern.valid = true;
+                return pattern;
+            }
+        }
+
+        return pattern;
+    }
+};
+
+Formatter& formatter() {
+    static Formatter instance;
+    return instance;
+}
+
+} // anonymous namespace
+
+size_t formatCurrencies(const double* prices,
+                        const char* symbols,
+                        const size_t* symbol_lengths,
+                        size_t count,
+                        char* buffer,
+                        size_t size,
+                        size_t* lengths) {
+    auto& fmt = formatter();
+    size_t needed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        QByteArray symbol = QByteArray::fromRawData(symbols, symbol_lengths[i]);
+        symbols += symbol_lengths[i];
+
+        QByteArray result = fmt.format(prices[i], symbol);
+        lengths[i] = result.size();
+        if (needed + result.size() <= size) {
+            memcpy(buffer + needed, result.constData(), result.size());
+        }
+        needed += result.size();
+    }
 
-char* toCurrencyString(double price, const char* symbol) {
-    QLocale locale;
-    QString result = locale.toCurrencyString(price, QString(symbol));
-    return result.toUtf8().data();
+    return needed;
 }
@@ -21,7 +21,6 @@ package service
 // #cgo pkg-config: Qt5Core
 // #cgo CXXFLAGS: -std=c++11 -Wall
 // #include "currency.h"
-// #include <stdlib.h>
 import "C"
 
 import (
@@ -45,13 +44,56 @@ var currencySymbolMap = map[string]string {
 }
 
 
+type CurrencyPrice struct {
+    Price  float64
+    Symbol string
+}
+
 func CurrencyString(price float64, symbol string) (string) {
-    symbolCstring := C.CString(symbol)
-    defer C.free(unsafe.Pointer(symbolCstring))
+    return CurrencyStrings([]CurrencyPrice{{price, symbol}})[0]
+}
 
-    result := C.toCurrencyString(C.double(price), symbolCstring)
+// Formats all the prices in a single call into C, which is where most
+// of the cost of formatting a single one goes.
+func CurrencyStrings(prices []CurrencyPrice) ([]string) {
+    results := make([]string, len(prices))
+    if len(prices) == 0 {
+        return results
+    }
+
+    values := make([]C.double, len(prices))
+    symbolLengths := make([]C.size_t, len(prices))
+    lengths := make([]C.size_t, len(prices))
+    // Never empty, so there's always a first byte to point at
+    symbols := make([]byte, 0, 1 + 4 * len(prices))
+    for i, price := range prices {
+        values[i] = C.double(price.Price)
+        symbolLengths[i] = C.size_t(len(price.Symbol))
+        symbols = append(symbols, price.Symbol...)
+    }
+    symbols = append(symbols, 0)
+
+    buffer := make([]byte, 16 * len(prices))
+    for {
+        needed := int(C.formatCurrencies(&values[0],
+            (*C.char)(unsafe.Pointer(&symbols[0])), &symbolLengths[0],
+            C.size_t(len(prices)),
+            (*C.char)(unsafe.Pointer(&buffer[0])), C.size_t(len(buffer)),
+            &lengths[0]))
+        if needed <= len(buffer) {
+            break
+        }
+        buffer = make([]byte, needed)
+    }
+
+    offset := 0
+    for i := range results {
+        length := int(lengths[i])
+        results[i] = string(buffer[offset:offset + length])
+        offset += length
+    }
 
-    return C.GoString(result)
+    return results
 }
 
 func IsSupportedCurrency(currencyCode string) (bool) {
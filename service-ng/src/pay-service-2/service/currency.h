@@ -22,7 +22,22 @@
 extern "C" {
 #endif
 
-char* toCurrencyString(double price, const char* symbol);
+#include <stddef.h>
+
+/* Formats count prices, each with its own currency symbol, in the
+   system locale. The symbols are passed back to back in symbols, with
+   their byte lengths in symbol_lengths. The results are written back to
+   back into buffer, without terminators, and their byte lengths into
+   lengths. Returns the size the buffer needs, if that's more than size
+   nothing useful was written and it should be called again with a
+   bigger one. Safe to call from any thread. */
+size_t formatCurrencies(const double* prices,
+                        const char* symbols,
+                        const size_t* symbol_lengths,
+                        size_t count,
+                        char* buffer,
+                        size_t size,
+                        size_t* lengths);
 
 #ifdef __cplusplus
 } // extern "C"
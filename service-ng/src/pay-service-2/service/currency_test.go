@@ -21,6 +21,7 @@ package service
 import (
     "github.com/godbus/dbus"
     "os"
+    "strings"
     "testing"
 )
 
@@ -103,3 +104,74 @@ func TestPreferredCurrencyCodeEnvironment(t *testing.T) {
             currencyCode, result)
     }
 }
+
+// The formats themselves are checked against QLocale in
+// tests/currency-format-tests.cpp, this makes sure each result comes
+// back in the place of its price whatever else is in the batch.
+func TestCurrencyStringsKeepOrder(t *testing.T) {
+    prices := []CurrencyPrice{
+        {0.99, "US$"},
+        {1234.5, "₤"},
+        {-2.0, "€"},
+        {1234567.891, "HK$"},
+        {-1234.5, "RMB"},
+        {0, "TW$"},
+    }
+    results := CurrencyStrings(prices)
+    if len(results) != len(prices) {
+        t.Fatalf("Expected %d results, got %d.", len(prices), len(results))
+    }
+    for i, price := range prices {
+        if !strings.Contains(results[i], price.Symbol) {
+            t.Errorf("Expected '%s' for %f to contain '%s'.",
+                results[i], price.Price, price.Symbol)
+        }
+    }
+
+    reversed := make([]CurrencyPrice, len(prices))
+    for i, price := range prices {
+        reversed[len(prices) - 1 - i] = price
+    }
+    for i, result := range CurrencyStrings(reversed) {
+        if result != results[len(prices) - 1 - i] {
+            t.Errorf("Expected '%s' for %f whatever the batch, got '%s'.",
+                results[len(prices) - 1 - i], reversed[i].Price, result)
+        }
+    }
+}
+
+func TestCurrencyStringsLongSymbol(t *testing.T) {
+    symbol := strings.Repeat("X", 64)
+    result := CurrencyStrings([]CurrencyPrice{{1.5, symbol}})[0]
+    if !strings.Contains(result, symbol) {
+        t.Fatalf("Expected '%s' to contain the symbol '%s'.", result, symbol)
+    }
+}
+
+func TestCurrencyStringsEmpty(t *testing.T) {
+    if len(CurrencyStrings(nil)) != 0 {
+        t.Fatalf("Expected no results for no prices.")
+    }
+}
+
+// Both report the cost of formatting one price
+func BenchmarkCurrencyString(b *testing.B) {
+    for i := 0; i < b.N; i++ {
+        CurrencyString(0.99, "US$")
+    }
+}
+
+func BenchmarkCurrencyStrings(b *testing.B) {
+    const batch = 100
+    prices := make([]CurrencyPrice, batch)
+    for i := range prices {
+        prices[i] = CurrencyPrice{float64(i) + 0.99, "US$"}
+    }
+    for done := 0; done < b.N; done += batch {
+        count := b.N - done
+        if count > batch {
+            count = batch
+        }
+        CurrencyStrings(prices[:count])
+    }
+}
@@ -21,12 +21,16 @@ package service
 import (
     "fmt"
     "github.com/godbus/dbus"
+    "sync"
 )
 
 // DbusServer satisfies the DbusWrapper interface for DBus communication within
 // the daemon.
 type DbusServer struct {
     connection *dbus.Conn // Connection to the dbus bus
+
+    watchesMutex sync.Mutex
+    watches      map[string]func(string) // Names being watched, and what to call when they go
 }
 
 // Connect simply initializes a connection to the DBus session bus
@@ -134,3 +138,90 @@ func (server *DbusServer) Emit(path dbus.ObjectPath, name string, values ...inte
 
     return server.connection.Emit(path, name, values...)
 }
+
+// WatchNameOwner calls lost once the name has no owner, straight away if it
+// has none already. Meant for unique names, which never come back.
+//
+// Parameters:
+// name: Name to watch.
+// lost: Called with the name once it's gone.
+//
+// Returns:
+// - Error (nil if none)
+func (server *DbusServer) WatchNameOwner(name string, lost func(name string)) error {
+    if server.connection == nil {
+        return fmt.Errorf("Server is not connected")
+    }
+
+    server.watchesMutex.Lock()
+    if server.watches == nil {
+        server.watches = make(map[string]func(string))
+        signals := make(chan *dbus.Signal, 10)
+        server.connection.Signal(signals)
+        go server.watchNameOwners(signals)
+    }
+    _, watched := server.watches[name]
+    server.watches[name] = lost
+    server.watchesMutex.Unlock()
+
+    if watched {
+        return nil
+    }
+
+    object := server.connection.BusObject()
+    err := object.Call("org.freedesktop.DBus.AddMatch", 0,
+        nameOwnerChangedRule(name)).Err
+    if err != nil {
+        server.watchesMutex.Lock()
+        delete(server.watches, name)
+        server.watchesMutex.Unlock()
+        return err
+    }
+
+    // It could have gone before the match was in place
+    var hasOwner bool
+    err = object.Call("org.freedesktop.DBus.NameHasOwner", 0, name).Store(&hasOwner)
+    if err == nil && !hasOwner {
+        server.nameLost(name)
+    }
+
+    return nil
+}
+
+func nameOwnerChangedRule(name string) string {
+    return "type='signal',sender='org.freedesktop.DBus'," +
+        "interface='org.freedesktop.DBus',member='NameOwnerChanged'," +
+        "arg0='" + name + "'"
+}
+
+// watchNameOwners passes on the names that lost their owner, until the
+// connection is closed.
+func (server *DbusServer) watchNameOwners(signals chan *dbus.Signal) {
+    for signal := range signals {
+        if signal.Name != "org.freedesktop.DBus.NameOwnerChanged" ||
+            len(signal.Body) != 3 {
+            continue
+        }
+
+        name, _ := signal.Body[0].(string)
+        newOwner, _ := signal.Body[2].(string)
+        if newOwner == "" {
+            server.nameLost(name)
+        }
+    }
+}
+
+func (server *DbusServer) nameLost(name string) {
+    server.watchesMutex.Lock()
+    lost, found := server.watches[name]
+    delete(server.watches, name)
+    server.watchesMutex.Unlock()
+
+    if !found {
+        return
+    }
+
+    server.connection.BusObject().Call("org.freedesktop.DBus.RemoveMatch",
+        0, nameOwnerChangedRule(name))
+    lost(name)
+}
@@ -35,6 +35,7 @@ type DbusWrapper interface {
     Export(object interface{}, path dbus.ObjectPath, iface string) error
     ExportSubtree(object interface{}, path dbus.ObjectPath, iface string) error
     Emit(path dbus.ObjectPath, name string, values ...interface{}) error
+    WatchNameOwner(name string, lost func(name string)) error
 }
 
 // EncodePath encodes a path for DBus.
@@ -40,10 +40,12 @@ type FakeDbusServer struct {
     failGetNameOwner bool
     failExport       bool
     failEmit         bool
+    failWatch        bool
 
     nameAlreadyTaken            bool
     failSpecificExportInterface string
     signals                     chan *dbus.Signal
+    watches                     map[string]func(string)
 }
 
 func (server *FakeDbusServer) InitializeSignals() {
@@ -133,6 +135,28 @@ func (server *FakeDbusServer) Emit(path dbus.ObjectPath, name string, values ...
     return nil
 }
 
+func (server *FakeDbusServer) WatchNameOwner(name string, lost func(name string)) error {
+    if server.failWatch {
+        return fmt.Errorf("Failed at user request")
+    }
+
+    if server.watches == nil {
+        server.watches = make(map[string]func(string))
+    }
+    server.watches[name] = lost
+
+    return nil
+}
+
+// loseName acts as if the name lost its owner
+func (server *FakeDbusServer) loseName(name string) {
+    lost, found := server.watches[name]
+    delete(server.watches, name)
+    if found {
+        lost(name)
+    }
+}
+
 func (server *FakeDbusServer) Stop() error {
     return nil
 }
@@ -22,10 +22,12 @@ import (
     "encoding/json"
     "fmt"
     "net/http"
+    "net/url"
     "os"
     "path"
     "reflect"
     "strconv"
+    "sync"
     "time"
 
     "github.com/godbus/dbus"
@@ -63,6 +65,13 @@ type PayService struct {
     launchPayUiFunction LaunchPayUiFunction
     tripletToAppIdFunction TripletToAppIdFunction
     getPrimaryPidFunction GetPrimaryPidFunction
+
+    // Status boards for the packages that asked for one, and the bus
+    // names of the clients reading them. We stay up while there are any,
+    // or their boards would go away under them.
+    boardsMutex  sync.Mutex
+    boards       map[string]*statusBoard
+    boardHolders map[string]bool
 }
 
 func NewPayService(dbusConnection DbusWrapper,
@@ -74,6 +83,8 @@ func NewPayService(dbusConnection DbusWrapper,
         shutdownTimer: shutdownTimer,
         client: client,
         useTrustStore: useTrustStore,
+        boards: make(map[string]*statusBoard),
+        boardHolders: make(map[string]bool),
     }
 
     if !baseObjectPath.IsValid() {
@@ -136,6 +147,7 @@ func (iface *PayService) AcknowledgeItem(message dbus.Message, itemName string)
     }
 
     details := parseItemMap(data.(map[string]interface{}))
+    iface.publishItem(packageName, details)
     return details, nil
 }
 
@@ -179,6 +191,7 @@ func (iface *PayService) GetItem(message dbus.Message, itemName string) (ItemDet
         }
     }
 
+    iface.publishItem(packageName, item)
     return item, nil
 }
 
@@ -205,11 +218,14 @@ func (iface *PayService) GetPurchasedItems(message dbus.Message) ([]ItemDetails,
             return nil, dbus.NewError(fmt.Sprintf("%s", err), nil)
         }
 
+        var pending []pendingPrice
         m := data.([]interface{})
         for index := range m {
-            details := parseItemMap(m[index].(map[string]interface{}))
+            details := parseItemMapPrices(m[index].(map[string]interface{}), &pending)
             purchasedItems = append(purchasedItems, details)
         }
+        formatPrices(pending)
+        iface.publishItems(packageName, purchasedItems)
 
         return purchasedItems, nil
     } else {
@@ -228,12 +244,13 @@ func (iface *PayService) GetPurchasedItems(message dbus.Message) ([]ItemDetails,
 
         m := data.(map[string]interface{})["_embedded"].(map[string]interface{})
         q := m["purchase"].([]interface{})
+        var pending []pendingPrice
         for purchase := range q {
             purchaseMap := q[purchase].(map[string]interface{})
             itemMap := purchaseMap["_embedded"].(
                 map[string]interface{})["item"].(map[string]interface{})
 
-            details := parseItemMap(itemMap)
+            details := parseItemMapPrices(itemMap, &pending)
 
             details["requested_device"] = dbus.MakeVariant(
                 purchaseMap["requested_device"])
@@ -243,6 +260,8 @@ func (iface *PayService) GetPurchasedItems(message dbus.Message) ([]ItemDetails,
             // FIXME: parse timestamps and add them here too
             purchasedItems = append(purchasedItems, details)
         }
+        formatPrices(pending)
+        iface.publishItems(packageName, purchasedItems)
 
         return purchasedItems, nil
     }
@@ -252,10 +271,28 @@ func (iface *PayService) GetPurchasedItems(message dbus.Message) ([]ItemDetails,
 }
 
 func (iface *PayService) PurchaseItem(message dbus.Message, itemName string) (ItemDetails, *dbus.Error) {
+    return iface.purchaseItem(message, itemName, "")
+}
+
+// PurchaseItemWithMetadata is PurchaseItem with extra information about the
+// call, currently the ID of the trace the purchase is part of.
+func (iface *PayService) PurchaseItemWithMetadata(message dbus.Message, itemName string, metadata map[string]dbus.Variant) (ItemDetails, *dbus.Error) {
+    traceId := ""
+    if value, ok := metadata[traceIdKey]; ok {
+        traceId, _ = value.Value().(string)
+    }
+
+    return iface.purchaseItem(message, itemName, traceId)
+}
+
+func (iface *PayService) purchaseItem(message dbus.Message, itemName string, traceId string) (ItemDetails, *dbus.Error) {
     iface.pauseTimer()
     defer iface.resetTimer()
     packageName := packageNameFromPath(message)
 
+    serviceSpan := startSpan(traceId, "service.purchase")
+    defer serviceSpan.end()
+
     if iface.useTrustStore && packageName != "click-scope"{
         err := iface.authorizePurchaseItem(packageName)
         if err != nil {
@@ -272,14 +309,21 @@ func (iface *PayService) PurchaseItem(message dbus.Message, itemName string) (It
     }
     purchaseUrl += itemName
 
+    // Pay UI carries on with the trace
+    if traceId != "" {
+        purchaseUrl += "?" + traceIdKey + "=" + url.QueryEscape(traceId)
+    }
+
     // Launch the Pay UI to handle this purchase (e.g. get credit card info,
     // etc.)
+    payUiSpan := startSpan(traceId, "service.pay-ui")
     feedback := iface.launchPayUiFunction(packageName, purchaseUrl)
 
     // Sit here and wait for Pay UI to close. The feedback consists of two
     // channels-- Finished and Error. Finished is always closed, so we'll
     // wait for that before we check for errors (the errors are buffered).
     <-feedback.Finished
+    payUiSpan.end()
 
     // Now check to see if any errors occured
     err := <-feedback.Error
@@ -291,6 +335,8 @@ func (iface *PayService) PurchaseItem(message dbus.Message, itemName string) (It
     // Pay UI has been closed without error, but we don't know if the user
     // actually made the purchase or just canceled, so we'll verify with
     // GetItem():
+    verifySpan := startSpan(traceId, "service.verify")
+    defer verifySpan.end()
     return iface.GetItem(message, itemName)
 }
 
@@ -321,11 +367,132 @@ func (iface *PayService) RefundItem(message dbus.Message, itemName string) (Item
     return iface.GetItem(message, itemName)
 }
 
+// Gives the caller a read only descriptor for the package's status board,
+// where it can look up the items we've seen without calling us
+func (iface *PayService) GetStatusBoard(message dbus.Message) (dbus.UnixFD, *dbus.Error) {
+    iface.pauseTimer()
+    defer iface.resetTimer()
+
+    packageName := packageNameFromPath(message)
+
+    board, err := iface.packageBoard(packageName)
+    if err != nil {
+        return 0, dbus.NewError(fmt.Sprintf("%s", err), nil)
+    }
+
+    iface.holdBoard(message)
+    return board.fd(), nil
+}
+
+func (iface *PayService) packageBoard(packageName string) (*statusBoard, error) {
+    iface.boardsMutex.Lock()
+    defer iface.boardsMutex.Unlock()
+
+    board, found := iface.boards[packageName]
+    if !found {
+        var err error
+        board, err = newStatusBoard("pay-status-" + packageName)
+        if err != nil {
+            return nil, err
+        }
+        iface.boards[packageName] = board
+    }
+
+    return board, nil
+}
+
+// Keeps us running until the caller leaves the bus
+func (iface *PayService) holdBoard(message dbus.Message) {
+    sender, ok := message.Headers[dbus.FieldSender].Value().(string)
+    if !ok || sender == "" {
+        return
+    }
+
+    iface.boardsMutex.Lock()
+    held := iface.boardHolders[sender]
+    iface.boardHolders[sender] = true
+    iface.boardsMutex.Unlock()
+
+    if held {
+        return
+    }
+
+    // If we can't tell when it's gone, we can't wait for it either
+    err := iface.dbusConnection.WatchNameOwner(sender, iface.boardReleased)
+    if err != nil {
+        fmt.Fprintf(os.Stderr,
+            "Unable to watch status board reader %s: %s\n", sender, err)
+        iface.boardsMutex.Lock()
+        delete(iface.boardHolders, sender)
+        iface.boardsMutex.Unlock()
+    }
+}
+
+func (iface *PayService) boardReleased(sender string) {
+    iface.boardsMutex.Lock()
+    delete(iface.boardHolders, sender)
+    iface.boardsMutex.Unlock()
+
+    iface.resetTimer()
+}
+
+func (iface *PayService) boardsHeld() bool {
+    iface.boardsMutex.Lock()
+    defer iface.boardsMutex.Unlock()
+
+    return len(iface.boardHolders) > 0
+}
+
+func (iface *PayService) statusBoard(packageName string) *statusBoard {
+    iface.boardsMutex.Lock()
+    defer iface.boardsMutex.Unlock()
+
+    return iface.boards[packageName]
+}
+
+// Puts what we know about the item up on the package's board, if anyone
+// is reading it
+func (iface *PayService) publishItem(packageName string, item ItemDetails) {
+    board := iface.statusBoard(packageName)
+    if board == nil {
+        return
+    }
+
+    sku, skuOk := item["sku"].Value().(string)
+    state, stateOk := item["state"].Value().(string)
+    if !skuOk || !stateOk {
+        return
+    }
+
+    refundableUntil, _ := item["refundable_until"].Value().(uint64)
+    board.publish(sku, boardState(state), refundableUntil)
+}
+
+func (iface *PayService) publishItems(packageName string, items []ItemDetails) {
+    for _, item := range items {
+        iface.publishItem(packageName, item)
+    }
+}
+
+// Closes all the boards, the clients go back to asking us
+func (iface *PayService) closeStatusBoards() {
+    iface.boardsMutex.Lock()
+    defer iface.boardsMutex.Unlock()
+
+    for packageName, board := range iface.boards {
+        board.close()
+        delete(iface.boards, packageName)
+    }
+}
+
 func (iface *PayService) pauseTimer() bool {
     return iface.shutdownTimer.Stop()
 }
 
 func (iface *PayService) resetTimer() bool {
+    if iface.boardsHeld() {
+        return false
+    }
     return iface.shutdownTimer.Reset(ShutdownTimeout)
 }
 
@@ -378,7 +545,33 @@ func (iface *PayService) getDataForUrl(iri string, method string, headers http.H
     return data, nil
 }
 
+// An item whose "price" is waiting to be formatted
+type pendingPrice struct {
+    details ItemDetails
+    price   CurrencyPrice
+}
+
+// Formats the prices of all the items together, which costs a lot less
+// than doing them one at a time.
+func formatPrices(pending []pendingPrice) {
+    prices := make([]CurrencyPrice, len(pending))
+    for i := range pending {
+        prices[i] = pending[i].price
+    }
+    for i, formatted := range CurrencyStrings(prices) {
+        pending[i].details["price"] = dbus.MakeVariant(formatted)
+    }
+}
+
 func parseItemMap(itemMap map[string]interface{}) (ItemDetails) {
+    var pending []pendingPrice
+    details := parseItemMapPrices(itemMap, &pending)
+    formatPrices(pending)
+    return details
+}
+
+// Like parseItemMap, but leaves formatting the prices to formatPrices
+func parseItemMapPrices(itemMap map[string]interface{}, pending *[]pendingPrice) (ItemDetails) {
     details := make(ItemDetails)
     for k, v := range itemMap {
         switch vv := v.(type) {
@@ -392,7 +585,7 @@ func parseItemMap(itemMap map[string]interface{}) (ItemDetails) {
                 details[k] = dbus.MakeVariant(vv)
             }
         case map[string]interface{}:
-            details[k] = dbus.MakeVariant(parseItemMap(vv))
+            details[k] = dbus.MakeVariant(parseItemMapPrices(vv, pending))
             // Get and set the "price" key too.
             if k == "prices" {
                 // FIXME: Need to get a suggested currency from server.
@@ -407,15 +600,15 @@ func parseItemMap(itemMap map[string]interface{}) (ItemDetails) {
                         "ERROR - Failed to parse price '%s': %s",
                         priceString, parseErr)
                 } else {
-                    details["price"] = dbus.MakeVariant(
-                        CurrencyString(price, currencySymbol))
+                    *pending = append(*pending, pendingPrice{details,
+                        CurrencyPrice{price, currencySymbol}})
                 }
             }
         case []interface{}:
             var list []dbus.Variant
             for idx := range vv {
                 value := vv[idx].(map[string]interface{})
-                list = append(list, dbus.MakeVariant(parseItemMap(value)))
+                list = append(list, dbus.MakeVariant(parseItemMapPrices(value, pending)))
             }
             details[k] = dbus.MakeVariant(list)
         case nil:
@@ -561,6 +561,62 @@ func TestPurchaseItem(t *testing.T) {
     }
 }
 
+func TestPurchaseItemWithMetadata(t *testing.T) {
+    dbusServer := new(FakeDbusServer)
+    dbusServer.InitializeSignals()
+    timer := NewFakeTimer(ShutdownTimeout)
+    client := new(FakeWebClient)
+
+    payiface, err := NewPayService(dbusServer, "foo", "/foo", timer, client, false)
+    if err != nil {
+        t.Fatalf("Unexpected error while creating pay service: %s", err)
+    }
+
+    if payiface == nil {
+        t.Fatalf("Pay service not created.")
+    }
+
+    // Setup fake pay-ui launcher
+    launchUrl := ""
+    payiface.launchPayUiFunction = func(appId string, purchaseUrl string) PayUiFeedback {
+        launchUrl = purchaseUrl
+        feedback := PayUiFeedback{
+            Finished: make(chan struct{}),
+            Error: make(chan error, 1),
+        }
+
+        // Finished
+        close(feedback.Error)
+        close(feedback.Finished)
+
+        return feedback
+    }
+
+    var m dbus.Message
+    m.Headers = make(map[dbus.HeaderField]dbus.Variant)
+    m.Headers[dbus.FieldPath] = dbus.MakeVariant("/com/canonical/pay/store/foo_2Eexample")
+    metadata := map[string]dbus.Variant{
+        "trace_id": dbus.MakeVariant("0123456789abcdef0123456789abcdef"),
+    }
+    _, dbusErr := payiface.PurchaseItemWithMetadata(m, "consumable", metadata)
+    if dbusErr != nil {
+        t.Errorf("Unexpected error when purchasing item: %s", dbusErr)
+    }
+
+    expected := "purchase://foo.example/consumable?trace_id=0123456789abcdef0123456789abcdef"
+    if launchUrl != expected {
+        t.Errorf(`Pay UI launched with "%s", expected "%s"`, launchUrl, expected)
+    }
+
+    if !timer.stopCalled {
+        t.Errorf("Timer was not stopped.")
+    }
+
+    if !timer.resetCalled {
+        t.Errorf("Timer was not reset.")
+    }
+}
+
 func TestPurchaseItem_payUiError(t *testing.T) {
     dbusServer := new(FakeDbusServer)
     dbusServer.InitializeSignals()
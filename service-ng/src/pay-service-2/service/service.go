@@ -43,7 +43,8 @@ const (
         introspect.IntrospectDataString +
         `</node>`
 
-    // shutdownTimeout is the amount of time we exit after last called
+    // shutdownTimeout is the amount of time we exit after last called,
+    // once no client is reading a status board
     ShutdownTimeout = time.Duration(30) * time.Second
 )
 
@@ -116,5 +117,6 @@ func (service *Service) Run() error {
 }
 
 func (service *Service) Shutdown() error {
+    service.payiface.closeStatusBoards()
     return service.server.Stop()
 }
@@ -0,0 +1,268 @@
+/* -*- mode: go; tab-width: 4; indent-tabs-mode: nil -*- */
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+package service
+
+// #include <errno.h>
+// #include <stdlib.h>
+// #include <sys/syscall.h>
+// #include <unistd.h>
+//
+// static int memfdCreate(const char* name) {
+// #ifdef SYS_memfd_create
+//     /* MFD_CLOEXEC | MFD_ALLOW_SEALING */
+//     return syscall(SYS_memfd_create, name, 0x0001U | 0x0002U);
+// #else
+//     errno = ENOSYS;
+//     return -1;
+// #endif
+// }
+import "C"
+
+import (
+    "fmt"
+    "hash/fnv"
+    "io/ioutil"
+    "os"
+    "sync"
+    "sync/atomic"
+    "syscall"
+    "unsafe"
+
+    "github.com/godbus/dbus"
+)
+
+// The status board is a table of the item states we know for a package,
+// in shared memory that the clients map read only. libpay's
+// internal/status-board.cpp reads it, the two need to agree on all of
+// the layout below.
+const (
+    statusBoardMagic    = 0x50415942 // "PAYB"
+    statusBoardVersion  = 1
+    statusBoardHeader   = 64
+    statusBoardSlots    = 256 // must be a power of two
+    statusBoardSlotSize = 256
+    statusBoardSize     = statusBoardHeader + statusBoardSlots*statusBoardSlotSize
+    statusBoardMaxSku   = statusBoardSlotSize - slotSku
+
+    // Header fields, all uint32
+    headerMagic    = 0
+    headerVersion  = 4
+    headerSlots    = 8
+    headerSlotSize = 12
+    headerClosed   = 16
+
+    // Slot fields. The sequence number is odd while the slot is being
+    // written, readers retry until they see the same even one on both
+    // sides of their read.
+    slotSeq        = 0  // uint32
+    slotState      = 4  // uint32
+    slotRefundable = 8  // uint64
+    slotHash       = 16 // uint64, zero for an empty slot
+    slotSkuLen     = 24 // uint32
+    slotSku        = 32 // the sku bytes, not terminated
+)
+
+const (
+    boardStateUnknown = iota
+    boardStatePurchased
+    boardStateApproved
+    boardStateNotPurchased
+)
+
+const (
+    fcntlAddSeals   = 1033 // F_ADD_SEALS
+    fcntlSealShrink = 0x0002
+    fcntlSealGrow   = 0x0004
+)
+
+type statusBoard struct {
+    mutex    sync.Mutex
+    file     *os.File
+    readOnly *os.File
+    data     []byte
+    slots    map[string]int
+}
+
+func newStatusBoard(name string) (*statusBoard, error) {
+    file, err := createBoardFile(name)
+    if err != nil {
+        return nil, err
+    }
+
+    err = file.Truncate(statusBoardSize)
+    if err != nil {
+        file.Close()
+        return nil, fmt.Errorf("Unable to size status board: %s", err)
+    }
+
+    // The clients have it mapped, it can't change size under them. The
+    // fallback file can't be sealed, but nobody else can open it either.
+    syscall.Syscall(syscall.SYS_FCNTL, file.Fd(), fcntlAddSeals,
+        fcntlSealShrink|fcntlSealGrow)
+
+    // Opening it again read only gives the clients a descriptor they
+    // can't write through, or map for writing
+    readOnly, err := os.OpenFile(fmt.Sprintf("/proc/self/fd/%d", file.Fd()),
+        os.O_RDONLY, 0)
+    if err != nil {
+        file.Close()
+        return nil, fmt.Errorf("Unable to open status board read only: %s", err)
+    }
+
+    data, err := syscall.Mmap(int(file.Fd()), 0, statusBoardSize,
+        syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+    if err != nil {
+        readOnly.Close()
+        file.Close()
+        return nil, fmt.Errorf("Unable to map status board: %s", err)
+    }
+
+    board := &statusBoard{
+        file: file,
+        readOnly: readOnly,
+        data: data,
+        slots: make(map[string]int),
+    }
+    atomic.StoreUint32(board.uint32At(headerVersion), statusBoardVersion)
+    atomic.StoreUint32(board.uint32At(headerSlots), statusBoardSlots)
+    atomic.StoreUint32(board.uint32At(headerSlotSize), statusBoardSlotSize)
+    atomic.StoreUint32(board.uint32At(headerMagic), statusBoardMagic)
+
+    return board, nil
+}
+
+func createBoardFile(name string) (*os.File, error) {
+    cname := C.CString(name)
+    defer C.free(unsafe.Pointer(cname))
+
+    fd, err := C.memfdCreate(cname)
+    if fd >= 0 {
+        return os.NewFile(uintptr(fd), name), nil
+    }
+
+    // Kernels before 3.17 don't have memfd, a file that's gone from the
+    // file system as soon as it's made does the same job
+    dir := os.Getenv("XDG_RUNTIME_DIR")
+    if dir == "" {
+        dir = os.TempDir()
+    }
+    file, fileErr := ioutil.TempFile(dir, "pay-status-")
+    if fileErr != nil {
+        return nil, fmt.Errorf("Unable to create status board: %s, %s",
+            err, fileErr)
+    }
+    os.Remove(file.Name())
+
+    return file, nil
+}
+
+func (board *statusBoard) uint32At(offset int) *uint32 {
+    return (*uint32)(unsafe.Pointer(&board.data[offset]))
+}
+
+func (board *statusBoard) uint64At(offset int) *uint64 {
+    return (*uint64)(unsafe.Pointer(&board.data[offset]))
+}
+
+// The descriptor to hand to the clients, it stays ours
+func (board *statusBoard) fd() dbus.UnixFD {
+    return dbus.UnixFD(board.readOnly.Fd())
+}
+
+func skuHash(sku string) uint64 {
+    hash := fnv.New64a()
+    hash.Write([]byte(sku))
+    value := hash.Sum64()
+    if value == 0 {
+        // Zero marks an empty slot
+        value = 1
+    }
+    return value
+}
+
+// Puts the state of an item up on the board. Returns false when it can't
+// go there, the clients ask us over the bus about those.
+func (board *statusBoard) publish(sku string, state uint32, refundableUntil uint64) bool {
+    if len(sku) == 0 || len(sku) > statusBoardMaxSku {
+        return false
+    }
+
+    board.mutex.Lock()
+    defer board.mutex.Unlock()
+
+    if board.data == nil {
+        return false
+    }
+
+    hash := skuHash(sku)
+    index, found := board.slots[sku]
+    if !found {
+        if len(board.slots) == statusBoardSlots {
+            return false
+        }
+        // Slots are never emptied, so the readers' probes always end at
+        // the same place ours does
+        index = int(hash & (statusBoardSlots - 1))
+        for *board.uint64At(statusBoardHeader + index*statusBoardSlotSize + slotHash) != 0 {
+            index = (index + 1) & (statusBoardSlots - 1)
+        }
+        board.slots[sku] = index
+    }
+
+    slot := statusBoardHeader + index*statusBoardSlotSize
+    seq := board.uint32At(slot + slotSeq)
+    current := atomic.LoadUint32(seq)
+
+    atomic.StoreUint32(seq, current+1)
+    atomic.StoreUint32(board.uint32At(slot+slotState), state)
+    atomic.StoreUint64(board.uint64At(slot+slotRefundable), refundableUntil)
+    atomic.StoreUint32(board.uint32At(slot+slotSkuLen), uint32(len(sku)))
+    copy(board.data[slot+slotSku:slot+statusBoardSlotSize], sku)
+    atomic.StoreUint64(board.uint64At(slot+slotHash), hash)
+    atomic.StoreUint32(seq, current+2)
+
+    return true
+}
+
+// Tells the clients to stop trusting the board and lets go of it. Their
+// mappings stay valid after we're gone.
+func (board *statusBoard) close() {
+    board.mutex.Lock()
+    defer board.mutex.Unlock()
+
+    if board.data == nil {
+        return
+    }
+
+    atomic.StoreUint32(board.uint32At(headerClosed), 1)
+    syscall.Munmap(board.data)
+    board.data = nil
+    board.readOnly.Close()
+    board.file.Close()
+}
+
+func boardState(state string) uint32 {
+    switch state {
+    case "purchased":
+        return boardStatePurchased
+    case "approved":
+        return boardStateApproved
+    }
+    return boardStateNotPurchased
+}
@@ -0,0 +1,270 @@
+/* -*- mode: go; tab-width: 4; indent-tabs-mode: nil -*- */
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+package service
+
+import (
+    "encoding/binary"
+    "fmt"
+    "strings"
+    "syscall"
+    "testing"
+
+    "github.com/godbus/dbus"
+)
+
+// Maps the board the way a client would, through the descriptor it gets
+func mapBoard(t *testing.T, board *statusBoard) []byte {
+    data, err := syscall.Mmap(int(board.fd()), 0, statusBoardSize,
+        syscall.PROT_READ, syscall.MAP_SHARED)
+    if err != nil {
+        t.Fatalf("Unable to map status board: %s", err)
+    }
+    return data
+}
+
+// Finds an item the way libpay does, without the retries
+func lookupBoard(data []byte, sku string) (uint32, uint64, bool) {
+    hash := skuHash(sku)
+    index := int(hash & (statusBoardSlots - 1))
+    for probe := 0; probe < statusBoardSlots; probe++ {
+        slot := data[statusBoardHeader+index*statusBoardSlotSize:]
+        stored := binary.LittleEndian.Uint64(slot[slotHash:])
+        if stored == 0 {
+            return 0, 0, false
+        }
+        length := binary.LittleEndian.Uint32(slot[slotSkuLen:])
+        if stored == hash && string(slot[slotSku:slotSku+int(length)]) == sku {
+            return binary.LittleEndian.Uint32(slot[slotState:]),
+                binary.LittleEndian.Uint64(slot[slotRefundable:]), true
+        }
+        index = (index + 1) & (statusBoardSlots - 1)
+    }
+    return 0, 0, false
+}
+
+func TestStatusBoardPublish(t *testing.T) {
+    board, err := newStatusBoard("test")
+    if err != nil {
+        t.Fatalf("Unexpected error creating status board: %s", err)
+    }
+    defer board.close()
+
+    data := mapBoard(t, board)
+    defer syscall.Munmap(data)
+
+    if binary.LittleEndian.Uint32(data[headerMagic:]) != statusBoardMagic {
+        t.Errorf("Status board header not written.")
+    }
+
+    if !board.publish("unlockable", boardStatePurchased, 1234) {
+        t.Errorf("Unable to publish item.")
+    }
+    if !board.publish("consumable", boardStateNotPurchased, 0) {
+        t.Errorf("Unable to publish item.")
+    }
+
+    state, refundable, found := lookupBoard(data, "unlockable")
+    if !found || state != boardStatePurchased || refundable != 1234 {
+        t.Errorf("Unexpected item on the board: %d, %d, %t",
+            state, refundable, found)
+    }
+
+    // Updating an item uses the same slot
+    board.publish("unlockable", boardStateNotPurchased, 0)
+    state, _, found = lookupBoard(data, "unlockable")
+    if !found || state != boardStateNotPurchased {
+        t.Errorf("Item not updated on the board: %d, %t", state, found)
+    }
+    if len(board.slots) != 2 {
+        t.Errorf("Expected 2 slots in use, got %d", len(board.slots))
+    }
+
+    if _, _, found = lookupBoard(data, "missing"); found {
+        t.Errorf("Found an item that wasn't published.")
+    }
+
+    if board.publish(strings.Repeat("x", statusBoardMaxSku+1), boardStatePurchased, 0) {
+        t.Errorf("Published a sku too long for the board.")
+    }
+}
+
+func TestStatusBoardFull(t *testing.T) {
+    board, err := newStatusBoard("test")
+    if err != nil {
+        t.Fatalf("Unexpected error creating status board: %s", err)
+    }
+    defer board.close()
+
+    for i := 0; i < statusBoardSlots; i++ {
+        if !board.publish(fmt.Sprintf("item-%d", i), boardStatePurchased, 0) {
+            t.Fatalf("Unable to publish item %d.", i)
+        }
+    }
+
+    if board.publish("one too many", boardStatePurchased, 0) {
+        t.Errorf("Published an item on a full board.")
+    }
+}
+
+func TestStatusBoardClose(t *testing.T) {
+    board, err := newStatusBoard("test")
+    if err != nil {
+        t.Fatalf("Unexpected error creating status board: %s", err)
+    }
+
+    data := mapBoard(t, board)
+    defer syscall.Munmap(data)
+
+    board.close()
+
+    if binary.LittleEndian.Uint32(data[headerClosed:]) != 1 {
+        t.Errorf("Status board not marked closed.")
+    }
+
+    if board.publish("unlockable", boardStatePurchased, 0) {
+        t.Errorf("Published an item on a closed board.")
+    }
+}
+
+func TestGetStatusBoard(t *testing.T) {
+    dbusServer := new(FakeDbusServer)
+    dbusServer.InitializeSignals()
+    timer := NewFakeTimer(ShutdownTimeout)
+    client := new(FakeWebClient)
+
+    payiface, err := NewPayService(dbusServer, "foo", "/foo", timer, client, false)
+    if err != nil {
+        t.Fatalf("Unexpected error while creating pay service: %s", err)
+    }
+    defer payiface.closeStatusBoards()
+
+    var m dbus.Message
+    m.Headers = make(map[dbus.HeaderField]dbus.Variant)
+    m.Headers[dbus.FieldPath] = dbus.MakeVariant("/com/canonical/pay/store/foo_2Eexample")
+
+    fd, dbusErr := payiface.GetStatusBoard(m)
+    if dbusErr != nil {
+        t.Fatalf("Unexpected error: %s", dbusErr)
+    }
+
+    _, dbusErr = payiface.GetItem(m, "unlockable")
+    if dbusErr != nil {
+        t.Fatalf("Unexpected error: %s", dbusErr)
+    }
+
+    data, mapErr := syscall.Mmap(int(fd), 0, statusBoardSize,
+        syscall.PROT_READ, syscall.MAP_SHARED)
+    if mapErr != nil {
+        t.Fatalf("Unable to map status board: %s", mapErr)
+    }
+    defer syscall.Munmap(data)
+
+    state, _, found := lookupBoard(data, "unlockable")
+    if !found || state != boardStateApproved {
+        t.Errorf("Item not published by GetItem: %d, %t", state, found)
+    }
+
+    again, _ := payiface.GetStatusBoard(m)
+    if again != fd {
+        t.Errorf("Expected the same board for the same package.")
+    }
+
+    if !timer.stopCalled {
+        t.Errorf("Timer was not stopped.")
+    }
+
+    if !timer.resetCalled {
+        t.Errorf("Timer was not reset.")
+    }
+}
+
+func TestGetStatusBoardKeepsServiceRunning(t *testing.T) {
+    dbusServer := new(FakeDbusServer)
+    dbusServer.InitializeSignals()
+    timer := NewFakeTimer(ShutdownTimeout)
+    client := new(FakeWebClient)
+
+    payiface, err := NewPayService(dbusServer, "foo", "/foo", timer, client, false)
+    if err != nil {
+        t.Fatalf("Unexpected error while creating pay service: %s", err)
+    }
+    defer payiface.closeStatusBoards()
+
+    var m dbus.Message
+    m.Headers = make(map[dbus.HeaderField]dbus.Variant)
+    m.Headers[dbus.FieldPath] = dbus.MakeVariant("/com/canonical/pay/store/foo_2Eexample")
+    m.Headers[dbus.FieldSender] = dbus.MakeVariant(":1.7")
+
+    _, dbusErr := payiface.GetStatusBoard(m)
+    if dbusErr != nil {
+        t.Fatalf("Unexpected error: %s", dbusErr)
+    }
+    payiface.GetStatusBoard(m)
+
+    if !timer.stopCalled {
+        t.Errorf("Timer was not stopped.")
+    }
+
+    if timer.resetCalled {
+        t.Errorf("Timer was reset while a client has the board.")
+    }
+
+    _, dbusErr = payiface.GetItem(m, "unlockable")
+    if dbusErr != nil {
+        t.Fatalf("Unexpected error: %s", dbusErr)
+    }
+
+    if timer.resetCalled {
+        t.Errorf("Timer was reset while a client has the board.")
+    }
+
+    dbusServer.loseName(":1.7")
+
+    if !timer.resetCalled {
+        t.Errorf("Timer was not reset once the client left.")
+    }
+}
+
+func TestGetStatusBoardUnwatchedClient(t *testing.T) {
+    dbusServer := new(FakeDbusServer)
+    dbusServer.InitializeSignals()
+    dbusServer.failWatch = true
+    timer := NewFakeTimer(ShutdownTimeout)
+    client := new(FakeWebClient)
+
+    payiface, err := NewPayService(dbusServer, "foo", "/foo", timer, client, false)
+    if err != nil {
+        t.Fatalf("Unexpected error while creating pay service: %s", err)
+    }
+    defer payiface.closeStatusBoards()
+
+    var m dbus.Message
+    m.Headers = make(map[dbus.HeaderField]dbus.Variant)
+    m.Headers[dbus.FieldPath] = dbus.MakeVariant("/com/canonical/pay/store/foo_2Eexample")
+    m.Headers[dbus.FieldSender] = dbus.MakeVariant(":1.7")
+
+    _, dbusErr := payiface.GetStatusBoard(m)
+    if dbusErr != nil {
+        t.Fatalf("Unexpected error: %s", dbusErr)
+    }
+
+    if !timer.resetCalled {
+        t.Errorf("Timer was not reset for a client we can't watch.")
+    }
+}
@@ -0,0 +1,119 @@
+/* -*- mode: go; tab-width: 4; indent-tabs-mode: nil -*- */
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+package service
+
+import (
+    "encoding/json"
+    "fmt"
+    "os"
+    "path"
+    "sync"
+    "time"
+)
+
+// traceIdKey is the name of the trace ID in D-Bus metadata and URL queries.
+const traceIdKey = "trace_id"
+
+// traceEvent is a Chrome trace "complete" event, the same as the ones
+// written by the C++ side (common/trace.cpp).
+type traceEvent struct {
+    Name     string            `json:"name"`
+    Category string            `json:"cat"`
+    Phase    string            `json:"ph"`
+    Start    int64             `json:"ts"`
+    Duration int64             `json:"dur"`
+    Pid      int               `json:"pid"`
+    Tid      int               `json:"tid"`
+    Args     map[string]string `json:"args"`
+}
+
+var (
+    traceOnce  sync.Once
+    traceMutex sync.Mutex
+    traceFile  *os.File
+)
+
+// openTraceFile starts this process' trace file in PAY_TRACE_DIR. It holds
+// one event per line, like the C++ side's, see common/trace.h for putting
+// them together.
+func openTraceFile() {
+    dir := os.Getenv("PAY_TRACE_DIR")
+    if dir == "" {
+        return
+    }
+
+    file, err := os.Create(path.Join(dir,
+        fmt.Sprintf("pay-trace-%d.jsonl", os.Getpid())))
+    if err != nil {
+        return
+    }
+
+    traceFile = file
+}
+
+// recordSpan writes a finished span of the given trace, if tracing is on.
+// Calls that didn't come with a trace ID aren't traced.
+func recordSpan(traceId string, name string, start time.Time, end time.Time) {
+    if traceId == "" {
+        return
+    }
+
+    traceOnce.Do(openTraceFile)
+    if traceFile == nil {
+        return
+    }
+
+    event, err := json.Marshal(traceEvent{
+        Name:     name,
+        Category: "pay",
+        Phase:    "X",
+        Start:    start.UnixNano() / 1000,
+        Duration: end.Sub(start).Nanoseconds() / 1000,
+        Pid:      os.Getpid(),
+        Args:     map[string]string{traceIdKey: traceId},
+    })
+    if err != nil {
+        return
+    }
+
+    traceMutex.Lock()
+    defer traceMutex.Unlock()
+    traceFile.Write(append(event, '\n'))
+}
+
+// span is a started span that gets recorded when ended.
+type span struct {
+    traceId string
+    name    string
+    start   time.Time
+    ended   bool
+}
+
+func startSpan(traceId string, name string) *span {
+    return &span{traceId: traceId, name: name, start: time.Now()}
+}
+
+func (s *span) end() {
+    if s.ended {
+        return
+    }
+    s.ended = true
+
+    recordSpan(s.traceId, s.name, s.start, time.Now())
+}
@@ -31,6 +31,10 @@ import (
 type WebClient struct {
     client *http.Client
     auth    AuthIface
+
+    // Looked up once in the background, closed when deviceId is set
+    deviceIdReady chan struct{}
+    deviceId      string
 }
 
 func NewWebClient(auth AuthIface) *WebClient {
@@ -40,6 +44,9 @@ func NewWebClient(auth AuthIface) *WebClient {
     // FIXME: Need to add redirect handler to re-sign new URLs
     client.client = http.DefaultClient
 
+    client.deviceIdReady = make(chan struct{})
+    go client.lookupDeviceId()
+
     return client
 }
 
@@ -86,11 +93,20 @@ func (client *WebClient) Call(iri string, method string,
     return string(body), nil
 }
 
+// The device ID doesn't change while we run, so only the first call
+// waits for the system bus, and only if the lookup hasn't finished yet.
 func (client *WebClient) GetDeviceId() (string) {
+    <-client.deviceIdReady
+    return client.deviceId
+}
+
+func (client *WebClient) lookupDeviceId() {
+    defer close(client.deviceIdReady)
+
     conn, err := dbus.SystemBus()
     if err != nil {
         fmt.Fprintln(os.Stderr, "ERROR - Failed to get device ID:", err)
-        return ""
+        return
     }
 
     var deviceId string
@@ -100,7 +116,7 @@ func (client *WebClient) GetDeviceId() (string) {
             0).Store(&deviceId)
     if err != nil {
         fmt.Fprintln(os.Stderr, "ERROR - Failed to get device ID:", err)
-        return ""
+        return
     }
-    return deviceId
+    client.deviceId = deviceId
 }
@@ -245,6 +245,8 @@ def main_add_store(mock, package_name, items):
          'ret = self.get_purchased_items(self)'),
         ('PurchaseItem', 's', 'a{sv}',
          'ret = self.purchase_item(self, args[0])'),
+        ('PurchaseItemWithMetadata', 'sa{sv}', 'a{sv}',
+         'ret = self.purchase_item(self, args[0])'),
         ('RefundItem', 's', 'a{sv}',
          'ret = self.refund_item(self, args[0])'),
         ('AcknowledgeItem', 's', 'a{sv}',
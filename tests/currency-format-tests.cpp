@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <service-ng/src/pay-service-2/service/currency.h>
+
+#include <gtest/gtest.h>
+
+#include <QLocale>
+#include <QString>
+
+#include <string>
+#include <vector>
+
+struct CurrencyFormatTests: public ::testing::Test
+{
+    static void SetUpTestCase()
+    {
+        /* Groups thousands and puts the symbol after the amount, the
+           formats are cached from the first call on */
+        QLocale::setDefault(QLocale(QLocale::German, QLocale::Germany));
+    }
+
+    /* What the service did before it cached the formats */
+    static std::string expected(double price, const std::string& symbol)
+    {
+        return QLocale().toCurrencyString(price, QString::fromStdString(symbol)).toStdString();
+    }
+
+    static std::vector<std::string> format(const std::vector<double>& prices,
+                                           const std::vector<std::string>& symbols)
+    {
+        std::string joined;
+        std::vector<size_t> symbolLengths;
+        for (const auto& symbol : symbols)
+        {
+            joined += symbol;
+            symbolLengths.push_back(symbol.size());
+        }
+
+        std::vector<size_t> lengths(prices.size());
+        std::vector<char> buffer(1);
+        size_t needed = formatCurrencies(prices.data(), joined.c_str(), symbolLengths.data(), prices.size(),
+                                         buffer.data(), buffer.size(), lengths.data());
+        EXPECT_GT(needed, buffer.size());
+
+        buffer.resize(needed);
+        EXPECT_EQ(needed, formatCurrencies(prices.data(), joined.c_str(), symbolLengths.data(), prices.size(),
+                                           buffer.data(), buffer.size(), lengths.data()));
+
+        std::vector<std::string> results;
+        size_t offset = 0;
+        for (auto length : lengths)
+        {
+            results.emplace_back(buffer.data() + offset, length);
+            offset += length;
+        }
+        return results;
+    }
+};
+
+TEST_F(CurrencyFormatTests, MatchesToCurrencyString)
+{
+    const std::vector<double> prices{0.99, 0, 1.5, 1234.5, 1234567.891, -2, -0.99, -1234.5, -7654321.25};
+    const std::vector<std::string> symbols{"US$", "€", "₤", "RMB", "HK$", ""};
+
+    for (const auto& symbol : symbols)
+    {
+        auto results = format(prices, std::vector<std::string>(prices.size(), symbol));
+        ASSERT_EQ(prices.size(), results.size());
+
+        for (size_t i = 0; i < prices.size(); i++)
+        {
+            EXPECT_EQ(expected(prices[i], symbol), results[i]) << prices[i] << " in '" << symbol << "'";
+        }
+    }
+}
+
+TEST_F(CurrencyFormatTests, MixedSymbols)
+{
+    const std::vector<double> prices{1234.5, -0.99, 18.05, -1234567.5};
+    const std::vector<std::string> symbols{"€", "US$", "ARS", "TW$"};
+
+    auto results = format(prices, symbols);
+    ASSERT_EQ(prices.size(), results.size());
+
+    for (size_t i = 0; i < prices.size(); i++)
+    {
+        EXPECT_EQ(expected(prices[i], symbols[i]), results[i]);
+    }
+}
+
+TEST_F(CurrencyFormatTests, SymbolLooksLikeAnAmount)
+{
+    /* Falls back to formatting these one at a time */
+    const std::vector<double> prices{1, -1234.5};
+    const std::vector<std::string> symbols{"1,00", "%1"};
+
+    auto results = format(prices, symbols);
+    ASSERT_EQ(prices.size(), results.size());
+
+    for (size_t i = 0; i < prices.size(); i++)
+    {
+        EXPECT_EQ(expected(prices[i], symbols[i]), results[i]);
+    }
+}
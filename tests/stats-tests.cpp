@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* The registry is process wide, each test has its own names */
+static Stats::Counter statThreads("test.threads");
+static Stats::Counter statExited("test.exited");
+static Stats::Counter statNamed("test.named");
+static Stats::Histogram statLatency("test.latency");
+
+TEST(Stats, RegisteredNames)
+{
+    auto counters = Stats::counters();
+    EXPECT_NE(counters.end(), counters.find("test.threads"));
+    EXPECT_NE(counters.end(), counters.find("test.exited"));
+    EXPECT_NE(counters.end(), counters.find("test.named"));
+    EXPECT_EQ(0u, counters["test.named"]);
+
+    auto histograms = Stats::histograms();
+    ASSERT_NE(histograms.end(), histograms.find("test.latency"));
+    EXPECT_EQ(Stats::Histogram::buckets, histograms["test.latency"].buckets.size());
+}
+
+TEST(Stats, ThreadsSum)
+{
+    const unsigned int threads = 8;
+    const unsigned int adds = 1000;
+
+    /* All of them are still around when the values are read */
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned int done = 0;
+    bool read = false;
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&]()
+        {
+            for (unsigned int j = 0; j < adds; j++)
+            {
+                statThreads.add();
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            done++;
+            changed.notify_all();
+            changed.wait(lock, [&read]()
+            {
+                return read;
+            });
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&done, threads]()
+    {
+        return done == threads;
+    });
+    EXPECT_EQ(uint64_t(threads) * adds, Stats::counters()["test.threads"]);
+    read = true;
+    changed.notify_all();
+    lock.unlock();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    EXPECT_EQ(uint64_t(threads) * adds, Stats::counters()["test.threads"]);
+}
+
+TEST(Stats, ExitedThreadsKept)
+{
+    std::thread([]()
+    {
+        statExited.add(5);
+    }).join();
+    std::thread([]()
+    {
+        statExited.add(7);
+    }).join();
+
+    statExited.add(1);
+
+    EXPECT_EQ(13u, Stats::counters()["test.exited"]);
+}
+
+TEST(Stats, HistogramBuckets)
+{
+    statLatency.record(std::chrono::microseconds(0));
+    statLatency.record(std::chrono::microseconds(1));
+    statLatency.record(std::chrono::microseconds(3));
+    std::thread([]()
+    {
+        statLatency.record(std::chrono::microseconds(3));
+    }).join();
+
+    auto value = Stats::histograms()["test.latency"];
+    EXPECT_EQ(4u, value.count);
+    EXPECT_EQ(7u, value.sum);
+    EXPECT_EQ(1u, value.buckets[0]);
+    EXPECT_EQ(1u, value.buckets[1]);
+    EXPECT_EQ(2u, value.buckets[2]);
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libpay/internal/status-board.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using Pay::Internal::StatusBoard;
+
+/* Writes a board the way the service's status_board.go does, with its
+   constants, so that the reader is checked against the service's layout
+   rather than its own */
+class GoBoard
+{
+public:
+    static constexpr uint32_t magic{0x50415942};
+    static constexpr uint32_t version{1};
+    static constexpr size_t header{64};
+    static constexpr uint32_t slots{256};
+    static constexpr uint32_t slotSize{256};
+    static constexpr size_t size{header + size_t(slots) * slotSize};
+
+    enum State : uint32_t
+    {
+        PURCHASED = 1,
+        APPROVED = 2,
+        NOT_PURCHASED = 3
+    };
+
+    GoBoard ()
+    {
+        char path[] = "/tmp/pay-status-test-XXXXXX";
+        fd = mkstemp(path);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Unable to create board file");
+        }
+        unlink(path);
+
+        if (ftruncate(fd, size) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Unable to size board file");
+        }
+
+        auto map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Unable to map board file");
+        }
+        data = static_cast<uint8_t*>(map);
+
+        put<uint32_t>(4, version);
+        put<uint32_t>(8, slots);
+        put<uint32_t>(12, slotSize);
+        put<uint32_t>(0, magic);
+    }
+
+    ~GoBoard ()
+    {
+        munmap(data, size);
+        close(fd);
+    }
+
+    /* A descriptor for the reader to take */
+    int reader () const
+    {
+        return dup(fd);
+    }
+
+    /* hash/fnv's New64a, with zero kept for empty slots */
+    static uint64_t hash (const std::string& sku)
+    {
+        uint64_t value = 14695981039346656037ULL;
+        for (const auto c : sku)
+        {
+            value ^= uint8_t(c);
+            value *= 1099511628211ULL;
+        }
+        return value != 0 ? value : 1;
+    }
+
+    static uint32_t home (const std::string& sku)
+    {
+        return hash(sku) & (slots - 1);
+    }
+
+    /* publish(), returns the slot the sku went into */
+    uint32_t publish (const std::string& sku, uint32_t state, uint64_t refundableUntil)
+    {
+        uint32_t index;
+        auto found = placed.find(sku);
+        if (found != placed.end())
+        {
+            index = found->second;
+        }
+        else
+        {
+            index = home(sku);
+            while (get<uint64_t>(slot(index) + 16) != 0)
+            {
+                index = (index + 1) & (slots - 1);
+            }
+            placed[sku] = index;
+        }
+
+        const auto at = slot(index);
+        const auto seq = get<uint32_t>(at);
+        put<uint32_t>(at, seq + 1);
+        put<uint32_t>(at + 4, state);
+        put<uint64_t>(at + 8, refundableUntil);
+        put<uint32_t>(at + 24, sku.size());
+        memcpy(data + at + 32, sku.data(), sku.size());
+        put<uint64_t>(at + 16, hash(sku));
+        put<uint32_t>(at + 0, seq + 2);
+
+        return index;
+    }
+
+    /* Leaves the slot as if the service were stuck half way through
+       writing it */
+    void startWriting (uint32_t index)
+    {
+        const auto at = slot(index);
+        put<uint32_t>(at, get<uint32_t>(at) | 1);
+    }
+
+    void markClosed ()
+    {
+        put<uint32_t>(16, 1);
+    }
+
+    template<typename T>
+    void put (size_t offset, T value)
+    {
+        memcpy(data + offset, &value, sizeof(value));
+    }
+
+private:
+    int fd = -1;
+    uint8_t* data = nullptr;
+    std::map<std::string, uint32_t> placed;
+
+    static size_t slot (uint32_t index)
+    {
+        return header + size_t(index) * slotSize;
+    }
+
+    template<typename T>
+    T get (size_t offset) const
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(value));
+        return value;
+    }
+};
+
+constexpr size_t GoBoard::size;
+
+TEST(StatusBoardTests, HashMatchesGo)
+{
+    /* From hash/fnv's tests */
+    EXPECT_EQ(0xcbf29ce484222325ULL, GoBoard::hash(""));
+    EXPECT_EQ(0xaf63dc4c8601ec8cULL, GoBoard::hash("a"));
+    EXPECT_EQ(0x089c4407b545986aULL, GoBoard::hash("ab"));
+    EXPECT_EQ(0xe71fa2190541574bULL, GoBoard::hash("abc"));
+}
+
+TEST(StatusBoardTests, Lookup)
+{
+    GoBoard go;
+    go.publish("purchased", GoBoard::PURCHASED, 1234567890);
+    go.publish("approved", GoBoard::APPROVED, 0);
+    go.publish("not-purchased", GoBoard::NOT_PURCHASED, 0);
+
+    StatusBoard board(go.reader());
+    EXPECT_FALSE(board.closed());
+
+    PayPackageItemStatus status;
+    uint64_t refundable_until = 0;
+
+    ASSERT_TRUE(board.lookup("purchased", status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_PURCHASED, status);
+    EXPECT_EQ(1234567890u, refundable_until);
+
+    ASSERT_TRUE(board.lookup("approved", status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_APPROVED, status);
+    EXPECT_EQ(0u, refundable_until);
+
+    ASSERT_TRUE(board.lookup("not-purchased", status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_NOT_PURCHASED, status);
+
+    EXPECT_FALSE(board.lookup("missing", status, refundable_until));
+    EXPECT_FALSE(board.lookup("", status, refundable_until));
+    EXPECT_FALSE(board.lookup(std::string(GoBoard::slotSize, 'x'), status, refundable_until));
+}
+
+TEST(StatusBoardTests, Updates)
+{
+    GoBoard go;
+    go.publish("item", GoBoard::NOT_PURCHASED, 0);
+
+    StatusBoard board(go.reader());
+
+    PayPackageItemStatus status;
+    uint64_t refundable_until = 0;
+    ASSERT_TRUE(board.lookup("item", status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_NOT_PURCHASED, status);
+
+    /* The mapping is shared, we see the service's writes */
+    go.publish("item", GoBoard::PURCHASED, 42);
+    ASSERT_TRUE(board.lookup("item", status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_PURCHASED, status);
+    EXPECT_EQ(42u, refundable_until);
+}
+
+TEST(StatusBoardTests, Probing)
+{
+    GoBoard go;
+    const std::string first{"sku-0"};
+
+    /* Find another sku that starts at the same slot */
+    std::string second;
+    for (int i = 1; second.empty(); i++)
+    {
+        auto candidate = "sku-" + std::to_string(i);
+        if (GoBoard::home(candidate) == GoBoard::home(first))
+        {
+            second = candidate;
+        }
+    }
+
+    const auto firstSlot = go.publish(first, GoBoard::PURCHASED, 1);
+    const auto secondSlot = go.publish(second, GoBoard::APPROVED, 2);
+    EXPECT_NE(firstSlot, secondSlot);
+
+    StatusBoard board(go.reader());
+
+    PayPackageItemStatus status;
+    uint64_t refundable_until = 0;
+    ASSERT_TRUE(board.lookup(first, status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_PURCHASED, status);
+    EXPECT_EQ(1u, refundable_until);
+    ASSERT_TRUE(board.lookup(second, status, refundable_until));
+    EXPECT_EQ(PAY_PACKAGE_ITEM_STATUS_APPROVED, status);
+    EXPECT_EQ(2u, refundable_until);
+}
+
+TEST(StatusBoardTests, BusySlot)
+{
+    GoBoard go;
+    const auto slot = go.publish("item", GoBoard::PURCHASED, 0);
+    go.startWriting(slot);
+
+    StatusBoard board(go.reader());
+
+    /* Gives up rather than wait for the service */
+    PayPackageItemStatus status;
+    uint64_t refundable_until = 0;
+    EXPECT_FALSE(board.lookup("item", status, refundable_until));
+}
+
+TEST(StatusBoardTests, Closed)
+{
+    GoBoard go;
+    StatusBoard board(go.reader());
+    EXPECT_FALSE(board.closed());
+
+    go.markClosed();
+    EXPECT_TRUE(board.closed());
+}
+
+TEST(StatusBoardTests, NotABoard)
+{
+    {
+        GoBoard go;
+        go.put<uint32_t>(0, 0);
+        EXPECT_THROW(StatusBoard(go.reader()), std::runtime_error);
+    }
+
+    {
+        GoBoard go;
+        go.put<uint32_t>(4, GoBoard::version + 1);
+        EXPECT_THROW(StatusBoard(go.reader()), std::runtime_error);
+    }
+
+    {
+        GoBoard go;
+        go.put<uint32_t>(8, 100);
+        EXPECT_THROW(StatusBoard(go.reader()), std::runtime_error);
+    }
+}
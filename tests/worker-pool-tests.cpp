@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "worker-pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Lets the work wait for the test to say it can go on */
+class Gate
+{
+public:
+    void open ()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        opened = true;
+        changed.notify_all();
+    }
+
+    bool wait ()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(5), [this]()
+        {
+            return opened;
+        });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool opened = false;
+};
+
+TEST(WorkerPool, KeyKeepsOrder)
+{
+    std::mutex mutex;
+    std::vector<int> order;
+
+    {
+        WorkerPool pool(4);
+        for (int i = 0; i < 100; i++)
+        {
+            pool.submit("key", [&mutex, &order, i]()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(i);
+            });
+        }
+    }
+
+    ASSERT_EQ(100u, order.size());
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST(WorkerPool, KeyRunsOneAtATime)
+{
+    std::atomic<int> running{0};
+    std::atomic<int> most{0};
+
+    {
+        WorkerPool pool(4);
+        for (int i = 0; i < 20; i++)
+        {
+            pool.submit("key", [&running, &most]()
+            {
+                auto now = ++running;
+                if (now > most)
+                {
+                    most = now;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                running--;
+            });
+        }
+    }
+
+    EXPECT_EQ(1, most.load());
+}
+
+TEST(WorkerPool, KeysRunInParallel)
+{
+    WorkerPool pool(2);
+    Gate first;
+    Gate second;
+
+    /* Each waits for the other, which only works with both running */
+    pool.submit("first", [&first, &second]()
+    {
+        second.open();
+        first.wait();
+    });
+    pool.submit("second", [&first, &second]()
+    {
+        first.open();
+        second.wait();
+    });
+
+    EXPECT_TRUE(first.wait());
+    EXPECT_TRUE(second.wait());
+}
+
+TEST(WorkerPool, BusyKeyDoesntHoldOthersBack)
+{
+    WorkerPool pool(2);
+    Gate blocked;
+    Gate other;
+
+    pool.submit("busy", [&blocked]()
+    {
+        blocked.wait();
+    });
+    pool.submit("busy", []() {});
+    pool.submit("other", [&other]()
+    {
+        other.open();
+    });
+
+    EXPECT_TRUE(other.wait());
+    blocked.open();
+}
+
+TEST(WorkerPool, ShutdownDrains)
+{
+    std::atomic<int> ran{0};
+    Gate started;
+    Gate release;
+
+    {
+        WorkerPool pool(2);
+        pool.submit("slow", [&started, &release, &ran]()
+        {
+            started.open();
+            release.wait();
+            ran++;
+        });
+        for (int i = 0; i < 10; i++)
+        {
+            pool.submit("key" + std::to_string(i % 3), [&ran]()
+            {
+                ran++;
+            });
+        }
+
+        ASSERT_TRUE(started.wait());
+        release.open();
+    }
+
+    EXPECT_EQ(11, ran.load());
+}
+
+TEST(WorkerPool, FailingWorkKeepsGoing)
+{
+    std::atomic<int> ran{0};
+
+    {
+        WorkerPool pool(1);
+        pool.submit("key", []()
+        {
+            throw std::runtime_error("failed");
+        });
+        pool.submit("key", [&ran]()
+        {
+            ran++;
+        });
+    }
+
+    EXPECT_EQ(1, ran.load());
+}
+
+/* What the work holds on to goes away after the pool's lock is let go,
+   so it can submit more work as it does */
+TEST(WorkerPool, WorkReleasedOutsideLock)
+{
+    std::atomic<int> ran{0};
+
+    class Resubmit
+    {
+    public:
+        Resubmit (WorkerPool& in_pool, std::atomic<int>& in_ran) :
+            pool(in_pool),
+            ran(in_ran)
+        {
+        }
+
+        ~Resubmit ()
+        {
+            auto& counter = ran;
+            pool.submit("after", [&counter]()
+            {
+                counter++;
+            });
+        }
+
+    private:
+        WorkerPool& pool;
+        std::atomic<int>& ran;
+    };
+
+    {
+        WorkerPool pool(1);
+        auto held = std::make_shared<Resubmit>(pool, ran);
+        pool.submit("key", [held]() {});
+        held.reset();
+    }
+
+    EXPECT_EQ(1, ran.load());
+}
@@ -51,6 +51,18 @@ public:
                    "/items/by-sku/" + sku;
 
         auto req = m_wfactory->create_request(url, true);
+        req->set_priority(Request::Priority::BACKGROUND, package_name);
+        maybe_add_device_header(req);
+        return req;
+    }
+
+    Request::Ptr getItemsInfo(const std::string& package_name)
+    {
+        // https://developer.staging.ubuntu.com/docs/api/iap.html#list-items
+        auto url = get_inventory_url() + '/' + package_name + "/items";
+
+        auto req = m_wfactory->create_request(url, true);
+        req->set_priority(Request::Priority::BACKGROUND, package_name);
         maybe_add_device_header(req);
         return req;
     }
@@ -68,6 +80,7 @@ public:
         }
 
         auto req = m_wfactory->create_request(url, true);
+        req->set_priority(Request::Priority::BACKGROUND, package_name);
         maybe_add_device_header(req);
         return req;
     }
@@ -75,6 +88,7 @@ public:
     Request::Ptr refundPackage(const std::string& package_name)
     {
         auto req = m_wfactory->create_request(get_refund_url(), true);
+        req->set_priority(Request::Priority::INTERACTIVE, package_name);
         maybe_add_device_header(req);
         req->set_post("{\"name\": \"" + package_name + "\"}");
         req->set_header("Content-Type", "application/json");
@@ -167,6 +181,12 @@ ClickPurchasesApi::getItemInfo(const std::string& package_name,
     return impl->getItemInfo(package_name, sku);
 }
 
+Request::Ptr
+ClickPurchasesApi::getItemsInfo(const std::string& package_name)
+{
+    return impl->getItemsInfo(package_name);
+}
+
 Request::Ptr
 ClickPurchasesApi::refundPackage(const std::string& package_name)
 {
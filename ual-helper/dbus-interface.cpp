@@ -20,123 +20,252 @@
 #include "dbus-interface.h"
 
 #include <gio/gio.h>
-#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <cstring>
 
 #include "proxy-service.h"
+#include "glib-thread.h"
+#include "logging.h"
 #include "proxy-package.h"
+#include "stats.h"
+#include "trace.h"
+#include "worker-pool.h"
+
+/* Read only view of the counters, exported next to the service object */
+static const char* statsXml =
+    "<node>"
+    "  <interface name='com.canonical.pay.Stats'>"
+    "    <!-- dbus.<method>.calls for each package method, verification.<result>,"
+    "         http.requests, http.errors, http.bytes_sent, http.bytes_received,"
+    "         the retry layer's http.retries, http.hedges, http.hedge_wins and"
+    "         http.retries_exhausted, and the store.applications and store.items"
+    "         there are right now -->"
+    "    <method name='GetCounters'>"
+    "      <arg type='a{st}' name='counters' direction='out'/>"
+    "    </method>"
+    "    <!-- count, sum in microseconds, and the buckets as described in stats.h -->"
+    "    <method name='GetHistograms'>"
+    "      <arg type='a{s(ttat)}' name='histograms' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+struct MethodStats
+{
+    explicit MethodStats (const std::string& method) :
+        calls("dbus." + method + ".calls"),
+        latency("dbus." + method + ".latency")
+    {
+    }
+
+    Stats::Counter calls;
+    Stats::Histogram latency;
+};
+
+static std::map<std::string, MethodStats> methodStats =
+{
+    {"ListPackages", MethodStats("ListPackages")},
+    {"ListItems", MethodStats("ListItems")},
+    {"VerifyItem", MethodStats("VerifyItem")},
+    {"PurchaseItem", MethodStats("PurchaseItem")},
+    {"PurchaseItemWithMetadata", MethodStats("PurchaseItemWithMetadata")},
+    {"RefundItem", MethodStats("RefundItem")}
+};
+
+static void recordCall (const std::string& method, const std::chrono::steady_clock::time_point& started)
+{
+    auto it = methodStats.find(method);
+    if (it == methodStats.end())
+    {
+        return;
+    }
+
+    it->second.calls.add();
+    it->second.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - started));
+}
 
 class DBusInterfaceImpl
 {
 public:
     /* Allocated on main thread with init */
     Item::Store::Ptr items;
-    std::thread t;
+    std::shared_ptr<GLib::ContextThread> reactor;
+    std::shared_ptr<WorkerPool> workers;
+    std::unique_ptr<core::ScopedConnection> itemupdate;
     core::Signal<> connectionReady;
     const GQuark errorQuark = g_quark_from_static_string("dbus-interface-impl");
 
-    /* Allocated on thread, and cleaned up there */
-    GMainLoop* loop = nullptr;
+    /* Allocated on the reactor, and cleaned up there */
+    GMainContext* context = nullptr;
+    guint owner_id = 0;
     proxyPay* serviceProxy = nullptr;
     proxyPayPackage* packageProxy = nullptr;
     GDBusConnection* bus = nullptr;
     GCancellable* cancel = nullptr;
     guint subtree_registration = 0;
-
-    /* Allocates a thread to do dbus work */
-    explicit DBusInterfaceImpl (const Item::Store::Ptr& in_items) :
+    GDBusNodeInfo* statsInfo = nullptr;
+    guint stats_registration = 0;
+
+    /* Serialized ListItems replies per package, dropped whenever one of
+       the package's items changes status or refund expiry. Items change
+       on other threads so this needs its own lock. */
+    std::mutex listMutex;
+    std::map<std::string, GVariant*> listReplies;
+
+    /* Status changes waiting to go out as a single ItemsStatusChanged per
+       package. Sent flushLatency after the first of them, so a burst goes
+       out together and nothing waits longer than that. Last change to an
+       item wins. */
+    struct Change
+    {
+        Item::Item::Status status;
+        uint64_t refund_timeout;
+    };
+    static constexpr guint flushLatency{50}; /* ms */
+    std::mutex changeMutex;
+    std::map<std::string, std::map<std::string, Change>> pendingChanges;
+    GSource* flushTimeout = nullptr;
+
+    /* Slow method calls go to the workers, which aren't ours, so
+       we count them to know when they're all done */
+    std::mutex callsMutex;
+    std::condition_variable callsIdle;
+    unsigned int callsRunning = 0;
+
+    /* Does its dbus work on the reactor and its slow work on the workers */
+    DBusInterfaceImpl (const Item::Store::Ptr& in_items,
+                       const std::shared_ptr<GLib::ContextThread>& in_reactor,
+                       const std::shared_ptr<WorkerPool>& in_workers) :
         items(in_items),
+        reactor(in_reactor),
+        workers(in_workers),
         cancel(g_cancellable_new())
     { }
 
     void run ()
     {
-        t = std::thread([this]()
+        itemupdate.reset(new core::ScopedConnection(items->itemChanged.connect([this](std::string pkg, std::string item,
+                                                                                       Item::Item::Status status, uint64_t refund_timeout)
         {
-            GMainContext* context = g_main_context_new();
-            g_debug("Setting main loop");
-            loop = g_main_loop_new(context, FALSE);
-            g_debug("Main loop set");
-
-            g_main_context_push_thread_default(context);
+            invalidateList(pkg);
 
-            core::ScopedConnection itemupdate(items->itemChanged.connect([this](std::string pkg, std::string item,
-                                                                                Item::Item::Status status, uint64_t refund_timeout)
+            if (bus == nullptr)
             {
-                if (bus == nullptr)
-                {
-                    return;
-                }
+                return;
+            }
 
-                const auto path = getPathFromPackage(pkg);
+            const auto path = getPathFromPackage(pkg);
 
-                auto mitem = items->getItem(pkg, item);
-                const char* strstatus = Item::Item::statusString(status);
+            const char* strstatus = Item::Item::statusString(status);
 
-                g_dbus_connection_emit_signal(bus,
-                                              nullptr, /* dest */
-                                              path.c_str(),
-                                              "com.canonical.pay.package",
-                                              "ItemStatusChanged",
-                                              g_variant_new("(sst)",
-                                                            item.c_str(),
-                                                            strstatus,
-                                                            refund_timeout),
-                                              nullptr);
-            }));
+            g_dbus_connection_emit_signal(bus,
+                                          nullptr, /* dest */
+                                          path.c_str(),
+                                          "com.canonical.pay.package",
+                                          "ItemStatusChanged",
+                                          g_variant_new("(sst)",
+                                                        item.c_str(),
+                                                        strstatus,
+                                                        refund_timeout),
+                                          nullptr);
 
-            if (cancel != nullptr && !g_cancellable_is_cancelled(cancel))
-            {
-                g_bus_own_name(G_BUS_TYPE_SESSION,
-                               "com.canonical.pay",
-                               G_BUS_NAME_OWNER_FLAGS_NONE,
-                               busAcquired_staticHelper,
-                               nameAcquired_staticHelper,
-                               nameLost_staticHelper,
-                               this,
-                               nullptr /* free func for this */);
-            }
+            queueChange(pkg, item, status, refund_timeout);
+        })));
+
+        reactor->executeOnThread([this]()
+        {
+            std::unique_lock<std::mutex> lock(changeMutex);
+            context = g_main_context_ref_thread_default();
+            lock.unlock();
 
             if (cancel != nullptr && !g_cancellable_is_cancelled(cancel))
             {
-                g_main_loop_run(loop);
+                owner_id = g_bus_own_name(G_BUS_TYPE_SESSION,
+                                          "com.canonical.pay",
+                                          G_BUS_NAME_OWNER_FLAGS_NONE,
+                                          busAcquired_staticHelper,
+                                          nameAcquired_staticHelper,
+                                          nameLost_staticHelper,
+                                          this,
+                                          nullptr /* free func for this */);
             }
+        });
+    }
 
-            if (serviceProxy != nullptr)
-            {
-                g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(serviceProxy));
-            }
-            if (subtree_registration != 0 && bus != nullptr)
-            {
-                g_dbus_connection_unregister_subtree(bus, subtree_registration);
-                subtree_registration =0;
-            }
+    /* The reactor goes on without us, so everything we left
+       on it has to go before we do. Runs on the reactor. */
+    void shutdown ()
+    {
+        if (owner_id != 0)
+        {
+            g_bus_unown_name(owner_id);
+            owner_id = 0;
+        }
+
+        if (serviceProxy != nullptr)
+        {
+            g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(serviceProxy));
+        }
+        if (subtree_registration != 0 && bus != nullptr)
+        {
+            g_dbus_connection_unregister_subtree(bus, subtree_registration);
+            subtree_registration =0;
+        }
+        if (stats_registration != 0 && bus != nullptr)
+        {
+            g_dbus_connection_unregister_object(bus, stats_registration);
+            stats_registration = 0;
+        }
+        g_clear_pointer(&statsInfo, g_dbus_node_info_unref);
 
-            g_clear_object(&serviceProxy);
-            g_clear_object(&packageProxy);
+        g_clear_object(&serviceProxy);
+        g_clear_object(&packageProxy);
 
-            g_clear_object(&bus);
-            g_clear_pointer(&loop, g_main_loop_unref);
-            g_clear_pointer(&context, g_main_context_unref);
-        });
+        /* No more flushes once we're going away */
+        std::unique_lock<std::mutex> lock(changeMutex);
+        cancelFlush();
+        pendingChanges.clear();
+        auto oldcontext = context;
+        context = nullptr;
+        lock.unlock();
+
+        g_clear_object(&bus);
+        g_clear_pointer(&oldcontext, g_main_context_unref);
     }
 
     ~DBusInterfaceImpl ()
     {
+        itemupdate.reset();
+
         g_cancellable_cancel(cancel);
         g_clear_object(&cancel);
 
-        if (loop != nullptr)
+        std::unique_lock<std::mutex> lock(callsMutex);
+        callsIdle.wait(lock, [this]()
         {
-            g_debug("Quitting main loop");
-            g_main_loop_quit(loop);
+            return callsRunning == 0;
+        });
+        lock.unlock();
+
+        if (!reactor->isCancelled())
+        {
+            g_debug("Leaving the reactor");
+            reactor->executeOnThread<bool>([this]()
+            {
+                shutdown();
+                return true;
+            });
         }
 
-        if (t.joinable())
+        for (auto& reply : listReplies)
         {
-            g_debug("Waiting on thread");
-            t.join();
+            g_variant_unref(reply.second);
         }
+        listReplies.clear();
     }
 
     static constexpr char const * baseObjectPath{"/com/canonical/pay"};
@@ -169,13 +298,13 @@ public:
        be done with it. */
     void nameLost ()
     {
-        g_main_loop_quit(loop);
         throw std::runtime_error("Unable to get dbus name: 'com.canonical.pay'");
     }
 
     /* Someone wants to know what packages we have */
     bool listPackages (GDBusMethodInvocation* invocation)
     {
+        auto started = std::chrono::steady_clock::now();
         auto packages = items->listApplications();
         GVariantBuilder builder;
         g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
@@ -189,9 +318,182 @@ public:
 
         g_variant_builder_close(&builder); // tuple
         g_dbus_method_invocation_return_value(invocation, g_variant_builder_end(&builder));
+        recordCall("ListPackages", started);
         return true;
     }
 
+    void statsCall (const gchar* method, GDBusMethodInvocation* invocation)
+    {
+        if (g_strcmp0(method, "GetCounters") == 0)
+        {
+            auto counters = Stats::counters();
+
+            /* The store sizes aren't counted as they change, look now */
+            uint64_t applications = 0;
+            uint64_t storeitems = 0;
+            for (const auto& app : items->listApplications())
+            {
+                applications++;
+                storeitems += items->getItems(app)->size();
+            }
+            counters["store.applications"] = applications;
+            counters["store.items"] = storeitems;
+
+            GVariantBuilder builder;
+            g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+            for (const auto& counter : counters)
+            {
+                g_variant_builder_add(&builder, "{st}", counter.first.c_str(), counter.second);
+            }
+
+            g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{st})", &builder));
+        }
+        else if (g_strcmp0(method, "GetHistograms") == 0)
+        {
+            GVariantBuilder builder;
+            g_variant_builder_init(&builder, G_VARIANT_TYPE("a{s(ttat)}"));
+            for (const auto& histogram : Stats::histograms())
+            {
+                GVariantBuilder buckets;
+                g_variant_builder_init(&buckets, G_VARIANT_TYPE("at"));
+                for (auto bucket : histogram.second.buckets)
+                {
+                    g_variant_builder_add(&buckets, "t", bucket);
+                }
+
+                g_variant_builder_add(&builder, "{s(ttat)}",
+                                      histogram.first.c_str(),
+                                      histogram.second.count,
+                                      histogram.second.sum,
+                                      &buckets);
+            }
+
+            g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{s(ttat)})", &builder));
+        }
+        else
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                                  "Unknown method '%s'", method);
+        }
+    }
+
+    /* Gets a ref to the ListItems reply for the package, only building it
+       when we don't already have one */
+    GVariant* listItems (const std::string& package)
+    {
+        std::lock_guard<std::mutex> lock(listMutex);
+
+        auto cached = listReplies.find(package);
+        if (cached != listReplies.end())
+        {
+            return g_variant_ref(cached->second);
+        }
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
+        g_variant_builder_open(&builder, G_VARIANT_TYPE("a(sst)"));
+
+        auto litems = items->getItems(package);
+        for (auto item : *litems)
+        {
+            g_variant_builder_open(&builder, G_VARIANT_TYPE("(sst)"));
+
+            g_variant_builder_add_value(&builder, g_variant_new_string(item.first.c_str()));
+            g_variant_builder_add_value(&builder, g_variant_new_string(Item::Item::statusString(item.second->getStatus())));
+            g_variant_builder_add_value(&builder, g_variant_new_uint64(item.second->getRefundExpiry()));
+
+            g_variant_builder_close(&builder);
+        }
+
+        g_variant_builder_close(&builder);
+
+        auto reply = g_variant_ref_sink(g_variant_builder_end(&builder));
+        listReplies[package] = reply;
+        return g_variant_ref(reply);
+    }
+
+    void invalidateList (const std::string& package)
+    {
+        std::lock_guard<std::mutex> lock(listMutex);
+
+        auto cached = listReplies.find(package);
+        if (cached != listReplies.end())
+        {
+            g_variant_unref(cached->second);
+            listReplies.erase(cached);
+        }
+    }
+
+    void queueChange (const std::string& package, const std::string& item,
+                      Item::Item::Status status, uint64_t refund_timeout)
+    {
+        std::lock_guard<std::mutex> lock(changeMutex);
+
+        pendingChanges[package][item] = Change{status, refund_timeout};
+
+        if (flushTimeout != nullptr || context == nullptr)
+        {
+            return;
+        }
+
+        flushTimeout = g_timeout_source_new(flushLatency);
+        g_source_set_callback(flushTimeout, flushChanges_staticHelper, this, nullptr);
+        g_source_attach(flushTimeout, context);
+    }
+
+    /* Called with the change lock held */
+    void cancelFlush ()
+    {
+        if (flushTimeout != nullptr)
+        {
+            g_source_destroy(flushTimeout);
+            g_source_unref(flushTimeout);
+            flushTimeout = nullptr;
+        }
+    }
+
+    /* Sends everything that built up since the last flush, on the reactor */
+    void flushChanges ()
+    {
+        std::unique_lock<std::mutex> lock(changeMutex);
+        cancelFlush();
+        std::map<std::string, std::map<std::string, Change>> changes;
+        changes.swap(pendingChanges);
+        lock.unlock();
+
+        if (bus == nullptr)
+        {
+            return;
+        }
+
+        for (const auto& package : changes)
+        {
+            const auto path = getPathFromPackage(package.first);
+
+            GVariantBuilder builder;
+            g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
+            g_variant_builder_open(&builder, G_VARIANT_TYPE("a(sst)"));
+
+            for (const auto& item : package.second)
+            {
+                g_variant_builder_add(&builder, "(sst)",
+                                      item.first.c_str(),
+                                      Item::Item::statusString(item.second.status),
+                                      item.second.refund_timeout);
+            }
+
+            g_variant_builder_close(&builder);
+
+            g_dbus_connection_emit_signal(bus,
+                                          nullptr, /* dest */
+                                          path.c_str(),
+                                          "com.canonical.pay.package",
+                                          "ItemsStatusChanged",
+                                          g_variant_builder_end(&builder),
+                                          nullptr);
+        }
+    }
+
     /**************************************
      * Subtree Functions
      **************************************/
@@ -224,41 +526,82 @@ public:
     void packageCall(const gchar* sender, const gchar* path, const gchar* method, GVariant* params,
                      GDBusMethodInvocation* invocation)
     {
+        auto started = std::chrono::steady_clock::now();
         const auto package = getPackageFromPath(path);
 
-        auto params_str = g_variant_print(params, true);
-        g_debug("%s sender(%s) path(%s) method(%s) package(%s) params(%s)",
-                G_STRFUNC, sender, path, method, package.c_str(), params_str);
-        g_free(params_str);
+        if (pay_log_enabled(DEBUG, DBUS))
+        {
+            auto params_str = g_variant_print(params, true);
+            pay_debug(DBUS, "%s sender(%s) path(%s) method(%s) package(%s) params(%s)",
+                      G_STRFUNC, sender, path, method, package.c_str(), params_str);
+            g_free(params_str);
+        }
 
         if (g_strcmp0(method, "ListItems") == 0)
         {
-            GVariantBuilder builder;
-            g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
-            g_variant_builder_open(&builder, G_VARIANT_TYPE("a(sst)"));
+            auto reply = listItems(package);
+            g_dbus_method_invocation_return_value(invocation, reply);
+            g_variant_unref(reply);
+            recordCall(method, started);
+            return;
+        }
 
-            auto litems = items->getItems(package);
-            for (auto item : *litems)
-            {
-                g_variant_builder_open(&builder, G_VARIANT_TYPE("(ss)"));
+        if (g_strcmp0(method, "VerifyItem") != 0 &&
+                g_strcmp0(method, "PurchaseItem") != 0 &&
+                g_strcmp0(method, "PurchaseItemWithMetadata") != 0 &&
+                g_strcmp0(method, "RefundItem") != 0)
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                                  "Unknown method '%s'", method);
+            return;
+        }
 
-                g_variant_builder_add_value(&builder, g_variant_new_string(item.first.c_str()));
-                g_variant_builder_add_value(&builder, g_variant_new_string(Item::Item::statusString(item.second->getStatus())));
-                g_variant_builder_add_value(&builder, g_variant_new_uint64(0));
+        GVariant* vitemid = g_variant_get_child_value(params, 0);
+        std::string itemid(g_variant_get_string(vitemid, NULL));
+        g_variant_unref(vitemid);
+        std::string smethod(method);
 
-                g_variant_builder_close(&builder);
+        std::string trace_id;
+        if (g_strcmp0(method, "PurchaseItemWithMetadata") == 0)
+        {
+            GVariant* metadata = g_variant_get_child_value(params, 1);
+            const gchar* vtrace = nullptr;
+            if (g_variant_lookup(metadata, Trace::idKey, "&s", &vtrace))
+            {
+                trace_id = vtrace;
             }
-
-            g_variant_builder_close(&builder);
-            g_dbus_method_invocation_return_value(invocation, g_variant_builder_end(&builder));
+            g_variant_unref(metadata);
         }
-        else if (g_strcmp0(method, "VerifyItem") == 0)
+
+        /* These can take a while, so they run on the workers and answer
+           from there. Calls for the same item stay in order so that its
+           state changes do too. */
+        std::unique_lock<std::mutex> lock(callsMutex);
+        callsRunning++;
+        lock.unlock();
+
+        workers->submit(package + '/' + itemid, [this, package, itemid, smethod, trace_id, invocation, started]()
         {
-            GVariant* vitemid = g_variant_get_child_value(params, 0);
-            std::string itemid(g_variant_get_string(vitemid, NULL));
-            g_variant_unref(vitemid);
+            itemCall(package, itemid, smethod, trace_id, invocation);
+            recordCall(smethod, started);
+
+            std::lock_guard<std::mutex> lock(callsMutex);
+            callsRunning--;
+            callsIdle.notify_all();
+        });
+    }
+
+    /* Runs on a worker thread */
+    void itemCall (const std::string& package, const std::string& itemid, const std::string& method,
+                   const std::string& trace_id, GDBusMethodInvocation* invocation)
+    {
+        auto item = items->getItem(package, itemid);
 
-            auto item = items->getItem(package, itemid);
+        /* The item may have just been added, which isn't signaled */
+        invalidateList(package);
+
+        if (method == "VerifyItem")
+        {
             if (item->verify())
             {
                 g_dbus_method_invocation_return_value(invocation, NULL);
@@ -268,14 +611,9 @@ public:
                 g_dbus_method_invocation_return_error(invocation, errorQuark, 1, "Unable to verify item '%s'", itemid.c_str());
             }
         }
-        else if (g_strcmp0(method, "PurchaseItem") == 0)
+        else if (method == "PurchaseItem" || method == "PurchaseItemWithMetadata")
         {
-            GVariant* vitemid = g_variant_get_child_value(params, 0);
-            std::string itemid(g_variant_get_string(vitemid, NULL));
-            g_variant_unref(vitemid);
-
-            auto item = items->getItem(package, itemid);
-            if (item->purchase())
+            if (item->purchase(trace_id))
             {
                 g_dbus_method_invocation_return_value(invocation, NULL);
             }
@@ -284,13 +622,8 @@ public:
                 g_dbus_method_invocation_return_error(invocation, errorQuark, 2, "Unable to purchase item '%s'", itemid.c_str());
             }
         }
-        else if (g_strcmp0(method, "RefundItem") == 0)
+        else if (method == "RefundItem")
         {
-            GVariant* vitemid = g_variant_get_child_value(params, 0);
-            std::string itemid(g_variant_get_string(vitemid, NULL));
-            g_variant_unref(vitemid);
-
-            auto item = items->getItem(package, itemid);
             if (item->refund())
             {
                 g_dbus_method_invocation_return_value(invocation, NULL);
@@ -323,6 +656,13 @@ public:
         notthis->nameLost();
     }
 
+    static gboolean flushChanges_staticHelper (gpointer user_data)
+    {
+        auto notthis = static_cast<DBusInterfaceImpl*>(user_data);
+        notthis->flushChanges();
+        return G_SOURCE_REMOVE;
+    }
+
     static gboolean listPackages_staticHelper (proxyPay* /*proxy*/, GDBusMethodInvocation* invocation, gpointer user_data)
     {
         auto notthis = static_cast<DBusInterfaceImpl*>(user_data);
@@ -357,6 +697,20 @@ public:
         auto notthis = static_cast<DBusInterfaceImpl*>(user_data);
         return notthis->packageCall(sender, path, method, params, invocation);
     }
+
+    static void statsCall_staticHelper (GDBusConnection* /*connection*/, const gchar* /*sender*/, const gchar* /*path*/,
+                                        const gchar* /*interface*/, const gchar* method, GVariant* /*params*/, GDBusMethodInvocation* invocation, gpointer user_data)
+    {
+        auto notthis = static_cast<DBusInterfaceImpl*>(user_data);
+        notthis->statsCall(method, invocation);
+    }
+};
+
+static const GDBusInterfaceVTable statsVtable =
+{
+    DBusInterfaceImpl::statsCall_staticHelper,
+    nullptr,
+    nullptr
 };
 
 static const GDBusSubtreeVTable subtreeVtable =
@@ -396,6 +750,17 @@ void DBusInterfaceImpl::busAcquired (GDBusConnection* inbus)
                                                               this,
                                                               nullptr, /* free func */
                                                               nullptr);
+
+    /* The subtree takes all the paths below us, so this goes on the
+       service object as a second interface */
+    statsInfo = g_dbus_node_info_new_for_xml(statsXml, nullptr);
+    stats_registration = g_dbus_connection_register_object(bus,
+                                                           baseObjectPath,
+                                                           statsInfo->interfaces[0],
+                                                           &statsVtable,
+                                                           this,
+                                                           nullptr, /* free func */
+                                                           nullptr);
 }
 
 static const GDBusInterfaceVTable packageVtable =
@@ -426,8 +791,10 @@ const GDBusInterfaceVTable* DBusInterfaceImpl::subtreeDispatch_staticHelper (GDB
 
 
 
-DBusInterface::DBusInterface (const Item::Store::Ptr& in_items):
-    impl(std::make_shared<DBusInterfaceImpl>(in_items))
+DBusInterface::DBusInterface (const Item::Store::Ptr& in_items,
+                              const std::shared_ptr<GLib::ContextThread>& reactor,
+                              const std::shared_ptr<WorkerPool>& workers):
+    impl(std::make_shared<DBusInterfaceImpl>(in_items, reactor, workers))
 {
     impl->connectionReady.connect([this]()
     {
@@ -25,11 +25,19 @@
 #define DBUS_INTERFACE_HPP__ 1
 
 class DBusInterfaceImpl;
+class WorkerPool;
+
+namespace GLib
+{
+class ContextThread;
+}
 
 class DBusInterface
 {
 public:
-    explicit DBusInterface (const Item::Store::Ptr& in_items);
+    DBusInterface (const Item::Store::Ptr& in_items,
+                   const std::shared_ptr<GLib::ContextThread>& reactor,
+                   const std::shared_ptr<WorkerPool>& workers);
     ~DBusInterface () { };
 
     static std::string encodePath (const std::string& input);
@@ -71,7 +71,9 @@ public:
     virtual uint64_t getRefundExpiry (void) = 0;
     virtual bool verify (void) = 0;
     virtual bool refund (void) = 0;
-    virtual bool purchase (void) = 0;
+    /* Carries on with the caller's trace, or starts one when the
+       trace ID is empty */
+    virtual bool purchase (const std::string& trace_id) = 0;
 
     typedef std::shared_ptr<Item> Ptr;
 };
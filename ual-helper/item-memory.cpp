@@ -20,14 +20,22 @@
 #include "item-memory.h"
 
 #include <algorithm>
+#include <atomic>
 #include <core/signal.h>
 #include <memory>
 
 #include <glib.h>
 
+#include "stats.h"
+
 namespace Item
 {
 
+static Stats::Counter statPurchased("verification.purchased");
+static Stats::Counter statNotPurchased("verification.not_purchased");
+static Stats::Counter statApproved("verification.approved");
+static Stats::Counter statError("verification.error");
+
 class MemoryItem : public Item
 {
 public:
@@ -68,51 +76,7 @@ public:
 
     bool verify (void) override
     {
-        if (!vfactory->running())
-        {
-            return false;
-        }
-
-        if (vitem == nullptr)
-        {
-            vitem = vfactory->verifyItem(app, id);
-        }
-
-        if (vitem == nullptr)
-        {
-            /* Uhg, failed */
-            return false;
-        }
-
-        /* New verification instance, tell the world! */
-        setStatus(Item::Status::VERIFYING);
-
-        /* When the verification item has run it's course we need to
-           update our status */
-        /* NOTE: This will execute on the verification item's thread */
-        vitem->verificationComplete.connect([this](Verification::Item::Status status, uint64_t refundable_until)
-        {
-            setRefundExpiry(0);
-            switch (status)
-            {
-                case Verification::Item::PURCHASED:
-                    setRefundExpiry(refundable_until);
-                    setStatus(Item::Status::PURCHASED);
-                    break;
-                case Verification::Item::NOT_PURCHASED:
-                    setStatus(Item::Status::NOT_PURCHASED);
-                    break;
-                case Verification::Item::APPROVED:
-                    setStatus(Item::Status::APPROVED);
-                    break;
-                case Verification::Item::ERROR:
-                default: /* Fall through, an error is same as status we don't know */
-                    setStatus(Item::Status::UNKNOWN);
-                    break;
-            }
-        });
-
-        return vitem->run();
+        return startVerification(false);
     }
 
     bool refund (void) override
@@ -141,6 +105,10 @@ public:
         ritem->finished.connect([this, cached_status](bool success)
         {
             g_debug("%s ritem returned success flag %d", G_STRFUNC, (int)success);
+            if (success)
+            {
+                vfactory->invalidate(app, id);
+            }
             auto new_status = success ? Status::NOT_PURCHASED : cached_status;
             setStatus(new_status);
         });
@@ -149,7 +117,7 @@ public:
         return ritem->run();
     }
 
-    bool purchase (void) override
+    bool purchase (const std::string& trace_id) override
     {
         /* First check to see if a purchase makes sense */
         if (status == PURCHASED)
@@ -166,41 +134,131 @@ public:
                 return false;
             }
 
-            pitem->purchaseComplete.connect([this](Purchase::Item::Status /*status*/)
+            pitem->purchaseComplete.connect([this](Purchase::Item::Status status, uint64_t refundable_until)
             {
-                /* Verifying on each time the purchase UI runs right now because
-                   we're not getting reliable status back from them. */
-                if (!verify())
+                vfactory->invalidate(app, id);
+
+                switch (status)
                 {
-                    setStatus(Item::Status::NOT_PURCHASED);
+                    case Purchase::Item::PURCHASED:
+                        setRefundExpiry(refundable_until);
+                        setStatus(Item::Status::PURCHASED);
+                        break;
+                    case Purchase::Item::NOT_PURCHASED:
+                        setRefundExpiry(0);
+                        setStatus(Item::Status::NOT_PURCHASED);
+                        break;
+                    default:
+                        /* We don't know how it went, the store does */
+                        if (!verify())
+                        {
+                            setStatus(Item::Status::NOT_PURCHASED);
+                        }
+                        return;
                 }
-                return;
+
+                /* The store told the Pay UI, so the app can go ahead with
+                   that while we make sure of it in the background */
+                startVerification(true);
             });
         }
 
         /* New purchase instance, tell the world! */
         setStatus(Item::Status::PURCHASING);
 
-        return pitem->run();
+        return pitem->run(trace_id);
     }
 
     typedef std::shared_ptr<MemoryItem> Ptr;
     core::Signal<Item::Status, uint64_t> statusChanged;
 
 private:
+    /* A quiet verification double checks a status that we already have,
+       so it doesn't go through VERIFYING. If the store can't be reached
+       it keeps the status, unless that's a purchase only the Pay UI has
+       told us about: those need the store to agree. */
+    bool startVerification (bool in_quiet)
+    {
+        if (!vfactory->running())
+        {
+            return false;
+        }
+
+        if (vitem == nullptr)
+        {
+            vitem = vfactory->verifyItem(app, id);
+
+            if (vitem == nullptr)
+            {
+                /* Uhg, failed */
+                return false;
+            }
+
+            /* When the verification item has run it's course we need to
+               update our status */
+            /* NOTE: This will execute on the verification item's thread */
+            vitem->verificationComplete.connect([this](Verification::Item::Status status, uint64_t refundable_until)
+            {
+                switch (status)
+                {
+                    case Verification::Item::PURCHASED:
+                        statPurchased.add();
+                        setRefundExpiry(refundable_until);
+                        setStatus(Item::Status::PURCHASED);
+                        break;
+                    case Verification::Item::NOT_PURCHASED:
+                        statNotPurchased.add();
+                        setRefundExpiry(0);
+                        setStatus(Item::Status::NOT_PURCHASED);
+                        break;
+                    case Verification::Item::APPROVED:
+                        statApproved.add();
+                        setRefundExpiry(0);
+                        setStatus(Item::Status::APPROVED);
+                        break;
+                    case Verification::Item::ERROR:
+                    default: /* Fall through, an error is same as status we don't know */
+                        statError.add();
+                        if (!quiet || getStatus() == Item::Status::PURCHASED)
+                        {
+                            setRefundExpiry(0);
+                            setStatus(Item::Status::UNKNOWN);
+                        }
+                        break;
+                }
+            });
+        }
+
+        quiet = in_quiet;
+        if (!quiet)
+        {
+            /* New verification instance, tell the world! */
+            setStatus(Item::Status::VERIFYING);
+        }
+
+        return vitem->run();
+    }
+
     void setStatus (Item::Status in_status)
     {
+        std::unique_lock<std::mutex> rl(refund_mutex);
+        auto refund = refund_timeout;
+        rl.unlock();
+
         std::unique_lock<std::mutex> ul(status_mutex);
-        bool signal = (status != in_status);
+        /* A new refund expiry is news even when the status stays, the
+           listings that have it need to hear about it */
+        bool signal = (status != in_status || signaled_refund != refund);
 
         status = in_status;
+        signaled_refund = refund;
         ul.unlock();
 
         if (signal)
             /* NOTE: in_status here as it's on the stack and the status
                that this signal should be associated with */
         {
-            statusChanged(in_status, refund_timeout);
+            statusChanged(in_status, refund);
         }
     }
 
@@ -227,10 +285,14 @@ private:
     Refund::Item::Ptr ritem;
     /* Purchase item if we're in the state of purchasing or null otherwise */
     Purchase::Item::Ptr pitem;
+    /* Whether the running verification is a quiet one */
+    std::atomic<bool> quiet{false};
 
     /****** status is protected with it's own mutex *******/
     std::mutex status_mutex;
     Item::Status status = Item::Status::UNKNOWN;
+    /* The refund expiry that went out with the last status change */
+    uint64_t signaled_refund = 0;
 
     /****** refund_timeout is protected with it's own mutex *******/
     std::mutex refund_mutex;
@@ -240,6 +302,7 @@ private:
 std::list<std::string>
 MemoryStore::listApplications (void)
 {
+    std::lock_guard<std::mutex> lock(dataMutex);
     std::list<std::string> apps;
 
     std::transform(data.begin(),
@@ -255,6 +318,14 @@ MemoryStore::listApplications (void)
 
 std::shared_ptr<std::map<std::string, Item::Ptr>>
 MemoryStore::getItems (const std::string& application)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return std::make_shared<std::map<std::string, Item::Ptr>>(*findApplication(application));
+}
+
+/* Called with the data mutex held */
+std::shared_ptr<std::map<std::string, Item::Ptr>>
+MemoryStore::findApplication (const std::string& application)
 {
     auto app = data[application];
 
@@ -262,6 +333,12 @@ MemoryStore::getItems (const std::string& application)
     {
         app = std::make_shared<std::map<std::string, Item::Ptr>>();
         data[application] = app;
+
+        /* First we've heard of it, it has a package open */
+        if (purchaseFactory != nullptr)
+        {
+            purchaseFactory->prepare(application);
+        }
     }
 
     return app;
@@ -280,7 +357,8 @@ MemoryStore::getItem (const std::string& application, const std::string& itemid)
         return Item::Ptr(nullptr);
     }
 
-    auto app = getItems(application);
+    std::lock_guard<std::mutex> lock(dataMutex);
+    auto app = findApplication(application);
     Item::Ptr item = (*app)[itemid];
 
     if (item == nullptr)
@@ -24,6 +24,7 @@
 #include <memory>
 #include <iostream>
 #include <map>
+#include <mutex>
 
 namespace Item
 {
@@ -48,7 +49,13 @@ public:
     Item::Ptr getItem (const std::string& application, const std::string& itemid) override;
 
 private:
+    /* Calls come in from several threads, data is only touched
+       with the mutex held and getItems() hands out copies */
+    std::mutex dataMutex;
     std::map<std::string, std::shared_ptr<std::map<std::string, Item::Ptr>>> data;
+
+    std::shared_ptr<std::map<std::string, Item::Ptr>> findApplication (const std::string& application);
+
     Verification::Factory::Ptr verificationFactory;
     Refund::Factory::Ptr refundFactory;
     Purchase::Factory::Ptr purchaseFactory;
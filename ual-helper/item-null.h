@@ -55,7 +55,7 @@ public:
         return false;
     }
 
-    bool purchase (void) override
+    bool purchase (const std::string& /*trace_id*/) override
     {
         return false;
     }
@@ -22,13 +22,31 @@
 #include "verification-http.h"
 #include "refund-http.h"
 #include "webclient-curl.h"
+#include "webclient-retry.h"
+#include "webclient-scheduler.h"
 #include "purchase-ual.h"
 #include "qtbridge.h"
 #include "token-grabber-u1.h"
+#include "glib-thread.h"
+#include "worker-pool.h"
+
+/* The slower bus calls share these, they can end up waiting on transfers */
+static constexpr unsigned int blockingWorkers{8};
+/* HTTP transfers get their own, two hosts' worth at the scheduler's
+   per-host limit */
+static constexpr unsigned int transferWorkers{8};
 
 int
 main (int argv, char* argc[])
 {
+    /* Besides Qt's, the only threads we have. The GLib loop runs the bus,
+       the Pay UI launches and the retry timers, the workers anything that
+       blocks, so the count doesn't change with how much is going on.
+       Declared first so they're the last to go. */
+    auto reactor = std::make_shared<GLib::ContextThread>();
+    auto workers = std::make_shared<WorkerPool>(blockingWorkers);
+    auto transfers = std::make_shared<WorkerPool>(transferWorkers);
+
     TokenGrabber::Ptr token;
     Web::Factory::Ptr wfactory;
     Web::ClickPurchasesApi::Ptr cpa;
@@ -38,17 +56,19 @@ main (int argv, char* argc[])
     Item::Store::Ptr items;
     DBusInterface::Ptr dbus;
 
-    qt::core::world::build_and_run(argv, argc, [&token, &wfactory, &cpa, &vfactory, &rfactory, &pfactory, &items, &dbus]()
+    qt::core::world::build_and_run(argv, argc, [&reactor, &workers, &transfers, &token, &wfactory, &cpa, &vfactory, &rfactory, &pfactory, &items, &dbus]()
     {
         /* Initialize the other object after Qt is built */
         token = std::make_shared<TokenGrabberU1>();
-        wfactory = std::make_shared<Web::CurlFactory>(token);
+        wfactory = std::make_shared<Web::RetryFactory>(
+                       std::make_shared<Web::SchedulerFactory>(std::make_shared<Web::CurlFactory>(token, transfers)),
+                       reactor);
         cpa = std::make_shared<Web::ClickPurchasesApi>(wfactory);
-        vfactory = std::make_shared<Verification::HttpFactory>(cpa);
+        vfactory = std::make_shared<Verification::HttpFactory>(cpa, reactor);
         rfactory = std::make_shared<Refund::HttpFactory>(cpa);
-        pfactory = std::make_shared<Purchase::UalFactory>();
+        pfactory = std::make_shared<Purchase::UalFactory>(reactor, workers);
         items = std::make_shared<Item::MemoryStore>(vfactory, rfactory, pfactory);
-        dbus = std::make_shared<DBusInterface>(items);
+        dbus = std::make_shared<DBusInterface>(items, reactor, workers);
     });
 
     qt::core::world::destroy();
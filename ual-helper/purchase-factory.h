@@ -32,14 +32,19 @@ public:
     {
         ERROR,
         NOT_PURCHASED,
-        PURCHASED
+        PURCHASED,
+        /* The UI went away without telling us how it went */
+        UNKNOWN
     };
 
-    virtual bool run (void) = 0;
+    /* The trace ID is the caller's, empty if it didn't have one */
+    virtual bool run (const std::string& trace_id) = 0;
 
     typedef std::shared_ptr<Item> Ptr;
 
-    core::Signal<Status> purchaseComplete;
+    /* Status and the time the item can be refunded until, which
+       is zero unless PURCHASED and the store gave one */
+    core::Signal<Status, uint64_t> purchaseComplete;
 };
 
 class Factory
@@ -49,6 +54,12 @@ public:
 
     virtual Item::Ptr purchaseItem (std::string& appid, std::string& itemid) = 0;
 
+    /* A hint that the application might buy something soon, it
+       shouldn't block */
+    virtual void prepare (const std::string& /*appid*/)
+    {
+    }
+
     typedef std::shared_ptr<Factory> Ptr;
 };
 
@@ -32,7 +32,7 @@ public:
     {
     }
 
-    virtual bool run (void)
+    virtual bool run (const std::string& /*trace_id*/)
     {
         return false;
     };
@@ -19,147 +19,296 @@
 
 #include "purchase-ual.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
 #include <thread>
 #include <future>
 #include <system_error>
+#include <vector>
 #include <ubuntu-app-launch.h>
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
 #include <mir_toolkit/mir_connection.h>
 #include <mir_toolkit/mir_prompt_session.h>
+#include <json/json.h>
 
 #include "glib-thread.h"
+#include "trace.h"
+#include "worker-pool.h"
 
 static const char* HELPER_TYPE = "pay-ui";
 
+/* The part of com.canonical.pay.payui that we serve to the Pay UI so
+   that it can tell us how the purchase went */
+static const char* payuiXml =
+    "<node>"
+    "  <interface name='com.canonical.pay.payui'>"
+    "    <method name='PurchaseResult'>"
+    "      <arg type='s' name='status' direction='in'/>"
+    "      <arg type='s' name='item' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+static const char* payuiBasePath = "/com/canonical/payui";
+
+/* The last part of the result object's path. Anyone can read it from
+   the Pay UI's command line, so it only keeps the paths of different
+   purchases apart, who calls is checked separately. */
+static std::string randomToken (void)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::random_device random;
+
+    std::string token;
+    for (int i = 0; i < 4; i++)
+    {
+        auto value = random();
+        for (int j = 0; j < 8; j++)
+        {
+            token += digits[value & 0xf];
+            value >>= 4;
+        }
+    }
+    return token;
+}
+
+/* Whether the process is the other one, or was started by it */
+static bool descendantOf (pid_t pid, pid_t ancestor)
+{
+    for (int depth = 0; depth < 16 && pid > 1; depth++)
+    {
+        if (pid == ancestor)
+        {
+            return true;
+        }
+
+        gchar* statpath = g_strdup_printf("/proc/%d/stat", int(pid));
+        auto stat = fopen(statpath, "r");
+        g_free(statpath);
+        if (stat == nullptr)
+        {
+            return false;
+        }
+
+        /* The command can have spaces and parens in it, the parent
+           comes after the last paren and the state */
+        char line[1024];
+        auto read = fgets(line, sizeof(line), stat);
+        fclose(stat);
+        auto end = read != nullptr ? strrchr(line, ')') : nullptr;
+        int parent = 0;
+        if (end == nullptr || sscanf(end + 1, " %*c %d", &parent) != 1)
+        {
+            return false;
+        }
+        pid = parent;
+    }
+
+    return false;
+}
+
 namespace Purchase
 {
 
-class UalItem : public Item
+/* What all the purchases share: the thread they run on, the workers
+   that make the calls that block for them, and what we can find out
+   about launching the Pay UI before anyone asks us to */
+class Launcher
 {
 public:
-    typedef std::shared_ptr<Item> Ptr;
-
-    UalItem (const std::string& in_appid, const std::string& in_itemid, const std::shared_ptr<MirConnection>& mir) :
-        appid(in_appid),
-        itemid(in_itemid),
-        connection(mir)
+    Launcher (const std::shared_ptr<GLib::ContextThread>& in_thread,
+              const std::shared_ptr<WorkerPool>& in_workers) :
+        thread(in_thread),
+        workers(in_workers),
+        cancel(g_cancellable_new(), [](GCancellable * cancel)
+        {
+            g_object_unref(cancel);
+        })
     {
-
     }
 
-    ~UalItem ()
+    ~Launcher ()
     {
+        g_cancellable_cancel(cancel.get());
+
+        /* The thread isn't ours, it goes on after we're gone */
+        if (thread->isCancelled())
+        {
+            return;
+        }
+
+        thread->executeOnThread<bool>([this]()
+        {
+            if (monitor != nullptr)
+            {
+                g_signal_handlers_disconnect_by_data(monitor, this);
+                g_file_monitor_cancel(monitor);
+            }
+            g_clear_object(&monitor);
+            g_clear_object(&bus);
+            return true;
+        });
     }
 
-    /* Goes through the basis phases of building up the environment for the
-       UI to run in. Ensures we've got an AppID, builds the session, sets up
-       the socket to pass the session. And then starts the UI. */
-    virtual bool run (void)
+    std::shared_ptr<GLib::ContextThread> thread;
+    /* Mir and UAL only have calls that wait on other processes, they're
+       made here so that the thread keeps serving the bus meanwhile */
+    std::shared_ptr<WorkerPool> workers;
+
+    /* Everything below is only used on the thread */
+
+    /* Calls done with the session bus, or nullptr if we can't get it.
+       Only the first call waits for it, and not on the thread. */
+    void sessionBus (std::function<void(GDBusConnection*)> done)
     {
-        ui_appid = discoverUiAppid();
-        if (ui_appid.empty())
+        if (bus != nullptr)
         {
-            g_warning("Empty UI App ID for PayUI");
-            return false;
+            done(bus);
+            return;
         }
 
-        auto purchase_url = buildPurchaseUrl();
-        if (purchase_url.empty())
+        busWaiting.push_back(done);
+        if (busWaiting.size() > 1)
         {
-            g_warning("Unable to determine purchase URL");
-            return false;
+            /* Already on its way */
+            return;
         }
 
-        thread = std::make_shared<GLib::ContextThread>([]() {}, [this]()
+        g_bus_get(G_BUS_TYPE_SESSION, cancel.get(), busFound_staticHelper, this);
+    }
+
+    /* Only looked for again when something changes in the directory */
+    const std::string& uiAppid (void)
+    {
+        if (monitor == nullptr)
         {
-            if (!instanceid.empty())
-            {
-                ubuntu_app_launch_stop_multiple_helper(HELPER_TYPE, ui_appid.c_str(), instanceid.c_str());
-                instanceid.clear();
-            }
+            auto file = g_file_new_for_path(hookDir().c_str());
+            monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, nullptr, nullptr);
+            g_object_unref(file);
 
-            if (session)
+            if (monitor != nullptr)
             {
-                session.reset();
+                g_signal_connect(monitor, "changed", G_CALLBACK(hookDirChanged_staticHelper), this);
             }
+        }
 
-            purchaseComplete(status);
-            ubuntu_app_launch_observer_delete_helper_stop(helper_stop_static_helper, HELPER_TYPE, this);
-        });
-        instanceid = thread->executeOnThread<std::string>([this, purchase_url]()
+        if (!haveUiAppid)
         {
-            std::string instid;
+            cachedUiAppid = discoverUiAppid();
+            /* Without a monitor we wouldn't know when it's stale */
+            haveUiAppid = (monitor != nullptr && !cachedUiAppid.empty());
+        }
 
-            pid_t overlaypid = appid2pid(appid);
-            if (overlaypid == 0)
+        return cachedUiAppid;
+    }
+
+    /* Calls done with the PID of the process to overlay, or zero if we
+       can't find one. PIDs we've found are reused while they're alive. */
+    void overlayPid (const std::string& appid, std::function<void(pid_t)> done)
+    {
+        auto known = pids.find(appid);
+        if (known != pids.end())
+        {
+            if (kill(known->second, 0) == 0 || errno == EPERM)
             {
-                return instid;
+                done(known->second);
+                return;
             }
+            pids.erase(known);
+        }
+
+        auto& waiting = lookups[appid];
+        waiting.push_back(done);
+        if (waiting.size() > 1)
+        {
+            /* Already on its way */
+            return;
+        }
 
-            session = std::shared_ptr<MirPromptSession>(
-                          mir_connection_create_prompt_session_sync(connection.get(), overlaypid, stateChanged, this),
-                          [](MirPromptSession * session)
+        auto found = [this, appid](pid_t pid)
+        {
+            if (pid != 0)
             {
-                if (session != nullptr)
-                {
-                    mir_prompt_session_release_sync(session);
-                }
-            });
+                pids[appid] = pid;
+            }
 
-            if (!session)
+            auto callbacks = std::move(lookups[appid]);
+            lookups.erase(appid);
+            for (const auto& callback : callbacks)
             {
-                return instid;
+                callback(pid);
             }
+        };
+
+        if (appid == "click-scope")
+        {
+            /* FIXME: Before other scopes can use pay, we'll need to figure out
+               how to detect if they're scopes or not. But for now we'll only just
+               look for 'click-scope' as it's our primary use-case */
+            upstartJobPid("unity8-dash", "", found);
+        }
+        else
+        {
+            found(ubuntu_app_launch_get_primary_pid(appid.c_str()));
+        }
+    }
 
-            ubuntu_app_launch_observer_add_helper_stop(helper_stop_static_helper, HELPER_TYPE, this);
+    /* Not on the thread. An app is using pay, so get the slow parts of
+       launching the UI out of the way before it wants to buy something. */
+    void prepare (const std::string& appid)
+    {
+        if (thread->isCancelled())
+        {
+            return;
+        }
 
-            std::array<const gchar*, 2>urls {purchase_url.c_str(), nullptr};
-            auto instance_c = ubuntu_app_launch_start_session_helper(HELPER_TYPE,
-                                                                     session.get(),
-                                                                     ui_appid.c_str(),
-                                                                     urls.data());
-            instid = std::string(instance_c);
-            g_free(instance_c);
-            return instid;
+        thread->executeOnThread([this, appid]()
+        {
+            uiAppid();
+            overlayPid(appid, [](pid_t) {});
         });
-
-        return !instanceid.empty();
     }
 
 private:
-    /* Set at init */
-    std::string appid;
-    std::string ui_appid;
-    std::string itemid;
-    std::string instanceid;
-    std::shared_ptr<GLib::ContextThread> thread;
-    std::shared_ptr<MirPromptSession> session;
-    Item::Status status = Item::ERROR;
+    /* Stops lookups that are still out when we go away */
+    std::shared_ptr<GCancellable> cancel;
+    GFileMonitor* monitor = nullptr;
+    std::string cachedUiAppid;
+    bool haveUiAppid = false;
+    GDBusConnection* bus = nullptr;
+    std::vector<std::function<void(GDBusConnection*)>> busWaiting;
+    std::map<std::string, pid_t> pids;
+    std::map<std::string, std::vector<std::function<void(pid_t)>>> lookups;
+
+    static std::string hookDir (void)
+    {
+        const gchar* clickhookdir = g_getenv("PAY_SERVICE_CLICK_DIR");
+        if (clickhookdir != nullptr)
+        {
+            return clickhookdir;
+        }
 
-    /* Given to us by our parents */
-    std::shared_ptr<MirConnection> connection;
+        gchar* cacheclickdir = g_build_filename(g_get_user_cache_dir(), "pay-service", HELPER_TYPE, nullptr);
+        std::string retval(cacheclickdir);
+        g_free(cacheclickdir);
+        return retval;
+    }
 
     /* Looks through a directory to find the first entry that is a .desktop file
        and uses that as our AppID. We don't support more than one entry being in
        a directory */
-    std::string discoverUiAppid (void)
+    static std::string discoverUiAppid (void)
     {
         std::string appid;
-        GDir* dir;
-        const gchar* clickhookdir = g_getenv("PAY_SERVICE_CLICK_DIR");
-        if (clickhookdir == nullptr)
-        {
-            gchar* cacheclickdir = g_build_filename(g_get_user_cache_dir(), "pay-service", HELPER_TYPE, nullptr);
-            g_debug("Looking for Pay UI in: %s", cacheclickdir);
-            dir = g_dir_open(cacheclickdir, 0, nullptr);
-            g_free(cacheclickdir);
-        }
-        else
-        {
-            g_debug("Looking for Pay UI in: %s", clickhookdir);
-            dir = g_dir_open(clickhookdir, 0, nullptr);
-        }
+        auto clickhookdir = hookDir();
+        g_debug("Looking for Pay UI in: %s", clickhookdir.c_str());
+        GDir* dir = g_dir_open(clickhookdir.c_str(), 0, nullptr);
 
         if (dir != nullptr)
         {
@@ -191,117 +340,171 @@ private:
         return appid;
     }
 
-    /* Build up the URL that we use to pass the purchase information on
-       to the Pay UI */
-    std::string buildPurchaseUrl (void)
+    static void busFound_staticHelper (GObject* /*object*/, GAsyncResult* res, gpointer user_data)
     {
-        std::string purchase_url = "purchase://";
+        GError* error = nullptr;
+        auto bus = g_bus_get_finish(res, &error);
 
-        if (appid != "click-scope")
+        if (error != nullptr)
         {
-            purchase_url += appid;
-            purchase_url += '/';
+            /* Cancelled means we're shutting down, nobody to tell */
+            if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+                g_error_free(error);
+                return;
+            }
+
+            g_critical("Unable to get session bus: %s", error->message);
+            g_error_free(error);
         }
 
-        purchase_url += itemid;
+        auto notthis = static_cast<Launcher*>(user_data);
+        notthis->bus = bus;
 
-        return purchase_url;
+        auto callbacks = std::move(notthis->busWaiting);
+        notthis->busWaiting.clear();
+        for (const auto& callback : callbacks)
+        {
+            callback(bus);
+        }
     }
 
-    static pid_t pidForUpstartJob (const gchar* jobname)
+    static void hookDirChanged_staticHelper (GFileMonitor* /*monitor*/, GFile* /*file*/, GFile* /*other*/,
+                                             GFileMonitorEvent /*event*/, gpointer user_data)
     {
-        GError* error = nullptr;
+        auto notthis = static_cast<Launcher*>(user_data);
+        notthis->haveUiAppid = false;
+    }
 
-        if (jobname == nullptr)
-        {
-            return 0;
-        }
+    /* Asks Upstart for the job, its instance and then its processes,
+       each reply starting the next call so the thread never waits */
+    struct UpstartLookup
+    {
+        std::string job;
+        std::string instance;
+        std::function<void(pid_t)> done;
+        /* Outlives the launcher with the lookup */
+        std::shared_ptr<GCancellable> cancel;
+    };
 
-        auto bus = std::shared_ptr<GDBusConnection>(g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr,
-                                                                   NULL), [](GDBusConnection * bus)
+public:
+    /* Calls done with the main process of the job's instance, or zero
+       if there isn't one */
+    void upstartJobPid (const std::string& job, const std::string& instance, std::function<void(pid_t)> done)
+    {
+        auto lookupCancel = cancel;
+        sessionBus([job, instance, done, lookupCancel](GDBusConnection * bus)
         {
-            g_clear_object(&bus);
+            if (bus == nullptr)
+            {
+                done(0);
+                return;
+            }
+
+            g_dbus_connection_call(bus,
+                                   "com.ubuntu.Upstart",
+                                   "/com/ubuntu/Upstart",
+                                   "com.ubuntu.Upstart0_6",
+                                   "GetJobByName",
+                                   g_variant_new("(s)", job.c_str()),
+                                   G_VARIANT_TYPE("(o)"),
+                                   G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                   -1, /* timeout */
+                                   lookupCancel.get(),
+                                   jobFound_staticHelper,
+                                   new UpstartLookup{job, instance, done, lookupCancel});
         });
-        if (!bus)
-        {
-            g_critical("Unable to get session bus");
-            return 0;
-        }
+    }
+
+private:
 
-        GVariant* retval = nullptr;
-        retval = g_dbus_connection_call_sync(
-                     bus.get(),
-                     "com.ubuntu.Upstart",
-                     "/com/ubuntu/Upstart",
-                     "com.ubuntu.Upstart0_6",
-                     "GetJobByName",
-                     g_variant_new("(s)", jobname),
-                     G_VARIANT_TYPE("(o)"),
-                     G_DBUS_CALL_FLAGS_NO_AUTO_START,
-                     -1, /* timeout */
-                     NULL, /* cancel */
-                     &error);
+    /* The reply, or nullptr once the lookup has been told it failed */
+    static GVariant* finishCall (GObject* bus, GAsyncResult* res, const char* what, UpstartLookup* lookup)
+    {
+        GError* error = nullptr;
+        auto reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(bus), res, &error);
 
-        if (error != NULL)
+        if (error != nullptr)
         {
-            g_warning("Unable to get path for job '%s': %s", jobname, error->message);
+            /* Cancelled means we're shutting down, nobody to tell */
+            if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+                g_warning("Unable to get %s for job '%s': %s", what, lookup->job.c_str(), error->message);
+                lookup->done(0);
+            }
             g_error_free(error);
-            return 0;
         }
 
-        gchar* path = nullptr;
-        g_variant_get(retval, "(o)", &path);
-        g_variant_unref(retval);
-
-        retval = g_dbus_connection_call_sync(
-                     bus.get(),
-                     "com.ubuntu.Upstart",
-                     path,
-                     "com.ubuntu.Upstart0_6.Job",
-                     "GetInstanceByName",
-                     g_variant_new("(s)", ""),
-                     G_VARIANT_TYPE("(o)"),
-                     G_DBUS_CALL_FLAGS_NO_AUTO_START,
-                     -1, /* timeout */
-                     NULL, /* cancel */
-                     &error);
-
-        g_free(path);
+        return reply;
+    }
 
-        if (error != NULL)
+    static void jobFound_staticHelper (GObject* bus, GAsyncResult* res, gpointer user_data)
+    {
+        std::unique_ptr<UpstartLookup> lookup(static_cast<UpstartLookup*>(user_data));
+        auto reply = finishCall(bus, res, "path", lookup.get());
+        if (reply == nullptr)
         {
-            g_warning("Unable to get instance for job '%s': %s", jobname, error->message);
-            g_error_free(error);
-            return 0;
+            return;
         }
 
-        g_variant_get(retval, "(o)", &path);
-        g_variant_unref(retval);
+        const gchar* path = nullptr;
+        g_variant_get(reply, "(&o)", &path);
+
+        g_dbus_connection_call(G_DBUS_CONNECTION(bus),
+                               "com.ubuntu.Upstart",
+                               path,
+                               "com.ubuntu.Upstart0_6.Job",
+                               "GetInstanceByName",
+                               g_variant_new("(s)", lookup->instance.c_str()),
+                               G_VARIANT_TYPE("(o)"),
+                               G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                               -1, /* timeout */
+                               lookup->cancel.get(),
+                               instanceFound_staticHelper,
+                               lookup.release());
+
+        g_variant_unref(reply);
+    }
 
-        retval = g_dbus_connection_call_sync(
-                     bus.get(),
-                     "com.ubuntu.Upstart",
-                     path,
-                     "org.freedesktop.DBus.Properties",
-                     "Get",
-                     g_variant_new("(ss)", "com.ubuntu.Upstart0_6.Instance", "processes"),
-                     G_VARIANT_TYPE("(v)"),
-                     G_DBUS_CALL_FLAGS_NO_AUTO_START,
-                     -1, /* timeout */
-                     NULL, /* cancel */
-                     &error);
+    static void instanceFound_staticHelper (GObject* bus, GAsyncResult* res, gpointer user_data)
+    {
+        std::unique_ptr<UpstartLookup> lookup(static_cast<UpstartLookup*>(user_data));
+        auto reply = finishCall(bus, res, "instance", lookup.get());
+        if (reply == nullptr)
+        {
+            return;
+        }
 
-        g_free(path);
+        const gchar* path = nullptr;
+        g_variant_get(reply, "(&o)", &path);
+
+        g_dbus_connection_call(G_DBUS_CONNECTION(bus),
+                               "com.ubuntu.Upstart",
+                               path,
+                               "org.freedesktop.DBus.Properties",
+                               "Get",
+                               g_variant_new("(ss)", "com.ubuntu.Upstart0_6.Instance", "processes"),
+                               G_VARIANT_TYPE("(v)"),
+                               G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                               -1, /* timeout */
+                               lookup->cancel.get(),
+                               processesFound_staticHelper,
+                               lookup.release());
+
+        g_variant_unref(reply);
+    }
 
-        if (error != NULL)
+    static void processesFound_staticHelper (GObject* bus, GAsyncResult* res, gpointer user_data)
+    {
+        std::unique_ptr<UpstartLookup> lookup(static_cast<UpstartLookup*>(user_data));
+        auto reply = finishCall(bus, res, "processes", lookup.get());
+        if (reply == nullptr)
         {
-            g_warning("Unable to get processes for job '%s': %s", jobname, error->message);
-            g_error_free(error);
-            return 0;
+            return;
         }
 
         GPid pid = 0;
-        GVariant* variant = g_variant_get_child_value(retval, 0);
+        GVariant* variant = g_variant_get_child_value(reply, 0);
         GVariant* array = g_variant_get_variant(variant);
         if (g_variant_n_children(array) > 0)
         {
@@ -314,25 +517,479 @@ private:
         }
         g_variant_unref(variant);
         g_variant_unref(array);
-        g_variant_unref(retval);
+        g_variant_unref(reply);
 
-        return pid;
+        lookup->done(pid);
     }
+};
+
+class UalItem : public Item, public std::enable_shared_from_this<UalItem>
+{
+public:
+    typedef std::shared_ptr<Item> Ptr;
 
-    /* Figures out the PID that we should be overlaying with the PayUI */
-    static pid_t appid2pid (std::string& appid)
+    UalItem (const std::string& in_appid,
+             const std::string& in_itemid,
+             const std::shared_ptr<MirConnection>& mir,
+             const std::shared_ptr<Launcher>& in_launcher) :
+        appid(in_appid),
+        itemid(in_itemid),
+        connection(mir),
+        launcher(in_launcher)
     {
-        if (appid == "click-scope")
+
+    }
+
+    ~UalItem ()
+    {
+        if (launcher->thread->isCancelled())
         {
-            /* FIXME: Before other scopes can use pay, we'll need to figure out
-               how to detect if they're scopes or not. But for now we'll only just
-               look for 'click-scope' as it's our primary use-case */
-            return pidForUpstartJob("unity8-dash");
+            return;
+        }
+
+        /* Nobody left to tell */
+        launcher->thread->executeOnThread<bool>([this]()
+        {
+            finish(false);
+            return true;
+        });
+    }
+
+    /* Goes through the basis phases of building up the environment for the
+       UI to run in. Ensures we've got an AppID, builds the session, sets up
+       the socket to pass the session. And then starts the UI. Anything that
+       goes wrong past finding the UI is reported with purchaseComplete. */
+    virtual bool run (const std::string& trace_id)
+    {
+        return launcher->thread->executeOnThread<bool>([this, trace_id]()
+        {
+            return start(trace_id);
+        });
+    }
+
+private:
+    /* Set at init */
+    std::string appid;
+    std::string itemid;
+
+    /* Given to us by our parents */
+    std::shared_ptr<MirConnection> connection;
+    std::shared_ptr<Launcher> launcher;
+
+    /* Only touched on the thread */
+    bool running = false;
+    std::string ui_appid;
+    std::string instanceid;
+    std::shared_ptr<MirPromptSession> session;
+    /* Pay UI instances that stopped while we were still starting one */
+    std::vector<std::string> stoppedEarly;
+    std::shared_ptr<Trace::Span> span;
+    Item::Status status = Item::UNKNOWN;
+    uint64_t refundable_until = 0;
+    std::string resultPath;
+    /* Tells a result that was being checked when its run ended from
+       one of the current run */
+    unsigned int runs = 0;
+    GDBusConnection* bus = nullptr;
+    guint result_registration = 0;
+    static const GDBusInterfaceVTable resultVtable;
+
+    bool start (const std::string& trace_id)
+    {
+        finish(false);
+
+        ui_appid = launcher->uiAppid();
+        if (ui_appid.empty())
+        {
+            g_warning("Empty UI App ID for PayUI");
+            return false;
+        }
+
+        running = true;
+        runs++;
+
+        /* Runs until the Pay UI is done with us, which it learns
+           the trace ID of from the purchase URL. Joins the caller's
+           trace when it sent one we can put in a URL. */
+        span = std::make_shared<Trace::Span>(Trace::validId(trace_id) ? trace_id : Trace::newId(),
+                                             "ual.purchase");
+
+        /* Unique to this run, and nothing to do with the trace ID
+           which goes out to the store and into trace files */
+        status = Item::UNKNOWN;
+        refundable_until = 0;
+        resultPath = std::string(payuiBasePath) + '/' + randomToken();
+
+        auto purchase_url = buildPurchaseUrl();
+
+        std::weak_ptr<UalItem> weak = shared_from_this();
+        launcher->overlayPid(appid, [weak, purchase_url](pid_t overlaypid)
+        {
+            auto self = weak.lock();
+            if (self && self->running)
+            {
+                self->launch(overlaypid, purchase_url);
+            }
+        });
+
+        return true;
+    }
+
+    void launch (pid_t overlaypid, const std::string& purchase_url)
+    {
+        if (overlaypid == 0)
+        {
+            g_warning("Unable to find the process to overlay for '%s'", appid.c_str());
+            status = Item::ERROR;
+            finish(true);
+            return;
+        }
+
+        std::weak_ptr<UalItem> weak = shared_from_this();
+        auto run = runs;
+        launcher->sessionBus([weak, run, overlaypid, purchase_url](GDBusConnection * sessionbus)
+        {
+            auto self = weak.lock();
+            if (self && self->running && self->runs == run)
+            {
+                self->startHelper(sessionbus, overlaypid, purchase_url);
+            }
+        });
+    }
+
+    /* Builds the Mir session and starts the Pay UI in it on one of the
+       workers, and hears back about it on the thread */
+    void startHelper (GDBusConnection* sessionbus, pid_t overlaypid, const std::string& purchase_url)
+    {
+        /* Without it the Pay UI can't report back and we verify
+           once it exits, so no reason to fail the purchase */
+        exportResult(sessionbus);
+
+        ubuntu_app_launch_observer_add_helper_stop(helper_stop_static_helper, HELPER_TYPE, this);
+
+        std::weak_ptr<UalItem> weak = shared_from_this();
+        auto run = runs;
+        auto thread = launcher->thread;
+        auto workers = launcher->workers;
+        auto key = workKey();
+        auto mir = connection;
+        auto ui = ui_appid;
+        workers->submit(key, [weak, run, thread, workers, key, mir, overlaypid, ui, purchase_url]()
+        {
+            std::shared_ptr<MirPromptSession> session(
+                mir_connection_create_prompt_session_sync(mir.get(), overlaypid, stateChanged, nullptr),
+                releaseSession);
+
+            std::string instance;
+            if (session)
+            {
+                std::array<const gchar*, 2>urls {purchase_url.c_str(), nullptr};
+                auto instance_c = ubuntu_app_launch_start_session_helper(HELPER_TYPE,
+                                                                         session.get(),
+                                                                         ui.c_str(),
+                                                                         urls.data());
+                if (instance_c != nullptr)
+                {
+                    instance = std::string(instance_c);
+                    g_free(instance_c);
+                }
+            }
+
+            if (thread->isCancelled())
+            {
+                stopHelper(ui, instance);
+                return;
+            }
+
+            thread->executeOnThread([weak, run, workers, key, ui, session, instance]()
+            {
+                auto self = weak.lock();
+                if (self && self->running && self->runs == run)
+                {
+                    self->launched(session, instance);
+                    return;
+                }
+
+                /* The run ended while we were starting it */
+                release(workers, key, ui, instance, session);
+            });
+        });
+    }
+
+    void launched (const std::shared_ptr<MirPromptSession>& in_session, const std::string& instance)
+    {
+        session = in_session;
+
+        if (!session || instance.empty())
+        {
+            status = Item::ERROR;
+            finish(true);
+            return;
+        }
+
+        instanceid = instance;
+
+        /* It might have come and gone before we knew it was ours */
+        if (std::find(stoppedEarly.begin(), stoppedEarly.end(), instance) != stoppedEarly.end())
+        {
+            instanceid.clear();
+            finish(true);
+        }
+        stoppedEarly.clear();
+    }
+
+    /* Tears down whatever the run built up */
+    void finish (bool notify)
+    {
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+
+        if (!instanceid.empty() || session)
+        {
+            release(launcher->workers, workKey(), ui_appid, instanceid, session);
+            instanceid.clear();
+            session.reset();
+        }
+        stoppedEarly.clear();
+
+        if (result_registration != 0)
+        {
+            g_dbus_connection_unregister_object(bus, result_registration);
+            result_registration = 0;
+        }
+        g_clear_object(&bus);
+
+        ubuntu_app_launch_observer_delete_helper_stop(helper_stop_static_helper, HELPER_TYPE, this);
+        span.reset();
+
+        if (notify)
+        {
+            purchaseComplete(status, refundable_until);
+        }
+    }
+
+    /* Launches and teardowns of an item stay in order */
+    std::string workKey (void)
+    {
+        return "purchase:" + appid + '/' + itemid;
+    }
+
+    static void releaseSession (MirPromptSession* session)
+    {
+        if (session != nullptr)
+        {
+            mir_prompt_session_release_sync(session);
+        }
+    }
+
+    /* Only on a worker */
+    static void stopHelper (const std::string& ui, const std::string& instance)
+    {
+        if (!instance.empty())
+        {
+            ubuntu_app_launch_stop_multiple_helper(HELPER_TYPE, ui.c_str(), instance.c_str());
+        }
+    }
+
+    /* Stops the Pay UI and lets go of its session on one of the workers */
+    static void release (const std::shared_ptr<WorkerPool>& workers, const std::string& key,
+                         const std::string& ui, const std::string& instance,
+                         std::shared_ptr<MirPromptSession> session)
+    {
+        workers->submit(key, [ui, instance, session]() mutable
+        {
+            stopHelper(ui, instance);
+            session.reset();
+        });
+    }
+
+    /* Build up the URL that we use to pass the purchase information on
+       to the Pay UI */
+    std::string buildPurchaseUrl (void)
+    {
+        std::string purchase_url = "purchase://";
+
+        if (appid != "click-scope")
+        {
+            purchase_url += appid;
+            purchase_url += '/';
+        }
+
+        purchase_url += itemid;
+
+        if (span)
+        {
+            purchase_url += '?';
+            purchase_url += Trace::idKey;
+            purchase_url += '=';
+            purchase_url += span->traceId();
+            purchase_url += "&result=";
+            purchase_url += resultPath;
+        }
+
+        return purchase_url;
+    }
+
+    void exportResult (GDBusConnection* sessionbus)
+    {
+        if (sessionbus == nullptr)
+        {
+            return;
+        }
+
+        GError* error = nullptr;
+        bus = G_DBUS_CONNECTION(g_object_ref(sessionbus));
+
+        auto info = g_dbus_node_info_new_for_xml(payuiXml, nullptr);
+        result_registration = g_dbus_connection_register_object(bus,
+                                                                resultPath.c_str(),
+                                                                info->interfaces[0],
+                                                                &resultVtable,
+                                                                this,
+                                                                nullptr, /* free func */
+                                                                &error);
+        g_dbus_node_info_unref(info);
+
+        if (error != nullptr)
+        {
+            g_warning("Unable to export purchase result object: %s", error->message);
+            g_error_free(error);
+        }
+    }
+
+    /* The Pay UI got the outcome from the store, take its word for it
+       instead of asking the store again */
+    void purchaseResult (const std::string& result, const std::string& item)
+    {
+        g_debug("Pay UI reported purchase status: %s", result.c_str());
+
+        refundable_until = 0;
+
+        if (result == "purchased")
+        {
+            status = Item::PURCHASED;
+
+            Json::Reader reader(Json::Features::strictMode());
+            Json::Value root;
+            GTimeVal refundable = {0, 0};
+            if (reader.parse(item, root) &&
+                    root.isObject() &&
+                    root.isMember("refundable_until") &&
+                    g_time_val_from_iso8601(root["refundable_until"].asString().c_str(), &refundable))
+            {
+                refundable_until = refundable.tv_sec;
+            }
+        }
+        else if (result == "not purchased")
+        {
+            status = Item::NOT_PURCHASED;
         }
         else
         {
-            return ubuntu_app_launch_get_primary_pid(appid.c_str());
+            status = Item::UNKNOWN;
+        }
+    }
+
+    /* A result being checked, it's only taken from the Pay UI we started */
+    struct ResultCall
+    {
+        std::weak_ptr<UalItem> item;
+        unsigned int run;
+        std::string result;
+        std::string json;
+        GDBusMethodInvocation* invocation;
+    };
+
+    /* Finds out which process sent the result, and then whether it's
+       our Pay UI, before taking its word for anything */
+    void resultCall (const gchar* sender, const std::string& result, const std::string& json,
+                     GDBusMethodInvocation* invocation)
+    {
+        g_dbus_connection_call(bus,
+                               "org.freedesktop.DBus",
+                               "/org/freedesktop/DBus",
+                               "org.freedesktop.DBus",
+                               "GetConnectionUnixProcessID",
+                               g_variant_new("(s)", sender),
+                               G_VARIANT_TYPE("(u)"),
+                               G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                               -1, /* timeout */
+                               nullptr, /* cancellable */
+                               callerFound_staticHelper,
+                               new ResultCall{shared_from_this(), runs, result, json, invocation});
+    }
+
+    static void callerFound_staticHelper (GObject* bus, GAsyncResult* res, gpointer user_data)
+    {
+        std::shared_ptr<ResultCall> call(static_cast<ResultCall*>(user_data));
+
+        GError* error = nullptr;
+        auto reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(bus), res, &error);
+        if (error != nullptr)
+        {
+            g_warning("Unable to find who sent the purchase result: %s", error->message);
+            g_dbus_method_invocation_return_gerror(call->invocation, error);
+            g_error_free(error);
+            return;
         }
+
+        guint32 caller = 0;
+        g_variant_get(reply, "(u)", &caller);
+        g_variant_unref(reply);
+
+        auto self = call->item.lock();
+        if (!self || !self->running || self->runs != call->run || self->instanceid.empty())
+        {
+            g_dbus_method_invocation_return_error(call->invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                                  "The purchase is over");
+            return;
+        }
+
+        /* UAL runs each helper as an instance of the untrusted-helper job */
+        auto instance = std::string(HELPER_TYPE) + ':' + self->instanceid + ':' + self->ui_appid;
+        self->launcher->upstartJobPid("untrusted-helper", instance, [call, caller](pid_t helper)
+        {
+            auto self = call->item.lock();
+            if (!self || !self->running || self->runs != call->run)
+            {
+                g_dbus_method_invocation_return_error(call->invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                                      "The purchase is over");
+                return;
+            }
+
+            if (helper == 0 || !descendantOf(pid_t(caller), helper))
+            {
+                g_warning("Purchase result from process %u, which isn't the Pay UI", caller);
+                g_dbus_method_invocation_return_error(call->invocation, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+                                                      "Only the Pay UI can report the purchase result");
+                return;
+            }
+
+            self->purchaseResult(call->result, call->json);
+            g_dbus_method_invocation_return_value(call->invocation, nullptr);
+        });
+    }
+
+    static void resultCall_staticHelper (GDBusConnection* /*connection*/, const gchar* sender, const gchar* /*path*/,
+                                         const gchar* /*interface*/, const gchar* method, GVariant* params,
+                                         GDBusMethodInvocation* invocation, gpointer user_data)
+    {
+        UalItem* notthis = static_cast<UalItem*>(user_data);
+
+        if (g_strcmp0(method, "PurchaseResult") != 0)
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                                  "Unknown method '%s'", method);
+            return;
+        }
+
+        const gchar* result = nullptr;
+        const gchar* item = nullptr;
+        g_variant_get(params, "(&s&s)", &result, &item);
+        notthis->resultCall(sender, result, item, invocation);
     }
 
     static void stateChanged (MirPromptSession* /*session*/, MirPromptSessionState state, void* /*user_data*/)
@@ -363,23 +1020,40 @@ private:
             return;
         }
 
-        if (instanceid.empty() || instanceid != stop_instanceid)
+        if (instanceid.empty())
+        {
+            if (running && !session)
+            {
+                stoppedEarly.push_back(stop_instanceid);
+            }
+            return;
+        }
+
+        if (instanceid != stop_instanceid)
         {
             return;
         }
 
-        status = Item::PURCHASED;
         instanceid.clear();
-        thread->quit();
+        finish(true);
     }
 };
 
+const GDBusInterfaceVTable UalItem::resultVtable =
+{
+    UalItem::resultCall_staticHelper,
+    nullptr,
+    nullptr
+};
+
 class UalFactory::Impl
 {
     std::shared_ptr<MirConnection> connection;
+    std::shared_ptr<Launcher> launcher;
 
 public:
-    Impl(void)
+    Impl(const std::shared_ptr<GLib::ContextThread>& thread,
+         const std::shared_ptr<WorkerPool>& workers)
     {
         gchar* mirpath = g_build_filename(g_get_user_runtime_dir(), "mir_socket_trusted", NULL);
 
@@ -398,11 +1072,18 @@ public:
         {
             throw std::runtime_error("Unable to connect to Mir Trusted Session");
         }
+
+        launcher = std::make_shared<Launcher>(thread, workers);
     }
 
     Item::Ptr purchaseItem (std::string& appid, std::string& itemid)
     {
-        return std::make_shared<UalItem>(appid, itemid, connection);
+        return std::make_shared<UalItem>(appid, itemid, connection, launcher);
+    }
+
+    void prepare (const std::string& appid)
+    {
+        launcher->prepare(appid);
     }
 };
 
@@ -412,8 +1093,15 @@ UalFactory::purchaseItem (std::string& appid, std::string& itemid)
     return impl->purchaseItem(appid, itemid);
 }
 
-UalFactory::UalFactory ():
-    impl(std::make_shared<Impl>())
+void
+UalFactory::prepare (const std::string& appid)
+{
+    impl->prepare(appid);
+}
+
+UalFactory::UalFactory (const std::shared_ptr<GLib::ContextThread>& thread,
+                        const std::shared_ptr<WorkerPool>& workers):
+    impl(std::make_shared<Impl>(thread, workers))
 {
     if (!impl)
     {
@@ -22,14 +22,25 @@
 #ifndef PURCHASE_UAL_HPP__
 #define PURCHASE_UAL_HPP__ 1
 
+namespace GLib
+{
+class ContextThread;
+}
+
+class WorkerPool;
+
 namespace Purchase
 {
 
+/* Purchases run on the given thread, which needs to outlive us. Mir and
+   UAL calls that block are made on the workers. */
 class UalFactory : public Factory
 {
 public:
-    UalFactory();
+    UalFactory(const std::shared_ptr<GLib::ContextThread>& thread,
+               const std::shared_ptr<WorkerPool>& workers);
     virtual Item::Ptr purchaseItem (std::string& appid, std::string& itemid);
+    virtual void prepare (const std::string& appid) override;
 
     typedef std::shared_ptr<UalFactory> Ptr;
 
@@ -47,6 +47,7 @@ QEvent::Type qt_core_world_task_event_type()
     return event_type;
 }
 
+/* Runs a task, nobody hears how it went */
 class TaskEvent : public QEvent
 {
 public:
@@ -56,16 +57,56 @@ public:
     {
     }
 
-    void run()
+    virtual ~TaskEvent()
+    {
+    }
+
+    virtual void run()
+    {
+        if (run_task())
+        {
+            qWarning() << "Task posted to the Qt world failed";
+        }
+    }
+
+protected:
+    std::exception_ptr run_task()
     {
         try
         {
             task();
-            promise.set_value();
         }
         catch (...)
         {
-            promise.set_exception(std::current_exception());
+            return std::current_exception();
+        }
+
+        return nullptr;
+    }
+
+private:
+    std::function<void()> task;
+};
+
+/* A task with a promise that's kept once it has run */
+class PromisedTaskEvent : public TaskEvent
+{
+public:
+    explicit PromisedTaskEvent(const std::function<void()>& task)
+        : TaskEvent(task)
+    {
+    }
+
+    void run() override
+    {
+        auto failure = run_task();
+        if (failure)
+        {
+            promise.set_exception(failure);
+        }
+        else
+        {
+            promise.set_value();
         }
     }
 
@@ -75,7 +116,6 @@ public:
     }
 
 private:
-    std::function<void()> task;
     std::promise<void> promise;
 };
 
@@ -163,25 +203,39 @@ void destroy()
     }).wait_for(std::chrono::seconds {1});
 }
 
-std::future<void> enter_with_task(const std::function<void()>& task)
+namespace detail
+{
+/* We hand over ownership of te here. The event is deleted later after it
+   has been processed by the event loop. */
+void post(TaskEvent* te)
 {
     QCoreApplication* instance = QCoreApplication::instance();
 
     if (!instance)
     {
+        delete te;
         throw std::runtime_error("Qt world has not been built before calling this function.");
     }
 
-    detail::TaskEvent* te = new detail::TaskEvent(task);
+    instance->postEvent(task_handler(), te);
+}
+}
+
+std::future<void> enter_with_task(const std::function<void()>& task)
+{
+    auto te = new detail::PromisedTaskEvent(task);
     auto future = te->get_future();
 
-    // We hand over ownership of te here. The event is deleted later after it has
-    // been processed by the event loop.
-    instance->postEvent(detail::task_handler(), te);
+    detail::post(te);
 
     return future;
 }
 
+void post_task(const std::function<void()>& task)
+{
+    detail::post(new detail::TaskEvent(task));
+}
+
 }
 }
 }
@@ -53,6 +53,11 @@ void destroy();
  */
 std::future<void> enter_with_task(const std::function<void()>& task);
 
+/**
+ * @brief Schedules the given task for execution in the Qt core world without a way to wait for it.
+ * @param task The task to be executed in the Qt core world.
+ */
+void post_task(const std::function<void()>& task);
 
 /**
  * @brief Enters the Qt core world and schedules the given task for execution.
@@ -19,6 +19,7 @@
 #include <glib.h>
 
 #include "refund-http.h"
+#include "logging.h"
 
 namespace Refund
 {
@@ -69,7 +70,7 @@ public:
         });
         request->error.connect([this](std::string error)
         {
-            std::cerr << "Error refunding item '" << error << std::endl;
+            pay_warning(HTTP, "Error refunding item '%s' of '%s': %s", item.c_str(), app.c_str(), error.c_str());
             finished(false);
         });
         request->run();
@@ -27,14 +27,25 @@
 /* Accounts Service */
 #include <Accounts/Manager>
 
+#include <QTimer>
+
 class TokenGrabberU1Qt: public QObject
 {
     Q_OBJECT
 
 public:
-    explicit TokenGrabberU1Qt (QObject* parent = 0);
+    enum class Credentials
+    {
+        PENDING,
+        FOUND,
+        MISSING
+    };
+
+    typedef std::function<void(Credentials, std::shared_ptr<const UbuntuOne::Token>)> Changed;
+
+    explicit TokenGrabberU1Qt (Changed in_changed,
+                               QObject* parent = 0);
     void run (void);
-    std::string signUrl(std::string url, std::string type);
 
 private Q_SLOTS:
     void handleCredentialsFound(const UbuntuOne::Token& token);
@@ -43,13 +54,15 @@ private Q_SLOTS:
     void accountChanged(Accounts::AccountId id);
 
 private:
-    UbuntuOne::Token token;
+    Changed changed;
     UbuntuOne::SSOService service;
     Accounts::Manager manager;
 };
 
-TokenGrabberU1Qt::TokenGrabberU1Qt (QObject* parent) :
+TokenGrabberU1Qt::TokenGrabberU1Qt (Changed in_changed,
+                                    QObject* parent) :
     QObject(parent),
+    changed(in_changed),
     manager("ubuntuone")
 {
     qDebug() << "Token grabber built";
@@ -103,20 +116,20 @@ void TokenGrabberU1Qt::accountChanged(Accounts::AccountId /*id*/)
        we're not getting a specific account or anything. Just
        watching for changes */
     qDebug() << "Account changed, try to get a new token";
-    token = UbuntuOne::Token();
+    changed(Credentials::PENDING, nullptr);
     service.getCredentials();
 }
 
 void TokenGrabberU1Qt::handleCredentialsFound(const UbuntuOne::Token& in_token)
 {
     qDebug() << "Got a Token";
-    token = in_token;
+    changed(Credentials::FOUND, std::make_shared<const UbuntuOne::Token>(in_token));
 }
 
 void TokenGrabberU1Qt::handleCredentialsNotFound()
 {
     qWarning() << "No Token :-(";
-    token = UbuntuOne::Token();
+    changed(Credentials::MISSING, nullptr);
 }
 
 void TokenGrabberU1Qt::handleCredentialsStored()
@@ -125,25 +138,39 @@ void TokenGrabberU1Qt::handleCredentialsStored()
     service.getCredentials();
 }
 
-std::string TokenGrabberU1Qt::signUrl (std::string url, std::string type)
+TokenGrabberU1::TokenGrabberU1 ()
 {
-    std::string retval;
+    /* Nothing can be signed until the first credentials come back, close
+       the gate before the Qt side has a chance to answer */
+    credentialsPending();
 
-    auto qretval = token.signUrl(url.c_str(), type.c_str());
-    retval = std::string(qretval.toUtf8());
-
-    return retval;
-}
-
-TokenGrabberU1::TokenGrabberU1 ():
-    //qt = std::make_shared<TokenGrabberU1Qt>();
-    qtfuture(qt::core::world::enter_with_task_and_expect_result<std::shared_ptr<TokenGrabberU1Qt>>([]()
+    qtfuture = qt::core::world::enter_with_task_and_expect_result<std::shared_ptr<TokenGrabberU1Qt>>([this]()
     {
-        auto qtgrabber = std::make_shared<TokenGrabberU1Qt>();
+        auto qtgrabber = std::make_shared<TokenGrabberU1Qt>([this](TokenGrabberU1Qt::Credentials credentials,
+                                                                       std::shared_ptr<const UbuntuOne::Token> snapshot)
+        {
+            /* Published before the gate opens so that everything waiting
+               on it signs with the new credentials */
+            std::atomic_store(&token, snapshot);
+
+            switch (credentials)
+            {
+                case TokenGrabberU1Qt::Credentials::PENDING:
+                    credentialsPending();
+                    break;
+                case TokenGrabberU1Qt::Credentials::FOUND:
+                    credentialsSettled();
+                    tokenUpdated(true);
+                    break;
+                case TokenGrabberU1Qt::Credentials::MISSING:
+                    credentialsSettled();
+                    tokenUpdated(false);
+                    break;
+            }
+        });
         qtgrabber->run();
         return qtgrabber;
-    }))
-{
+    });
 }
 
 TokenGrabberU1::~TokenGrabberU1 (void)
@@ -152,18 +179,29 @@ TokenGrabberU1::~TokenGrabberU1 (void)
 
 std::string TokenGrabberU1::signUrl (std::string url, std::string type)
 {
-    if (qtfuture.valid())
-    {
-        grabber = qtfuture.get();
-    }
+    std::string retval;
 
-    if (grabber != nullptr)
+    /* Signing is just an HMAC over our own copy of the token, there's
+       no need to bother the Qt thread with it */
+    auto current = std::atomic_load(&token);
+    if (current == nullptr)
     {
-        return grabber->signUrl(url, type);
+        return retval;
     }
 
-    std::string retval;
+    auto qretval = current->signUrl(url.c_str(), type.c_str());
+    retval = std::string(qretval.toUtf8());
+
     return retval;
 }
 
+void TokenGrabberU1::armDeadline (const std::chrono::milliseconds& length,
+                                  std::function<void()> expired)
+{
+    qt::core::world::post_task([length, expired]()
+    {
+        QTimer::singleShot(length.count(), expired);
+    });
+}
+
 #include "token-grabber-u1.moc"
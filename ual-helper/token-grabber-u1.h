@@ -24,6 +24,10 @@
 #include "token-grabber.h"
 
 class TokenGrabberU1Qt;
+namespace UbuntuOne
+{
+class Token;
+}
 
 class TokenGrabberU1 : public TokenGrabber
 {
@@ -33,9 +37,16 @@ public:
 
     virtual std::string signUrl(std::string url, std::string type);
 
+protected:
+    virtual void armDeadline (const std::chrono::milliseconds& length,
+                              std::function<void()> expired) override;
+
 private:
+    /* Owns the Qt side, which lives and dies on the Qt thread */
     std::future<std::shared_ptr<TokenGrabberU1Qt>> qtfuture;
-    std::shared_ptr<TokenGrabberU1Qt> grabber;
+    /* The current credentials, replaced as a whole whenever they change
+       and only ever read through std::atomic_load() */
+    std::shared_ptr<const UbuntuOne::Token> token;
 };
 
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "token-grabber.h"
+
+/* How long requests wait for credentials before going out with
+   whatever we've got */
+static const std::chrono::milliseconds deadline{10000};
+
+TokenGrabber::TokenGrabber (void) :
+    gate(std::make_shared<Gate>())
+{
+}
+
+TokenGrabber::~TokenGrabber (void)
+{
+}
+
+void
+TokenGrabber::whenReady (std::function<void()> work)
+{
+    std::unique_lock<std::mutex> lock(gate->mutex);
+    if (!gate->ready)
+    {
+        gate->parked.push_back(work);
+        return;
+    }
+    lock.unlock();
+
+    work();
+}
+
+void
+TokenGrabber::credentialsPending (void)
+{
+    std::unique_lock<std::mutex> lock(gate->mutex);
+    gate->ready = false;
+    auto waiting = ++gate->pending;
+    lock.unlock();
+
+    std::weak_ptr<Gate> weak = gate;
+    armDeadline(deadline, [weak, waiting]()
+    {
+        auto current = weak.lock();
+        if (!current)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(current->mutex);
+        if (current->ready || waiting != current->pending)
+        {
+            return;
+        }
+
+        current->release(lock);
+    });
+}
+
+void
+TokenGrabber::credentialsSettled (void)
+{
+    std::unique_lock<std::mutex> lock(gate->mutex);
+    gate->release(lock);
+}
+
+/* Opens the gate and lets everyone that was waiting go at once */
+void
+TokenGrabber::Gate::release (std::unique_lock<std::mutex>& lock)
+{
+    ready = true;
+    std::vector<std::function<void()>> waiting;
+    waiting.swap(parked);
+    lock.unlock();
+
+    for (auto& work : waiting)
+    {
+        work();
+    }
+}
@@ -20,20 +20,57 @@
 #ifndef TOKEN_GRABBER_HPP__
 #define TOKEN_GRABBER_HPP__ 1
 
-#include <string>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <core/signal.h>
 
 class TokenGrabber
 {
 public:
+    TokenGrabber (void);
+    virtual ~TokenGrabber (void);
+
     virtual std::string signUrl(std::string url, std::string type) = 0;
 
+    /* Runs @work once there are credentials to sign with, or once we've
+       given up waiting for them. Never blocks, so @work runs either on
+       the calling thread or on the one that settles the credentials. */
+    void whenReady (std::function<void()> work);
+
     typedef std::shared_ptr<TokenGrabber> Ptr;
 
     /* Signals */
     core::Signal<bool> tokenUpdated;
+
+protected:
+    /* The credentials were dropped and new ones have been asked for */
+    void credentialsPending (void);
+    /* We either have credentials or know that we won't get any */
+    void credentialsSettled (void);
+
+    /* Calls @expired after @length on the implementation's own loop */
+    virtual void armDeadline (const std::chrono::milliseconds& length,
+                              std::function<void()> expired) = 0;
+
+private:
+    /* Kept apart from us so that a deadline that's still armed when
+       we go away finds nothing rather than us */
+    struct Gate
+    {
+        std::mutex mutex;
+        bool ready = true;
+        unsigned int pending = 0;
+        std::vector<std::function<void()>> parked;
+
+        void release (std::unique_lock<std::mutex>& lock);
+    };
+
+    std::shared_ptr<Gate> gate;
 };
 
 #endif /* TOKEN_GRABBER_HPP__ */
@@ -47,6 +47,10 @@ public:
     virtual bool running () = 0;
     virtual Item::Ptr verifyItem (const std::string& appid, const std::string& itemid) = 0;
 
+    /* Tells the factory that any result it remembers for the item is out of
+       date, for instance because the item was just purchased or refunded */
+    virtual void invalidate (const std::string& /*appid*/, const std::string& /*itemid*/) {}
+
     typedef std::shared_ptr<Factory> Ptr;
 };
 
@@ -18,10 +18,19 @@
  */
 
 #include "verification-http.h"
+#include "glib-thread.h"
+#include "logging.h"
 
 #include <QDateTime>
 #include <json/json.h>
 
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
 
 namespace Verification
 {
@@ -39,15 +48,390 @@ static time_t parse_iso_utc_timestamp(const std::string& isotime)
     return when.toTime_t();
 }
 
-class HttpItem : public Item
+static Item::Status status_from_state(const std::string& state)
+{
+    if (state == "available")
+    {
+        return Item::Status::NOT_PURCHASED;
+    }
+    else if (state == "purchased")
+    {
+        return Item::Status::PURCHASED;
+    }
+    else if (state == "approved")
+    {
+        return Item::Status::APPROVED;
+    }
+
+    return Item::Status::ERROR;
+}
+
+/* Remembers the parsed result of each verification URL along with the
+   validators the server sent, so repeated verifications can either be
+   answered directly while fresh, or revalidated with a conditional GET
+   that skips both the body transfer and the JSON parsing. Errors are
+   never kept, the next verification asks the server again. */
+class HttpFactory::Cache
+{
+public:
+    struct Entry
+    {
+        std::string app;
+        std::string item;
+        std::string etag;
+        std::string last_modified;
+        Item::Status status = Item::Status::ERROR;
+        uint64_t refundable_until = 0;
+        std::chrono::steady_clock::time_point fetched;
+        bool stale = false;
+    };
+
+    /* How long a result is used without asking the server again */
+    static constexpr std::chrono::seconds freshness{30};
+
+    /* Results kept for revalidation, the oldest go first */
+    static constexpr size_t maxEntries{256};
+
+    bool lookup (const std::string& url, Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = entries.find(url);
+        if (it == entries.end())
+        {
+            return false;
+        }
+
+        entry = it->second;
+        return true;
+    }
+
+    static bool isFresh (const Entry& entry)
+    {
+        return !entry.stale &&
+               (std::chrono::steady_clock::now() - entry.fetched) < freshness;
+    }
+
+    void store (const std::string& url, Entry entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        entry.fetched = std::chrono::steady_clock::now();
+        entry.stale = false;
+
+        if (entries.size() >= maxEntries && entries.find(url) == entries.end())
+        {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); it++)
+            {
+                if (it->second.fetched < oldest->second.fetched)
+                {
+                    oldest = it;
+                }
+            }
+            entries.erase(oldest);
+        }
+
+        entries[url] = entry;
+    }
+
+    /* The server told us our copy is still good */
+    void revalidated (const std::string& url)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = entries.find(url);
+        if (it != entries.end())
+        {
+            it->second.fetched = std::chrono::steady_clock::now();
+            it->second.stale = false;
+        }
+    }
+
+    /* We keep the validators so the next request can still be
+       conditional, but the result has to be confirmed by the server.
+       Someone is waiting on that confirmation, so it's also urgent. */
+    void invalidate (const std::string& app, const std::string& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& entry : entries)
+        {
+            if (entry.second.app == app && entry.second.item == item)
+            {
+                entry.second.stale = true;
+            }
+        }
+
+        urgent.insert(std::make_pair(app, item));
+    }
+
+    /* Returns whether the next verification of the item is one the user
+       is waiting on, and clears that */
+    bool takeUrgent (const std::string& app, const std::string& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return urgent.erase(std::make_pair(app, item)) > 0;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+    std::set<std::pair<std::string, std::string>> urgent;
+};
+
+constexpr std::chrono::seconds HttpFactory::Cache::freshness;
+constexpr size_t HttpFactory::Cache::maxEntries;
+
+/* Lists every item of a package in one request and answers the item
+   verifications for that package from the listing, both the ones that
+   were waiting on it and the ones that come in while it's fresh. Items
+   that aren't in the listing are left to be fetched one by one. */
+class HttpFactory::Inventory : public std::enable_shared_from_this<HttpFactory::Inventory>
+{
+public:
+    typedef std::function<void(bool found, Item::Status status)> Callback;
+
+    /* How long a listing is used before the package is listed again */
+    static constexpr std::chrono::seconds lifetime{30};
+
+    /* How long a listing can take before we stop waiting on it, and
+       leave the items to be fetched one by one */
+    static constexpr std::chrono::seconds deadline{60};
+
+    Inventory (Web::ClickPurchasesApi::Ptr cpa_in,
+               const std::shared_ptr<GLib::ContextThread>& timers_in):
+        cpa {cpa_in},
+        timers {timers_in}
+    {
+    }
+
+    /* NOTE: The callback is either called right away or on the thread
+       of the listing request */
+    void lookup (const std::string& package, const std::string& sku, Callback callback)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto& snapshot = snapshots[package];
+
+        if (snapshot.valid &&
+                (std::chrono::steady_clock::now() - snapshot.fetched) < lifetime)
+        {
+            auto it = snapshot.items.find(sku);
+            bool found = (it != snapshot.items.end());
+            auto status = found ? it->second : Item::Status::ERROR;
+            lock.unlock();
+
+            callback(found, status);
+            return;
+        }
+
+        snapshot.pending.push_back(std::make_pair(sku, callback));
+
+        if (snapshot.fetching)
+        {
+            return;
+        }
+
+        snapshot.fetching = true;
+        const auto generation = ++snapshot.generation;
+        auto request = cpa->getItemsInfo(package);
+        if (!snapshot.etag.empty())
+        {
+            request->set_header("If-None-Match", snapshot.etag);
+        }
+        request->set_header("Accept", "application/json");
+        std::weak_ptr<Inventory> weak = shared_from_this();
+        request->finished.connect([weak, package, generation](Web::Response::Ptr response)
+        {
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+
+            if (response->status() == 304)
+            {
+                self->complete(package, generation, true, nullptr, std::string());
+            }
+            else if (response->is_success())
+            {
+                std::map<std::string, Item::Status> items;
+                bool parsed = self->parse(response->body(), items);
+                self->complete(package, generation, parsed, parsed ? &items : nullptr, response->header("ETag"));
+            }
+            else
+            {
+                self->complete(package, generation, false, nullptr, std::string());
+            }
+        });
+        request->error.connect([weak, package, generation](std::string error)
+        {
+            pay_warning(HTTP, "Error listing items of '%s': %s", package.c_str(), error.c_str());
+            auto self = weak.lock();
+            if (self)
+            {
+                self->complete(package, generation, false, nullptr, std::string());
+            }
+        });
+
+        /* Kept until the next listing, letting go of it stops it */
+        snapshot.request = request;
+        lock.unlock();
+
+        timers->timeoutSeconds(deadline, [weak, package, generation]()
+        {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->complete(package, generation, false, nullptr, std::string());
+            }
+        });
+
+        request->run();
+    }
+
+    void invalidate (const std::string& package)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = snapshots.find(package);
+        if (it != snapshots.end())
+        {
+            it->second.fetched = std::chrono::steady_clock::time_point();
+        }
+    }
+
+private:
+    struct Snapshot
+    {
+        std::map<std::string, Item::Status> items;
+        std::chrono::steady_clock::time_point fetched;
+        std::string etag;
+        bool valid = false;
+        bool fetching = false;
+        /* Which listing we're waiting on, so that one we've given up
+           on can't answer for the next */
+        uint64_t generation = 0;
+        Web::Request::Ptr request;
+        std::vector<std::pair<std::string, Callback>> pending;
+    };
+
+    /* Stores the new listing, or keeps the old one when the server says
+       it's unchanged, and then answers everyone who was waiting. Does
+       nothing for a listing that was already completed, by its reply
+       or by the deadline, whichever came first. */
+    void complete (const std::string& package,
+                   uint64_t generation,
+                   bool success,
+                   std::map<std::string, Item::Status>* items,
+                   const std::string& etag)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto& snapshot = snapshots[package];
+
+        if (!snapshot.fetching || snapshot.generation != generation)
+        {
+            return;
+        }
+
+        snapshot.fetching = false;
+        if (items != nullptr)
+        {
+            snapshot.items.swap(*items);
+            snapshot.etag = etag;
+        }
+
+        /* An unchanged reply confirms the listing the ETag came with,
+           even when the listing after that one failed */
+        snapshot.valid = success && (items != nullptr || !snapshot.etag.empty());
+        if (snapshot.valid)
+        {
+            snapshot.fetched = std::chrono::steady_clock::now();
+        }
+
+        std::vector<std::pair<std::string, Callback>> pending;
+        pending.swap(snapshot.pending);
+        auto found = snapshot.items;
+        bool valid = snapshot.valid;
+        lock.unlock();
+
+        for (const auto& waiting : pending)
+        {
+            auto it = found.find(waiting.first);
+            if (valid && it != found.end())
+            {
+                waiting.second(true, it->second);
+            }
+            else
+            {
+                waiting.second(false, Item::Status::ERROR);
+            }
+        }
+    }
+
+    /* Accepts both a plain array of items and the HAL form with
+       the items under _embedded */
+    static bool parse (const std::string& body, std::map<std::string, Item::Status>& items)
+    {
+        Json::Reader reader(Json::Features::strictMode());
+        Json::Value root;
+        if (!reader.parse(body, root))
+        {
+            return false;
+        }
+
+        Json::Value list = root;
+        if (root.isObject() && root.isMember("_embedded"))
+        {
+            list = root["_embedded"]["item"];
+        }
+
+        if (!list.isArray())
+        {
+            return false;
+        }
+
+        for (const auto& entry : list)
+        {
+            if (entry.isObject() && entry.isMember("sku") && entry.isMember("state"))
+            {
+                /* Items in a state we don't understand are left out, so
+                   they're fetched one by one rather than reported as
+                   errors for as long as the listing lives */
+                auto status = status_from_state(entry["state"].asString());
+                if (status != Item::Status::ERROR)
+                {
+                    items[entry["sku"].asString()] = status;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    Web::ClickPurchasesApi::Ptr cpa;
+    std::shared_ptr<GLib::ContextThread> timers;
+    std::mutex mutex;
+    std::map<std::string, Snapshot> snapshots;
+};
+
+constexpr std::chrono::seconds HttpFactory::Inventory::lifetime;
+constexpr std::chrono::seconds HttpFactory::Inventory::deadline;
+
+class HttpItem : public Item, public std::enable_shared_from_this<HttpItem>
 {
 public:
     HttpItem(const std::string& app_in,
              const std::string& item_in,
-             Web::ClickPurchasesApi::Ptr cpa_in):
+             Web::ClickPurchasesApi::Ptr cpa_in,
+             std::shared_ptr<HttpFactory::Cache> cache_in,
+             std::shared_ptr<HttpFactory::Inventory> inventory_in):
         app {app_in},
         item {item_in},
-    cpa {cpa_in}
+    cpa {cpa_in},
+    cache {cache_in},
+    inventory {inventory_in}
     {
     }
 
@@ -57,6 +441,49 @@ public:
            1. if appid is 'click-scope', we're verifying the package itself which is in 'item'
            2. otherwise, we're verifying an iap where app is the package and item is the item
            Yes, this is confusing. :-) */
+        interactive = cache->takeUrgent(app, item);
+
+        if (app != "click-scope" && !interactive)
+        {
+            /* Most of the time the package listing knows about the item,
+               only ask for it directly when it doesn't. The listing can
+               outlive us, so it only gets a weak reference. */
+            std::weak_ptr<HttpItem> weak = shared_from_this();
+            inventory->lookup(app/*package*/, item/*item*/, [weak](bool found, Status status)
+            {
+                auto self = weak.lock();
+                if (!self)
+                {
+                    return;
+                }
+
+                if (found)
+                {
+                    self->verificationComplete(status, 0);
+                }
+                else
+                {
+                    self->fetch();
+                }
+            });
+            return true;
+        }
+
+        return fetch();
+    }
+
+private:
+    std::string app;
+    std::string item;
+    Web::ClickPurchasesApi::Ptr cpa;
+    std::shared_ptr<HttpFactory::Cache> cache;
+    std::shared_ptr<HttpFactory::Inventory> inventory;
+    Web::Request::Ptr request;
+    bool interactive = false;
+
+    /* Asks the server about this one item */
+    bool fetch (void)
+    {
         if (app != "click-scope")
         {
             request = cpa->getItemInfo(app/*package*/, item/*item*/);
@@ -66,85 +493,137 @@ public:
             request = cpa->getPackageInfo(item/*package*/, false);
         }
 
+        if (interactive)
+        {
+            request->set_priority(Web::Request::Priority::INTERACTIVE,
+                                  app != "click-scope" ? app : item);
+        }
+
+        const auto url = request->url();
+        HttpFactory::Cache::Entry cached;
+        const bool have_cached = cache->lookup(url, cached);
+
+        if (have_cached && HttpFactory::Cache::isFresh(cached))
+        {
+            verificationComplete(cached.status, cached.refundable_until);
+            return true;
+        }
+
+        if (have_cached)
+        {
+            if (!cached.etag.empty())
+            {
+                request->set_header("If-None-Match", cached.etag);
+            }
+            if (!cached.last_modified.empty())
+            {
+                request->set_header("If-Modified-Since", cached.last_modified);
+            }
+        }
+
         // Ensure we get JSON back
         request->set_header("Accept", "application/json");
-        request->finished.connect([this](Web::Response::Ptr response)
+        /* The request can still be answering after we've been let go */
+        std::weak_ptr<HttpItem> weak = shared_from_this();
+        request->finished.connect([weak, url, have_cached, cached](Web::Response::Ptr response)
         {
-            if (response->is_success ())
+            auto self = weak.lock();
+            if (!self)
             {
-                Json::Reader reader(Json::Features::strictMode());
-                Json::Value root;
-                reader.parse(response->body(), root);
+                return;
+            }
 
-                if (app == "click-scope")
-                {
-                    if  (root.isObject() && root.isMember("state"))
-                    {
-                        auto state = root["state"].asString();
-                        uint64_t refundable_until{0};
-                        if (root.isMember("refundable_until"))
-                        {
-                            auto tmp_r = root["refundable_until"].asString();
-                            std::cerr << "DEBUG: refundable_until: " << tmp_r.c_str() << std::endl;
-                            refundable_until = parse_iso_utc_timestamp(tmp_r);
-                            std::cerr << "DEBUG: parsed_refundable: " << refundable_until << std::endl;
-                        }
-                        verificationComplete(Status::PURCHASED,
-                                             refundable_until);
-                    }
-                }
-                else
+            if (have_cached && response->status() == 304)
+            {
+                self->cache->revalidated(url);
+                self->verificationComplete(cached.status, cached.refundable_until);
+            }
+            else if (response->is_success ())
+            {
+                HttpFactory::Cache::Entry entry;
+                entry.app = self->app;
+                entry.item = self->item;
+
+                if (self->parse(response->body(), entry.status, entry.refundable_until))
                 {
-                    if (root.isObject() && root.isMember("state"))
+                    /* A state we don't understand is worth asking about
+                       again next time rather than repeating for a while */
+                    if (entry.status != Status::ERROR)
                     {
-                        auto state = root["state"].asString();
-                        if (state == "available")
-                        {
-                            verificationComplete(Status::NOT_PURCHASED, 0);
-                        }
-                        else if (state == "purchased")
-                        {
-                            verificationComplete(Status::PURCHASED, 0);
-                        }
-                        else if (state == "approved")
-                        {
-                            verificationComplete(Status::APPROVED, 0);
-                        }
-                        else
-                        {
-                            verificationComplete(Status::ERROR, 0);
-                        }
+                        entry.etag = response->header("ETag");
+                        entry.last_modified = response->header("Last-Modified");
+                        self->cache->store(url, entry);
                     }
+
+                    self->verificationComplete(entry.status, entry.refundable_until);
                 }
             }
             else
             {
-                verificationComplete(Status::NOT_PURCHASED, 0);
+                self->verificationComplete(Status::NOT_PURCHASED, 0);
             }
         });
-        request->error.connect([this](std::string error)
+        request->error.connect([weak](std::string error)
         {
-            std::cerr << "Error verifying item '" << error << std::endl;
-            verificationComplete(Status::ERROR, 0);
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+
+            pay_warning(HTTP, "Error verifying item '%s' of '%s': %s", self->item.c_str(), self->app.c_str(), error.c_str());
+            self->verificationComplete(Status::ERROR, 0);
         });
         request->run();
 
         return true;
     }
 
-private:
-    std::string app;
-    std::string item;
-    Web::ClickPurchasesApi::Ptr cpa;
-    Web::Request::Ptr request;
+    /* Turns the server's JSON into a status, returns false if the
+       body didn't have a state for us to report */
+    bool parse (const std::string& body, Status& status, uint64_t& refundable_until)
+    {
+        Json::Reader reader(Json::Features::strictMode());
+        Json::Value root;
+        reader.parse(body, root);
+
+        if (!root.isObject() || !root.isMember("state"))
+        {
+            return false;
+        }
+
+        auto state = root["state"].asString();
+        refundable_until = 0;
+
+        if (app == "click-scope")
+        {
+            if (root.isMember("refundable_until"))
+            {
+                auto tmp_r = root["refundable_until"].asString();
+                refundable_until = parse_iso_utc_timestamp(tmp_r);
+                pay_debug(HTTP, "Refundable until '%s': %llu", tmp_r.c_str(),
+                          (unsigned long long)refundable_until);
+            }
+            status = Status::PURCHASED;
+        }
+        else
+        {
+            status = status_from_state(state);
+        }
+
+        return true;
+    }
 };
 
 /*********************
  * HttpFactory
  *********************/
 
-HttpFactory::HttpFactory (Web::ClickPurchasesApi::Ptr in_cpa):
-    cpa {in_cpa}
+HttpFactory::HttpFactory (Web::ClickPurchasesApi::Ptr in_cpa,
+                          const std::shared_ptr<GLib::ContextThread>& timers):
+    cpa {in_cpa},
+    cache {std::make_shared<Cache>()},
+    inventory {std::make_shared<Inventory>(in_cpa, timers)}
 {
 }
 
@@ -157,7 +636,18 @@ HttpFactory::running()
 Item::Ptr
 HttpFactory::verifyItem (const std::string& appid, const std::string& itemid)
 {
-    return std::make_shared<HttpItem>(appid, itemid, cpa);
+    return std::make_shared<HttpItem>(appid, itemid, cpa, cache, inventory);
+}
+
+void
+HttpFactory::invalidate (const std::string& appid, const std::string& itemid)
+{
+    cache->invalidate(appid, itemid);
+
+    if (appid != "click-scope")
+    {
+        inventory->invalidate(appid);
+    }
 }
 
 
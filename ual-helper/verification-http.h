@@ -20,21 +20,36 @@
 #include "verification-factory.h"
 #include "click-purchases-api.h"
 
+#include <memory>
 #include <string>
 
 #ifndef VERIFICATION_HTTP_HPP__
 #define VERIFICATION_HTTP_HPP__ 1
 
+namespace GLib
+{
+class ContextThread;
+}
+
 namespace Verification {
 
 class HttpFactory : public Factory {
 public:
-    explicit HttpFactory (Web::ClickPurchasesApi::Ptr cpa_in);
+    /* Listings that take too long are given up on with a timer
+       on the given thread */
+    HttpFactory (Web::ClickPurchasesApi::Ptr cpa_in,
+                 const std::shared_ptr<GLib::ContextThread>& timers);
     virtual bool running () override;
     virtual Item::Ptr verifyItem (const std::string& appid, const std::string& itemid) override;
+    virtual void invalidate (const std::string& appid, const std::string& itemid) override;
+
+    class Cache;
+    class Inventory;
 
 private:
     Web::ClickPurchasesApi::Ptr cpa;
+    std::shared_ptr<Cache> cache;
+    std::shared_ptr<Inventory> inventory;
 };
 
 } // ns Verification
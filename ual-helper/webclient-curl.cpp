@@ -16,21 +16,39 @@
 
 #include "webclient-curl.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib> // getenv()
+#include <mutex>
 #include <string>
-#include <thread>
 
 #include <curl/curl.h>
 #include <curl/easy.h>
 
+#include "logging.h"
+#include "stats.h"
+#include "worker-pool.h"
+
 namespace Web
 {
 
+static Stats::Counter statRequests("http.requests");
+static Stats::Counter statErrors("http.errors");
+static Stats::Counter statBytesSent("http.bytes_sent");
+static Stats::Counter statBytesReceived("http.bytes_received");
+static Stats::Histogram statLatency("http.latency");
+
 class CurlResponse : public Response
 {
 public:
-    CurlResponse (int status, std::string body) :
+    CurlResponse (long status,
+                  std::string body,
+                  std::map<std::string,std::string> headers) :
         _body(body),
+        _headers(headers),
         _status(status)
     {
     }
@@ -45,21 +63,65 @@ public:
         return _status == 200 ? true : false;
     }
 
+    virtual long status ()
+    {
+        return _status;
+    }
+
+    virtual std::string header (const std::string& key)
+    {
+        auto it = _headers.find(lowercase(key));
+        if (it == _headers.end())
+        {
+            return std::string();
+        }
+        return it->second;
+    }
+
+    static std::string lowercase (std::string str)
+    {
+        std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c)
+        {
+            return std::tolower(c);
+        });
+        return str;
+    }
+
 private:
     std::string _body;
-    int _status;
+    std::map<std::string,std::string> _headers;
+    long _status;
 };
 
 
-class CurlRequest : public Request
+/* One go at a request. It's all the worker running the transfer looks
+   at, so whoever has the request can let go of it at any time. */
+struct CurlTransfer
+{
+    std::string url;
+    std::map<std::string,std::string> headers;
+    std::vector<char> body;
+    bool sign = false;
+    TokenGrabber::Ptr token;
+
+    std::string buffer;
+    std::map<std::string,std::string> responseHeaders;
+    /* Set when the request is run again or goes away, cuts the
+       transfer short and keeps its result to itself */
+    std::atomic<bool> stop{false};
+};
+
+class CurlRequest : public Request, public std::enable_shared_from_this<CurlRequest>
 {
 public:
     CurlRequest (std::function<void(std::string&, std::map<std::string,std::string>&)> preWebHook,
                  const std::string& url,
                  bool sign,
-                 TokenGrabber::Ptr token) :
+                 TokenGrabber::Ptr token,
+                 std::shared_ptr<WorkerPool> workers) :
         _preWebHook(preWebHook),
-        stop(false),
+        _workers(workers),
+        _key("http:" + std::to_string(nextKey++)),
         _url(url),
         _sign(sign),
         _token(token)
@@ -68,7 +130,7 @@ public:
 
     ~CurlRequest (void)
     {
-        stopThread();
+        stopTransfer();
     }
 
     void set_post (const std::vector<char>& body) override
@@ -76,110 +138,194 @@ public:
         _body = body;
     }
 
-    void stopThread (void)
+    /* Cuts short the transfer that's out, if any, without waiting for
+       it. Nothing more is heard from it. */
+    void stopTransfer (void)
     {
-        stop = true;
-
-        if (exec.joinable())
+        std::lock_guard<std::mutex> lock(execMutex);
+        if (current)
         {
-            exec.join();
+            current->stop = true;
+            current.reset();
         }
+        /* Forget about any launch still waiting on the credentials */
+        launches++;
     }
 
     virtual bool run (void)
     {
-        stopThread();
-        transferBuffer.clear();
-        stop = false;
+        stopTransfer();
 
         if (_preWebHook)
         {
             _preWebHook(_url, _headers);
         }
 
-        /* Do the execution in another thread so we can wait on the
-           network socket. */
-        exec = std::thread([this]()
-        {
-            CURL* handle = curl_easy_init();
+        auto transfer = std::make_shared<CurlTransfer>();
+        transfer->url = _url;
+        transfer->headers = _headers;
+        transfer->body = _body;
+        transfer->sign = _sign;
+        transfer->token = _token;
+
+        std::unique_lock<std::mutex> lock(execMutex);
+        current = transfer;
+        unsigned int launch = launches;
+        lock.unlock();
 
-            /* Helps with threads */
-            curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
-            curl_easy_setopt(handle, CURLOPT_URL, _url.c_str());
-            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curlWrite);
-            curl_easy_setopt(handle, CURLOPT_WRITEDATA, this);
+        if (!_sign)
+        {
+            start(transfer);
+            return true;
+        }
 
-            if (getenv("U1_DEBUG") != nullptr)
+        /* Rather than going out unsigned while the credentials are being
+           refreshed, wait for them without holding on to a thread */
+        std::weak_ptr<CurlRequest> weak = shared_from_this();
+        _token->whenReady([weak, launch, transfer]()
+        {
+            auto self = weak.lock();
+            if (self && self->launches == launch)
             {
-                curl_easy_setopt(handle, CURLOPT_VERBOSE, 1L);
+                self->start(transfer);
             }
+        });
 
-            if (_body.empty())
+        return true;
+    }
+
+    /* The transfer blocks on the network socket, so it runs on one of
+       the workers. Runs of the same request share a key and stay in
+       order. The worker only holds on to us while it tells us how it
+       went, so letting go of a request stops it. */
+    void start (const std::shared_ptr<CurlTransfer>& transfer)
+    {
+        std::weak_ptr<CurlRequest> weak = shared_from_this();
+        _workers->submit(_key, [weak, transfer]()
+        {
+            if (transfer->stop)
             {
-                curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+                return;
             }
-            else
+
+            Response::Ptr response;
+            std::string message;
+            perform(*transfer, response, message);
+
+            auto self = weak.lock();
+            if (!self || transfer->stop)
             {
-                curl_easy_setopt(handle, CURLOPT_POST, 1L);
-                curl_easy_setopt(handle, CURLOPT_POSTFIELDS, &_body.front());
-                curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)_body.size());
+                return;
             }
 
-            /* Sign the request if needed */
-            if (_sign)
+            if (response)
             {
-                const char* method_name = _body.empty() ? "GET" : "POST";
-                auto auth = _token->signUrl(_url, method_name);
-
-                if (!auth.empty())
-                {
-                    set_header("Authorization", auth);
-                }
-                else
-                {
-                    std::cerr << "WARNING: Signing failed, submitting unsigned request." << std::endl;
-                }
+                self->finished(response);
             }
-
-            // set our headers in curl
-            struct curl_slist* curlHeaders = NULL;
-            if (!_headers.empty())
+            else
             {
-                for (auto& kv : _headers)
-                {
-                    auto line = kv.first + ": " + kv.second;
-                    curlHeaders = curl_slist_append(curlHeaders, line.c_str());
-                }
-                curl_easy_setopt(handle, CURLOPT_HTTPHEADER, curlHeaders);
+                self->error(message);
             }
+        });
+    }
 
-            /**** Do it! ****/
-            auto status = curl_easy_perform(handle);
+    static void perform (CurlTransfer& transfer, Response::Ptr& response, std::string& message)
+    {
+        CURL* handle = curl_easy_init();
+
+        /* Helps with threads */
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handle, CURLOPT_URL, transfer.url.c_str());
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curlWrite);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer);
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, curlHeader);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &transfer);
+        /* Lets a stopped transfer give up while it's still connecting
+           or waiting on the server, not just once data arrives */
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, curlProgress);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &transfer);
+
+        if (getenv("U1_DEBUG") != nullptr)
+        {
+            curl_easy_setopt(handle, CURLOPT_VERBOSE, 1L);
+        }
 
-            if (status == CURLE_OK)
-            {
-                long responsecode = 0;
-                curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responsecode);
+        if (transfer.body.empty())
+        {
+            curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+        }
+        else
+        {
+            curl_easy_setopt(handle, CURLOPT_POST, 1L);
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, &transfer.body.front());
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)transfer.body.size());
+        }
+
+        /* Sign the request if needed */
+        if (transfer.sign)
+        {
+            const char* method_name = transfer.body.empty() ? "GET" : "POST";
+            auto auth = transfer.token->signUrl(transfer.url, method_name);
 
-                finished(std::make_shared<CurlResponse>(responsecode,
-                                                        transferBuffer));
+            if (!auth.empty())
+            {
+                transfer.headers["Authorization"] = auth;
             }
             else
             {
-                error(curl_easy_strerror(status));
+                pay_warning(HTTP, "Signing failed, submitting unsigned request");
             }
+        }
+
+        // set our headers in curl
+        struct curl_slist* curlHeaders = NULL;
+        if (!transfer.headers.empty())
+        {
+            for (auto& kv : transfer.headers)
+            {
+                auto line = kv.first + ": " + kv.second;
+                curlHeaders = curl_slist_append(curlHeaders, line.c_str());
+            }
+            curl_easy_setopt(handle, CURLOPT_HTTPHEADER, curlHeaders);
+        }
 
-            curl_easy_cleanup(handle);
+        /**** Do it! ****/
+        auto started = std::chrono::steady_clock::now();
+        auto status = curl_easy_perform(handle);
 
-            /* Clean up headers */
-            if (curlHeaders != nullptr)
+        statRequests.add();
+        statLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - started));
+        statBytesSent.add(transfer.body.size());
+        statBytesReceived.add(transfer.buffer.size());
+
+        if (status == CURLE_OK)
+        {
+            long responsecode = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responsecode);
+
+            response = std::make_shared<CurlResponse>(responsecode,
+                                                      transfer.buffer,
+                                                      transfer.responseHeaders);
+        }
+        else
+        {
+            if (!transfer.stop)
             {
-                curl_slist_free_all (curlHeaders) ;
-                curlHeaders = nullptr;
+                statErrors.add();
             }
-        });
+            message = curl_easy_strerror(status);
+        }
 
-        return true;
+        curl_easy_cleanup(handle);
+
+        /* Clean up headers */
+        if (curlHeaders != nullptr)
+        {
+            curl_slist_free_all (curlHeaders) ;
+            curlHeaders = nullptr;
+        }
     }
 
     virtual void set_header (const std::string& key,
@@ -188,11 +334,22 @@ public:
         _headers[key] = value;
     }
 
+    virtual const std::string& url (void)
+    {
+        return _url;
+    }
+
 private:
     std::function<void(std::string&, std::map<std::string,std::string>&)> _preWebHook;
-    std::string transferBuffer;
-    std::thread exec;
-    bool stop;
+    std::shared_ptr<WorkerPool> _workers;
+    /* Never reused, a new request mustn't end up behind the transfers of
+       one that was at the same address */
+    static std::atomic<uint64_t> nextKey;
+    const std::string _key;
+    std::mutex execMutex;
+    /* The latest run, until it's stopped */
+    std::shared_ptr<CurlTransfer> current;
+    std::atomic<unsigned int> launches{0};
 
     std::string _url;
     std::map<std::string,std::string> _headers;
@@ -206,24 +363,71 @@ private:
                              void* user_data)
     {
         auto datasize = size * nmemb;
-        CurlRequest* request = static_cast<CurlRequest*>(user_data);
-        if (request->stop)
+        CurlTransfer* transfer = static_cast<CurlTransfer*>(user_data);
+        if (transfer->stop)
         {
-            std::cout << "cURL transaction stopped prematurely" << std::endl;
+            pay_debug(HTTP, "cURL transaction stopped prematurely");
             return 0;
         }
-        request->transferBuffer.append(static_cast<char*>(buffer), datasize);
+        transfer->buffer.append(static_cast<char*>(buffer), datasize);
+        return datasize;
+    }
+
+    /* Called by cURL every so often during the transfer, a non-zero
+       return aborts it */
+    static int curlProgress (void* user_data,
+                             curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+    {
+        CurlTransfer* transfer = static_cast<CurlTransfer*>(user_data);
+        return transfer->stop ? 1 : 0;
+    }
+
+    /* Called by cURL once per header line. We keep the headers with
+       lowercased keys so that lookups don't depend on server casing. */
+    static size_t curlHeader (char* buffer, size_t size, size_t nitems,
+                              void* user_data)
+    {
+        auto datasize = size * nitems;
+        CurlTransfer* transfer = static_cast<CurlTransfer*>(user_data);
+
+        std::string line(buffer, datasize);
+        auto colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            /* Status line or the blank line ending the headers */
+            return datasize;
+        }
+
+        auto key = CurlResponse::lowercase(line.substr(0, colon));
+        auto value = line.substr(colon + 1);
+        auto first = value.find_first_not_of(" \t");
+        auto last = value.find_last_not_of(" \t\r\n");
+        if (first == std::string::npos)
+        {
+            value.clear();
+        }
+        else
+        {
+            value = value.substr(first, last - first + 1);
+        }
+
+        transfer->responseHeaders[key] = value;
         return datasize;
     }
 };
 
 
+std::atomic<uint64_t> CurlRequest::nextKey{0};
+
+
 /*********************
  * CurlFactory
  *********************/
 
-CurlFactory::CurlFactory (TokenGrabber::Ptr token) :
-    tokenGrabber(token)
+CurlFactory::CurlFactory (TokenGrabber::Ptr token,
+                          std::shared_ptr<WorkerPool> workers) :
+    tokenGrabber(token),
+    workers(workers)
 {
     /* TODO: We should check to see if we have networking someday */
     curl_global_init(CURL_GLOBAL_SSL);
@@ -245,7 +449,7 @@ Request::Ptr
 CurlFactory::create_request (const std::string& url,
                              bool sign)
 {
-    return std::make_shared<CurlRequest>(preWebHook, url, sign, tokenGrabber);
+    return std::make_shared<CurlRequest>(preWebHook, url, sign, tokenGrabber, workers);
 }
 
 } // ns Web
@@ -17,17 +17,23 @@
 #include "webclient-factory.h"
 #include "token-grabber.h"
 
+#include <memory>
 #include <string>
 
+class WorkerPool;
 
 #ifndef WEBCLIENT_CURL_HPP__
 #define WEBCLIENT_CURL_HPP__ 1
 
 namespace Web {
 
+/* Transfers block on the network, they run on the given workers. Those
+   should be their own so that transfers and whatever waits on them
+   don't run each other out of threads. */
 class CurlFactory : public Factory {
 public:
-    explicit CurlFactory (TokenGrabber::Ptr token);
+    CurlFactory (TokenGrabber::Ptr token,
+                 std::shared_ptr<WorkerPool> workers);
     ~CurlFactory ();
 
     virtual bool running () override;
@@ -35,6 +41,7 @@ public:
                                          bool sign) override;
 private:
     TokenGrabber::Ptr tokenGrabber;
+    std::shared_ptr<WorkerPool> workers;
 };
 
 } // ns Web
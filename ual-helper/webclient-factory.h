@@ -32,14 +32,31 @@ class Response {
 public:
     virtual std::string& body () = 0;
     virtual bool is_success () = 0;
+    virtual long status () = 0;
+
+    /** Looks up a response header, the key is case insensitive.
+        Returns an empty string if the header wasn't sent */
+    virtual std::string header (const std::string& key) = 0;
 
     typedef std::shared_ptr<Response> Ptr;
 };
 
 class Request {
 public:
+    enum class Priority {
+        INTERACTIVE,
+        BACKGROUND
+    };
+
     virtual bool run (void) = 0;
 
+    virtual const std::string& url (void) = 0;
+
+    /** Hint for factories that queue requests. The group is what requests
+            are queued fairly between, usually the package they're for */
+    virtual void set_priority (Priority /*priority*/,
+                               const std::string& /*group*/) {}
+
     virtual void set_header (const std::string& key,
                              const std::string& value) = 0;
 
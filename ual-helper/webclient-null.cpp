@@ -35,6 +35,11 @@ public:
         return false;
     }
 
+    virtual const std::string& url (void) override
+    {
+        return _url;
+    }
+
     virtual void set_header (const std::string& /*key*/,
                              const std::string& /*value*/) override
     {
@@ -43,6 +48,9 @@ public:
     virtual void set_post (const std::vector<char>& /*body*/) override
     {
     }
+
+private:
+    std::string _url;
 };
 
 
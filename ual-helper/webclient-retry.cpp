@@ -0,0 +1,451 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "webclient-retry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "glib-thread.h"
+#include "stats.h"
+
+namespace Web
+{
+
+/* How much of our traffic it takes to get through to the store */
+static Stats::Counter statRetries("http.retries");
+static Stats::Counter statHedges("http.hedges");
+static Stats::Counter statHedgeWins("http.hedge_wins");
+static Stats::Counter statExhausted("http.retries_exhausted");
+
+static std::string hostFromUrl (const std::string& url)
+{
+    auto start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    auto end = url.find('/', start);
+    return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+class RetryFactory::Policy
+{
+public:
+    static constexpr unsigned int maxRetries{3};
+    static constexpr std::chrono::milliseconds base{250};
+    static constexpr std::chrono::milliseconds cap{8000};
+    /* A server asking us to come back later than this is treated as a
+       failure rather than keeping the caller waiting */
+    static constexpr std::chrono::milliseconds maxRetryAfter{30000};
+    /* Latencies kept per host, and how many we need before hedging */
+    static constexpr size_t latencyWindow{64};
+    static constexpr size_t latencyMinimum{20};
+
+    explicit Policy (const std::shared_ptr<GLib::ContextThread>& in_timers) :
+        rng(std::random_device()()),
+        timers(in_timers)
+    {
+    }
+
+    /* How long to wait before the given retry, or a negative duration if
+       the server doesn't want us back soon enough */
+    std::chrono::milliseconds backoff (unsigned int retry, const Response::Ptr& response)
+    {
+        auto ceiling = std::min(cap, base * (1 << std::min(retry, 16u)));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        std::uniform_int_distribution<long> jitter(0, ceiling.count());
+        auto delay = std::chrono::milliseconds(jitter(rng));
+        lock.unlock();
+
+        if (response)
+        {
+            auto retry_after = parseRetryAfter(response->header("Retry-After"));
+            if (retry_after > maxRetryAfter)
+            {
+                return std::chrono::milliseconds(-1);
+            }
+            delay = std::max(delay, retry_after);
+        }
+
+        return delay;
+    }
+
+    void after (const std::chrono::milliseconds& delay, std::function<void()> work)
+    {
+        timers->timeout(delay, work);
+    }
+
+    void record (const std::string& host, const std::chrono::milliseconds& latency)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto& window = latencies[host];
+        window.push_back(latency);
+        if (window.size() > latencyWindow)
+        {
+            window.pop_front();
+        }
+    }
+
+    /* The p95 latency for the host, zero when we don't know it yet */
+    std::chrono::milliseconds hedgeDelay (const std::string& host)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto it = latencies.find(host);
+        if (it == latencies.end() || it->second.size() < latencyMinimum)
+        {
+            return std::chrono::milliseconds(0);
+        }
+
+        std::vector<std::chrono::milliseconds> sorted(it->second.begin(), it->second.end());
+        lock.unlock();
+
+        auto p95 = sorted.begin() + (sorted.size() * 95) / 100;
+        std::nth_element(sorted.begin(), p95, sorted.end());
+        return std::max(*p95, std::chrono::milliseconds(1));
+    }
+
+private:
+    /* We only handle the delta-seconds form, an HTTP date falls
+       back to our own backoff */
+    static std::chrono::milliseconds parseRetryAfter (const std::string& value)
+    {
+        if (value.empty() || !std::all_of(value.begin(), value.end(), ::isdigit))
+        {
+            return std::chrono::milliseconds(0);
+        }
+
+        try
+        {
+            return std::chrono::seconds(std::stol(value));
+        }
+        catch (...)
+        {
+            return maxRetryAfter + std::chrono::milliseconds(1);
+        }
+    }
+
+    std::mutex mutex;
+    std::mt19937 rng;
+    std::map<std::string, std::deque<std::chrono::milliseconds>> latencies;
+    std::shared_ptr<GLib::ContextThread> timers;
+};
+
+constexpr unsigned int RetryFactory::Policy::maxRetries;
+constexpr std::chrono::milliseconds RetryFactory::Policy::base;
+constexpr std::chrono::milliseconds RetryFactory::Policy::cap;
+constexpr std::chrono::milliseconds RetryFactory::Policy::maxRetryAfter;
+constexpr size_t RetryFactory::Policy::latencyWindow;
+constexpr size_t RetryFactory::Policy::latencyMinimum;
+
+class RetryRequest : public Request, public std::enable_shared_from_this<RetryRequest>
+{
+public:
+    RetryRequest (Factory::Ptr in_factory,
+                  const std::string& in_url,
+                  bool in_sign,
+                  std::shared_ptr<RetryFactory::Policy> in_policy) :
+        factory(in_factory),
+        policy(in_policy),
+        _url(in_url),
+        _host(hostFromUrl(in_url)),
+        _sign(in_sign)
+    {
+    }
+
+    virtual bool run (void) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        /* Anything still out from a previous run no longer matters */
+        generation++;
+        attempts.clear();
+        outstanding = 0;
+        retries = 0;
+        hedged = false;
+        done = false;
+        lock.unlock();
+
+        launch(false);
+        return true;
+    }
+
+    virtual const std::string& url (void) override
+    {
+        return _url;
+    }
+
+    virtual void set_header (const std::string& key,
+                             const std::string& value) override
+    {
+        _headers[key] = value;
+    }
+
+    virtual void set_post (const std::vector<char>& body) override
+    {
+        _body = body;
+    }
+
+    virtual void set_priority (Priority in_priority,
+                               const std::string& in_group) override
+    {
+        _priority = in_priority;
+        _group = in_group;
+        _prioritized = true;
+    }
+
+private:
+    Factory::Ptr factory;
+    std::shared_ptr<RetryFactory::Policy> policy;
+
+    std::string _url;
+    std::string _host;
+    bool _sign;
+    std::map<std::string,std::string> _headers;
+    std::vector<char> _body;
+    Priority _priority = Priority::BACKGROUND;
+    std::string _group;
+    bool _prioritized = false;
+
+    /****** protected by the mutex *******/
+    std::mutex mutex;
+    unsigned int generation = 0;
+    /* Attempts are kept until the next run, letting go of one stops it */
+    std::vector<Request::Ptr> attempts;
+    unsigned int outstanding = 0;
+    unsigned int retries = 0;
+    bool hedged = false;
+    bool done = false;
+
+    /* A GET can be sent again without changing anything on the server */
+    bool idempotent (void)
+    {
+        return _body.empty();
+    }
+
+    bool transient (long status)
+    {
+        switch (status)
+        {
+            case 429: /* Too Many Requests */
+            case 503: /* Service Unavailable */
+                /* The server didn't act on the request */
+                return true;
+            case 408: /* Request Timeout */
+            case 500: /* Internal Server Error */
+            case 502: /* Bad Gateway */
+            case 504: /* Gateway Timeout */
+                return idempotent();
+            default:
+                return false;
+        }
+    }
+
+    void launch (bool hedge)
+    {
+        auto attempt = factory->create_request(_url, _sign);
+        for (const auto& header : _headers)
+        {
+            attempt->set_header(header.first, header.second);
+        }
+        if (!_body.empty())
+        {
+            attempt->set_post(_body);
+        }
+        if (_prioritized)
+        {
+            attempt->set_priority(_priority, _group);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto gen = generation;
+        outstanding++;
+        attempts.push_back(attempt);
+        bool first = (retries == 0 && !hedge);
+        lock.unlock();
+
+        /* The attempt can still be answering after we've been let go */
+        std::weak_ptr<RetryRequest> weak = shared_from_this();
+        auto started = std::chrono::steady_clock::now();
+        attempt->finished.connect([weak, gen, hedge, started](Response::Ptr response)
+        {
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+            self->policy->record(self->_host, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - started));
+            self->result(gen, hedge, response, std::string());
+        });
+        attempt->error.connect([weak, gen, hedge](std::string message)
+        {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->result(gen, hedge, nullptr, message);
+            }
+        });
+        attempt->run();
+
+        if (first && idempotent())
+        {
+            auto delay = policy->hedgeDelay(_host);
+            if (delay.count() > 0)
+            {
+                policy->after(delay, [weak, gen]()
+                {
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->hedge(gen);
+                    }
+                });
+            }
+        }
+    }
+
+    /* The first attempt is slower than most, race a second one against it */
+    void hedge (unsigned int gen)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (gen != generation || done || hedged || retries > 0)
+        {
+            return;
+        }
+        hedged = true;
+        lock.unlock();
+
+        statHedges.add();
+        launch(true);
+    }
+
+    void retry (unsigned int gen)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (gen != generation || done)
+        {
+            return;
+        }
+        lock.unlock();
+
+        launch(false);
+    }
+
+    void result (unsigned int gen, bool hedge, Response::Ptr response, const std::string& message)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (gen != generation || done)
+        {
+            return;
+        }
+        outstanding--;
+
+        /* Transport errors on a POST are ambiguous, the server may well
+           have acted on it, so those are never sent again */
+        bool again = response ? transient(response->status()) : idempotent();
+
+        if (again && outstanding > 0)
+        {
+            /* The other attempt may still make it */
+            return;
+        }
+
+        std::chrono::milliseconds delay(-1);
+        if (again && retries < RetryFactory::Policy::maxRetries)
+        {
+            delay = policy->backoff(retries, response);
+        }
+
+        if (!again || delay.count() < 0)
+        {
+            done = true;
+            lock.unlock();
+
+            if (again)
+            {
+                statExhausted.add();
+            }
+            else if (hedge)
+            {
+                statHedgeWins.add();
+            }
+
+            if (response)
+            {
+                finished(response);
+            }
+            else
+            {
+                error(message);
+            }
+            return;
+        }
+
+        retries++;
+        lock.unlock();
+
+        statRetries.add();
+        std::weak_ptr<RetryRequest> weak = shared_from_this();
+        policy->after(delay, [weak, gen]()
+        {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->retry(gen);
+            }
+        });
+    }
+};
+
+/*********************
+ * RetryFactory
+ *********************/
+
+RetryFactory::RetryFactory (Factory::Ptr inner_factory,
+                            const std::shared_ptr<GLib::ContextThread>& timers) :
+    inner(inner_factory),
+    policy(std::make_shared<Policy>(timers))
+{
+}
+
+RetryFactory::~RetryFactory ()
+{
+}
+
+bool
+RetryFactory::running ()
+{
+    return inner->running();
+}
+
+Request::Ptr
+RetryFactory::create_request (const std::string& url,
+                              bool sign)
+{
+    return std::make_shared<RetryRequest>(inner, url, sign, policy);
+}
+
+void
+RetryFactory::setPreWebHook(std::function<void(std::string&, std::map<std::string,std::string>&)> hook)
+{
+    inner->setPreWebHook(hook);
+}
+
+} // ns Web
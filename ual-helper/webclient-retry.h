@@ -0,0 +1,60 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "webclient-factory.h"
+
+#include <memory>
+#include <string>
+
+
+#ifndef WEBCLIENT_RETRY_HPP__
+#define WEBCLIENT_RETRY_HPP__ 1
+
+namespace GLib
+{
+class ContextThread;
+}
+
+namespace Web {
+
+/* Sits in front of another factory and retries requests that failed in a
+   way that's likely to go away: exponential backoff with full jitter,
+   honoring Retry-After. GETs are retried on any transient failure, POSTs
+   only when the server said it didn't process them. A GET that's slower
+   than most to the same host also gets a hedged second attempt. The
+   waits are timers on the given thread. Retries and hedges are counted
+   in the process stats under http. */
+class RetryFactory : public Factory {
+public:
+    RetryFactory (Factory::Ptr inner_factory,
+                  const std::shared_ptr<GLib::ContextThread>& timers);
+    ~RetryFactory ();
+
+    virtual bool running () override;
+    virtual Request::Ptr create_request (const std::string& url,
+                                         bool sign) override;
+    virtual void setPreWebHook(std::function<void(std::string&, std::map<std::string,std::string>&)> hook) override;
+
+    class Policy;
+
+private:
+    Factory::Ptr inner;
+    std::shared_ptr<Policy> policy;
+};
+
+} // ns Web
+
+#endif /* WEBCLIENT_RETRY_HPP__ */
@@ -0,0 +1,379 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "webclient-scheduler.h"
+
+#include <deque>
+#include <mutex>
+
+namespace Web
+{
+
+class ScheduledRequest;
+
+class SchedulerFactory::Queue
+{
+public:
+    explicit Queue (unsigned int per_host) :
+        limit(per_host < 2 ? 2 : per_host)
+    {
+    }
+
+    void submit (const std::shared_ptr<ScheduledRequest>& request);
+    void done (const std::string& host, Request::Priority priority);
+
+private:
+    struct Class
+    {
+        /* Waiting requests for each group, and the order the groups
+           with waiting requests get their turn in */
+        std::map<std::string, std::deque<std::weak_ptr<ScheduledRequest>>> groups;
+        std::deque<std::string> turns;
+    };
+
+    struct Host
+    {
+        unsigned int running = 0;
+        unsigned int background = 0;
+        Class interactive;
+        Class queued;
+    };
+
+    /* Background requests leave one connection to interactive ones */
+    bool admits (const Host& host, Request::Priority priority)
+    {
+        if (host.running >= limit)
+        {
+            return false;
+        }
+
+        return priority == Request::Priority::INTERACTIVE ||
+               host.background < limit - 1;
+    }
+
+    void account (Host& host, Request::Priority priority)
+    {
+        host.running++;
+        if (priority == Request::Priority::BACKGROUND)
+        {
+            host.background++;
+        }
+    }
+
+    std::shared_ptr<ScheduledRequest> next (Class& queue);
+    std::shared_ptr<ScheduledRequest> next (Host& host);
+
+    const unsigned int limit;
+    std::mutex mutex;
+    std::map<std::string, Host> hosts;
+};
+
+class ScheduledRequest : public Request, public std::enable_shared_from_this<ScheduledRequest>
+{
+public:
+    ScheduledRequest (Request::Ptr inner_request,
+                      std::shared_ptr<SchedulerFactory::Queue> in_queue) :
+        inner(inner_request),
+        queue(in_queue),
+        host(hostFromUrl(inner_request->url()))
+    {
+    }
+
+    /* Hooks up to the inner request once we're shared, it can still be
+       answering after we've been let go */
+    void connect (void)
+    {
+        std::weak_ptr<ScheduledRequest> weak = shared_from_this();
+        inner->finished.connect([weak](Response::Ptr response)
+        {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->complete();
+                self->finished(response);
+            }
+        });
+        inner->error.connect([weak](std::string message)
+        {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->complete();
+                self->error(message);
+            }
+        });
+    }
+
+    /* A request that goes away with its connection gives it back */
+    ~ScheduledRequest ()
+    {
+        complete();
+    }
+
+    virtual bool run (void) override
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        if (started)
+        {
+            /* Goes again on the connection it already has */
+            lock.unlock();
+            return inner->run();
+        }
+        if (queued)
+        {
+            /* It's going to run as it is once there's room, running it
+               again before then isn't something we can do */
+            return false;
+        }
+        queued = true;
+        lock.unlock();
+
+        queue->submit(shared_from_this());
+        return true;
+    }
+
+    /* Called by the queue once there's room for us */
+    void start (void)
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        started = true;
+        lock.unlock();
+
+        inner->run();
+    }
+
+    virtual const std::string& url (void) override
+    {
+        return inner->url();
+    }
+
+    virtual void set_header (const std::string& key,
+                             const std::string& value) override
+    {
+        inner->set_header(key, value);
+    }
+
+    virtual void set_post (const std::vector<char>& body) override
+    {
+        inner->set_post(body);
+    }
+
+    virtual void set_priority (Priority in_priority,
+                               const std::string& in_group) override
+    {
+        priority = in_priority;
+        group = in_group;
+    }
+
+    const std::string& getHost (void)
+    {
+        return host;
+    }
+
+    const std::string& getGroup (void)
+    {
+        return group;
+    }
+
+    Priority getPriority (void)
+    {
+        return priority;
+    }
+
+private:
+    Request::Ptr inner;
+    std::shared_ptr<SchedulerFactory::Queue> queue;
+    std::string host;
+    std::string group;
+    Priority priority = Priority::BACKGROUND;
+
+    std::mutex state_mutex;
+    bool queued = false;
+    bool started = false;
+
+    /* Gives our connection back before anyone hears about the result so
+       the next request is already on its way. Only the first call after
+       we've started gives it back. */
+    void complete (void)
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        bool release = started;
+        queued = false;
+        started = false;
+        lock.unlock();
+
+        if (release)
+        {
+            queue->done(host, priority);
+        }
+    }
+
+    static std::string hostFromUrl (const std::string& url)
+    {
+        auto start = url.find("://");
+        start = (start == std::string::npos) ? 0 : start + 3;
+        auto end = url.find('/', start);
+        return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    }
+};
+
+/*********************
+ * Queue
+ *********************/
+
+void
+SchedulerFactory::Queue::submit (const std::shared_ptr<ScheduledRequest>& request)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto& host = hosts[request->getHost()];
+    auto priority = request->getPriority();
+
+    if (admits(host, priority))
+    {
+        account(host, priority);
+        lock.unlock();
+
+        request->start();
+        return;
+    }
+
+    auto& queue = (priority == Request::Priority::INTERACTIVE) ? host.interactive : host.queued;
+    auto& waiting = queue.groups[request->getGroup()];
+    if (waiting.empty())
+    {
+        queue.turns.push_back(request->getGroup());
+    }
+    waiting.push_back(request);
+}
+
+void
+SchedulerFactory::Queue::done (const std::string& hostname, Request::Priority priority)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto& host = hosts[hostname];
+
+    host.running--;
+    if (priority == Request::Priority::BACKGROUND)
+    {
+        host.background--;
+    }
+
+    auto request = next(host);
+    lock.unlock();
+
+    if (request)
+    {
+        request->start();
+    }
+}
+
+/* Takes the first live request from the group whose turn it is, and sends
+   the group to the back of the line if it has more waiting */
+std::shared_ptr<ScheduledRequest>
+SchedulerFactory::Queue::next (Class& queue)
+{
+    while (!queue.turns.empty())
+    {
+        auto group = queue.turns.front();
+        queue.turns.pop_front();
+
+        auto& waiting = queue.groups[group];
+        std::shared_ptr<ScheduledRequest> request;
+        while (!request && !waiting.empty())
+        {
+            request = waiting.front().lock();
+            waiting.pop_front();
+        }
+
+        if (waiting.empty())
+        {
+            queue.groups.erase(group);
+        }
+        else
+        {
+            queue.turns.push_back(group);
+        }
+
+        if (request)
+        {
+            return request;
+        }
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<ScheduledRequest>
+SchedulerFactory::Queue::next (Host& host)
+{
+    std::shared_ptr<ScheduledRequest> request;
+
+    if (admits(host, Request::Priority::INTERACTIVE))
+    {
+        request = next(host.interactive);
+        if (request)
+        {
+            account(host, Request::Priority::INTERACTIVE);
+            return request;
+        }
+    }
+
+    if (admits(host, Request::Priority::BACKGROUND))
+    {
+        request = next(host.queued);
+        if (request)
+        {
+            account(host, Request::Priority::BACKGROUND);
+            return request;
+        }
+    }
+
+    return nullptr;
+}
+
+/*********************
+ * SchedulerFactory
+ *********************/
+
+SchedulerFactory::SchedulerFactory (Factory::Ptr inner_factory,
+                                    unsigned int per_host) :
+    inner(inner_factory),
+    queue(std::make_shared<Queue>(per_host))
+{
+}
+
+bool
+SchedulerFactory::running ()
+{
+    return inner->running();
+}
+
+Request::Ptr
+SchedulerFactory::create_request (const std::string& url,
+                                  bool sign)
+{
+    auto request = std::make_shared<ScheduledRequest>(inner->create_request(url, sign), queue);
+    request->connect();
+    return request;
+}
+
+void
+SchedulerFactory::setPreWebHook(std::function<void(std::string&, std::map<std::string,std::string>&)> hook)
+{
+    inner->setPreWebHook(hook);
+}
+
+} // ns Web
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2015 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "webclient-factory.h"
+
+#include <string>
+
+
+#ifndef WEBCLIENT_SCHEDULER_HPP__
+#define WEBCLIENT_SCHEDULER_HPP__ 1
+
+namespace Web {
+
+/* Sits in front of another factory and holds requests back so that only
+   a few run against each host at once. Interactive requests go before
+   background ones and always have a connection kept free for them,
+   background requests take turns between their groups. */
+class SchedulerFactory : public Factory {
+public:
+    explicit SchedulerFactory (Factory::Ptr inner_factory,
+                               unsigned int per_host = 4);
+
+    virtual bool running () override;
+    virtual Request::Ptr create_request (const std::string& url,
+                                         bool sign) override;
+    virtual void setPreWebHook(std::function<void(std::string&, std::map<std::string,std::string>&)> hook) override;
+
+    class Queue;
+
+private:
+    Factory::Ptr inner;
+    std::shared_ptr<Queue> queue;
+};
+
+} // ns Web
+
+#endif /* WEBCLIENT_SCHEDULER_HPP__ */